@@ -0,0 +1,1019 @@
+#include "../inc/process.hpp"
+#include "../inc/analyze.hpp"
+#include "../inc/parser.hpp"
+#include "../inc/editor.hpp"
+#include "../inc/history.hpp"
+#include "../inc/complete.hpp"
+#include "../inc/batch.hpp"
+#include "../inc/stats.hpp"
+#include "../inc/plan.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <regex>
+#include <fstream>
+#include <iterator>
+#include <functional>
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <dirent.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <sys/utsname.h>
+
+using namespace process;
+
+namespace {
+
+using clock_t_  = std::chrono::steady_clock;
+using samples_t = std::vector<double>;
+using values_t  = std::vector<std::pair<std::string, double>>;
+
+struct Result
+{
+    std::string name;
+    values_t    values;     // the unit is part of the key
+};
+
+std::vector<Result> results;    // everything printed, for --json
+
+const size_t spawnIters     = 500;
+const size_t ballastBytes   = 512 * 1024 * 1024; // = 512 MiB
+const size_t parseIters     = 20000;
+const size_t keystrokeIters = 2000;
+const size_t pasteIters     = 200;
+const size_t pasteBytes     = 4000; // fits the pty line discipline buffer
+const size_t historySize    = 1000000;
+const size_t historyIters   = 1000;
+const size_t binaries       = 30000;
+const size_t completeIters  = 1000;
+const size_t rescanIters    = 20;
+const size_t pathDirs       = 16;
+const size_t hashIters      = 500;
+const size_t batchLines     = 2000;
+const size_t builtinIters   = 2000;
+const size_t copyBytes      = 256 * 1024 * 1024; // = 256 MiB
+const size_t copyIters      = 5;
+const size_t statsIters     = 1000;
+const size_t statsBatch     = 1000;   // records per sample, one is below the clock
+const size_t taskIters      = 500;
+const size_t pipeBytes      = 256 * 1024 * 1024; // = 256 MiB
+const size_t pipeIters      = 3;
+const size_t lookupBatch    = 1000;
+const size_t liveJobs[]     = {0, 64, 512};
+
+double toUsec(clock_t_::duration dur) noexcept
+{
+    return std::chrono::duration<double, std::micro>(dur).count();
+}
+
+void addResult(std::string const& name, values_t const& values)
+{
+    results.push_back({name, values});
+}
+
+void printSamples(std::string const& name, samples_t& samples)
+{
+    std::sort(samples.begin(), samples.end());
+
+    double sum = 0;
+    for (double sample : samples)
+        sum += sample;
+
+    auto percentile = [&samples](double p)
+    {
+        return samples[(size_t)(p * (samples.size() - 1))];
+    };
+
+    std::cout   << std::left << std::setw(32) << name << std::right
+                << std::fixed << std::setprecision(1)
+                << " mean " << std::setw(9) << sum / samples.size()
+                << " p50 "  << std::setw(9) << percentile(0.50)
+                << " p99 "  << std::setw(9) << percentile(0.99)
+                << " us\n";
+
+    addResult(name, {{"mean_us", sum / samples.size()}, {"p50_us", percentile(0.50)},
+                     {"p99_us", percentile(0.99)}, {"samples", samples.size()}});
+}
+
+std::string jsonString(std::string const& str)
+{
+    std::string json = "\"";
+    for (char ch : str)
+    {
+        if (ch == '"' || ch == '\\')
+            json += '\\';
+        if ((unsigned char)ch >= 0x20)
+            json += ch;
+    }
+    return json + "\"";
+}
+
+// one object per run: where and what was measured, then every result
+bool writeJson(std::string const& path, Process::ESpawn backend)
+{
+    struct utsname uts;
+    uname(&uts);
+
+    std::ofstream out(path);
+    out << std::setprecision(6)
+        << "{\n"
+        << "  \"schema\": 1,\n"
+        << "  \"revision\": " << jsonString(NANOSHELL_REVISION) << ",\n"
+        << "  \"time\": " << time(nullptr) << ",\n"
+        << "  \"host\": " << jsonString(uts.nodename) << ",\n"
+        << "  \"kernel\": " << jsonString(uts.release) << ",\n"
+        << "  \"machine\": " << jsonString(uts.machine) << ",\n"
+        << "  \"cpus\": " << sysconf(_SC_NPROCESSORS_ONLN) << ",\n"
+        << "  \"compiler\": " << jsonString(__VERSION__) << ",\n"
+        << "  \"spawn\": " << jsonString(Process::spawnBackendName(backend)) << ",\n"
+        << "  \"results\": [";
+
+    for (size_t idx = 0; idx < results.size(); idx++)
+    {
+        out << (idx ? "," : "") << "\n    {\"name\": " << jsonString(results[idx].name);
+        for (auto const& [key, value] : results[idx].values)
+        {
+            // an empty sample set or a zero time, JSON has no inf or nan
+            out << ", " << jsonString(key) << ": ";
+            if (std::isfinite(value))
+                out << value;
+            else
+                out << "null";
+        }
+        out << "}";
+    }
+
+    out << "\n  ]\n}\n";
+    return out.good();
+}
+
+// Enter-to-exit latency of `/bin/true` for every spawn backend
+void benchSpawn(std::string const& suffix)
+{
+    const Process::argv_t argv = {"/bin/true"};
+    const auto backends = {
+        Process::ESpawn::FORK,
+        Process::ESpawn::VFORK,
+        Process::ESpawn::POSIX_SPAWN
+    };
+
+    for (auto backend : backends)
+    {
+        Process::setSpawnBackend(backend);
+        samples_t samples;
+        samples.reserve(spawnIters);
+
+        for (size_t iter = 0; iter < spawnIters; iter++)
+        {
+            const auto begin = clock_t_::now();
+            Process process(argv);
+            process.join();
+            samples.push_back(toUsec(clock_t_::now() - begin));
+        }
+
+        printSamples(std::string("spawn/") +
+                     Process::spawnBackendName(backend) + suffix, samples);
+    }
+}
+
+std::vector<std::string> makeParseCorpus(size_t longArgc)
+{
+    std::string longLine = "grep -e";
+    for (size_t arg = 0; arg < longArgc; arg++)
+        longLine += " ./src/file_" + std::to_string(arg) + ".cpp";
+
+    return {
+        "ls",
+        "ls -la /usr/bin",
+        "grep -rn \"some pattern\" ./src ./inc &",
+        "find . -name main.cpp | wc -l",
+        "make release && ./nanoshell",
+        "test -f ./nanoshell || make debug",
+        "cat ./src/shell.cpp | grep -n tasks_ &",
+        longLine
+    };
+}
+
+// the classifier analyzeCmdLine used before the hand-written parser
+size_t legacyRegexClassify(std::vector<std::string> const& corpus, size_t iters)
+{
+    const std::string argv      = "((\"[^\"]+\")|([-_\\w\\d.,/]+))";
+    const std::string prefix    = "(([ ]+)" + argv + ")+";
+    const std::string postfix   = "(" + argv + "([ ]+))+";
+    const std::string bg        = "[ ]*( &)?[ ]*$";
+    const auto flags = std::regex_constants::ECMAScript | std::regex_constants::icase;
+
+    const std::regex regexes[] = {
+        std::regex("^[ ]*" + argv + "(([ ]+)" + argv + ")*" + bg, flags),
+        std::regex("^[ ]*" + postfix + "\\|{1}" + prefix + bg, flags),
+        std::regex("^[ ]*" + postfix + "(&&|\\|\\|)" + prefix + bg, flags)
+    };
+
+    size_t matched = 0;
+    for (size_t iter = 0; iter < iters; iter++)
+    for (auto const& line : corpus)
+    for (auto const& regex : regexes)
+    {
+        const auto begin = std::sregex_iterator(line.begin(), line.end(), regex);
+        if (std::distance(begin, std::sregex_iterator()) == 1)
+        {
+            matched++;
+            break;
+        }
+    }
+
+    return matched;
+}
+
+size_t parserClassify(std::vector<std::string> const& corpus, size_t iters)
+{
+    size_t matched = 0;
+    parser::CmdTree cmdTree;
+
+    // every line parsed again, the plan cache would answer the repeats
+    for (size_t iter = 0; iter < iters; iter++)
+    for (auto const& line : corpus)
+        matched += parser::parse(line, cmdTree);
+
+    return matched;
+}
+
+size_t cachedClassify(std::vector<std::string> const& corpus, size_t iters)
+{
+    size_t matched = 0;
+    parser::CmdTree cmdTree;
+
+    plan::Cache::get().clear();
+
+    // every line but the first of each is a hit, the way a loop repeats them
+    for (size_t iter = 0; iter < iters; iter++)
+    for (auto const& line : corpus)
+        matched += analyze::analyzeCmdLine(line, cmdTree) != analyze::ETypeCmdLine::UNKNOWN;
+
+    return matched;
+}
+
+// lines per second and MB/s of analyzeCmdLine over a mixed corpus
+template<typename Classify>
+void benchParseWith(std::string const& name, std::vector<std::string> const& corpus,
+                    size_t iters, Classify&& classify)
+{
+    size_t bytes = 0;
+    for (auto const& line : corpus)
+        bytes += line.size();
+
+    const auto begin    = clock_t_::now();
+    const size_t parsed = classify(corpus, iters);
+    const double sec    = std::chrono::duration<double>(clock_t_::now() - begin).count();
+    const double lines  = (double)corpus.size() * iters;
+
+    std::cout   << std::left << std::setw(32) << name << std::right
+                << std::fixed << std::setprecision(1)
+                << " " << std::setw(12) << lines / sec << " lines/s "
+                << std::setw(9) << bytes * iters / sec / 1e6 << " MB/s"
+                << " (" << parsed << " valid)\n";
+
+    addResult(name, {{"lines_per_s", lines / sec}, {"mb_per_s", bytes * iters / sec / 1e6}});
+}
+
+void benchParse(void)
+{
+    // std::regex recurses per repetition, so keep its long line moderate
+    const auto shortCorpus  = makeParseCorpus(32);
+    const auto longCorpus   = makeParseCorpus(Process::maxArgc - 2);
+
+    benchParseWith("parse/regex (legacy)", shortCorpus, parseIters / 10, legacyRegexClassify);
+    benchParseWith("parse/parser", shortCorpus, parseIters, parserClassify);
+    benchParseWith("parse/parser (254 args)", longCorpus, parseIters, parserClassify);
+    benchParseWith("parse/plan cache", shortCorpus, parseIters, cachedClassify);
+    benchParseWith("parse/plan cache (254 args)", longCorpus, parseIters, cachedClassify);
+}
+
+// the getChar_ loop the line editor replaced: termios and a syscall per byte.
+// it restores the saved (already raw) mode, a cooked pty would echo on its own
+void legacyEcho(int fd, size_t size)
+{
+    for (size_t idx = 0; idx < size; idx++)
+    {
+        char ch;
+        struct termios old;
+        tcgetattr(fd, &old);
+
+        struct termios raw = old;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        tcsetattr(fd, TCSANOW, &raw);
+
+        if (read(fd, &ch, 1) != 1)
+            return;
+
+        tcsetattr(fd, TCSADRAIN, &old);
+        write(fd, &ch, 1);
+    }
+}
+
+void editorEcho(editor::LineEditor& lineEditor, int fd, size_t size)
+{
+    char buf[BUFSIZ];
+
+    while (size)
+    {
+        const ssize_t readed = read(fd, buf, sizeof(buf));
+        if (readed <= 0)
+            return;
+
+        size_t used = 0;
+        lineEditor.feed(buf, readed, used);
+        lineEditor.flush();
+        size -= used;
+    }
+}
+
+// input written to the pty master until its echo is read back from it
+template<typename Echo>
+void benchEchoWith(std::string const& name, int master, std::string const& input,
+                   size_t iters, Echo&& echo)
+{
+    samples_t samples;
+    samples.reserve(iters);
+    std::string buf(input.size(), 0);
+
+    for (size_t iter = 0; iter < iters; iter++)
+    {
+        const auto begin = clock_t_::now();
+        write(master, input.data(), input.size());
+        echo(input.size());
+
+        for (size_t got = 0; got < input.size(); )
+        {
+            const ssize_t readed = read(master, buf.data(), input.size() - got);
+            if (readed <= 0)
+                return;
+            got += readed;
+        }
+
+        samples.push_back(toUsec(clock_t_::now() - begin));
+    }
+
+    printSamples(name, samples);
+}
+
+void benchEditor(void)
+{
+    const int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master == -1 || grantpt(master) == -1 || unlockpt(master) == -1)
+        return;
+
+    const int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    if (slave == -1)
+        return;
+
+    struct termios raw;
+    tcgetattr(slave, &raw);
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(slave, TCSANOW, &raw);
+
+    editor::LineEditor lineEditor(slave);
+    const std::string keystroke = "x";
+    const std::string paste(pasteBytes, 'x');
+
+    auto legacy = [slave](size_t size) { legacyEcho(slave, size); };
+    auto smart  = [&lineEditor, slave](size_t size)
+    {
+        lineEditor.begin();
+        editorEcho(lineEditor, slave, size);
+    };
+
+    benchEchoWith("echo/keystroke (legacy)", master, keystroke, keystrokeIters, legacy);
+    benchEchoWith("echo/keystroke (editor)", master, keystroke, keystrokeIters, smart);
+    benchEchoWith("echo/paste 4KB (legacy)", master, paste, pasteIters, legacy);
+    benchEchoWith("echo/paste 4KB (editor)", master, paste, pasteIters, smart);
+
+    close(slave);
+    close(master);
+}
+
+std::vector<std::string> makeHistoryCorpus(void)
+{
+    std::vector<std::string> corpus;
+
+    for (size_t idx = 0; idx < 2000; idx++)
+    {
+        corpus.push_back("git commit -m \"fix issue " + std::to_string(idx) + "\"");
+        corpus.push_back("make -j8 target_" + std::to_string(idx % 300));
+        corpus.push_back("ls -la /var/log/dir_" + std::to_string(idx));
+        corpus.push_back("cat ./src/file_" + std::to_string(idx) + ".cpp | grep -n TODO");
+    }
+
+    return corpus;
+}
+
+// appends, ctrl + r hits and misses and prefix lookups over a big ledger
+void benchHistory(void)
+{
+    char path[] = "/tmp/nanoshell_bench_history.XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd == -1)
+        return;
+    close(fd);
+    unlink(path);
+
+    history::History ledger;
+    if (!ledger.open(path))
+        return;
+
+    const auto corpus = makeHistoryCorpus();
+    uint64_t seed = 1;
+    auto random = [&seed](void)
+    {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        return seed >> 33;
+    };
+
+    const auto begin = clock_t_::now();
+    history::Entry entry;
+
+    for (size_t idx = 0; idx < historySize; idx++)
+    {
+        entry.cmdLine   = corpus[random() % corpus.size()];
+        entry.durationNs= random() % 1000000000;
+        ledger.append(entry);
+    }
+
+    const double sec = std::chrono::duration<double>(clock_t_::now() - begin).count();
+    std::cout   << std::left << std::setw(32) << "history/append" << std::right
+                << std::fixed << std::setprecision(1)
+                << " " << std::setw(12) << historySize / sec << " records/s"
+                << " (" << ledger.size() << " records)\n";
+
+    addResult("history/append", {{"records_per_s", historySize / sec}});
+
+    auto benchQuery = [&ledger](std::string const& name, auto&& query)
+    {
+        samples_t samples;
+        samples.reserve(historyIters);
+
+        for (size_t iter = 0; iter < historyIters; iter++)
+        {
+            const auto begin = clock_t_::now();
+            query(iter);
+            samples.push_back(toUsec(clock_t_::now() - begin));
+        }
+
+        printSamples(name, samples);
+    };
+
+    benchQuery("history/ctrl-r (hit)", [&ledger, &entry](size_t iter)
+    {
+        ledger.searchBack("issue " + std::to_string(iter % 2000) + "\"", 0, entry);
+    });
+    benchQuery("history/ctrl-r miss", [&ledger, &entry](size_t iter)
+    {
+        ledger.searchBack("ssh host_" + std::to_string(iter), 0, entry);
+    });
+    benchQuery("history/ctrl-r next (hit)", [&ledger, &entry](size_t iter)
+    {
+        // each keystroke continues from the current match
+        (void)iter;
+        ledger.searchBack("make", 0, entry);
+        ledger.searchBack("make -j8 target_1", entry.offset + entry.size, entry);
+    });
+
+    std::vector<history::Entry> entries;
+    benchQuery("history/prefix (16)", [&ledger, &entries](size_t iter)
+    {
+        ledger.findPrefix("ls -la /var/log/dir_" + std::to_string(iter % 2000), 16, entries);
+    });
+    benchQuery("history/prefix miss", [&ledger, &entries](size_t iter)
+    {
+        (void)iter;
+        ledger.findPrefix("ssh ", 16, entries);
+    });
+
+    ledger.close();
+    unlink(path);
+    unlink((std::string(path) + ".idx").c_str());
+    unlink((std::string(path) + ".sig").c_str());
+}
+
+// what a completion without an index does on every Tab
+size_t rescanPath(std::string const& pathEnv, std::string const& prefix)
+{
+    size_t found = 0;
+    size_t begin = 0;
+
+    while (begin <= pathEnv.size())
+    {
+        const size_t colon = std::min(pathEnv.find(':', begin), pathEnv.size());
+        DIR * dir = opendir(pathEnv.substr(begin, colon - begin).c_str());
+        begin = colon + 1;
+
+        if (dir == nullptr)
+            continue;
+
+        while (struct dirent * dirent = readdir(dir))
+            found += strncmp(dirent->d_name, prefix.c_str(), prefix.size()) == 0;
+        closedir(dir);
+    }
+
+    return found;
+}
+
+// Tab latency over a PATH with a big directory of binaries
+void benchComplete(void)
+{
+    char dirPath[] = "/tmp/nanoshell_bench_bin.XXXXXX";
+    if (mkdtemp(dirPath) == nullptr)
+        return;
+
+    for (size_t idx = 0; idx < binaries; idx++)
+    {
+        const std::string file = std::string(dirPath) + "/tool_" + std::to_string(idx);
+        const int fd = open(file.c_str(), O_WRONLY | O_CREAT, 0755);
+        if (fd != -1)
+            close(fd);
+    }
+
+    const char * oldPath = getenv("PATH");
+    const std::string savedPath = oldPath ? oldPath : "";
+    const std::string pathEnv = std::string(dirPath) + ":" + savedPath;
+    setenv("PATH", pathEnv.c_str(), 1);
+
+    complete::Completer completer;
+    std::vector<std::string> candidates;
+    samples_t samples;
+
+    auto begin = clock_t_::now();
+    completer.findCommands("tool_1", candidates);
+    samples.push_back(toUsec(clock_t_::now() - begin));
+    printSamples("complete/index build", samples);
+
+    auto benchTab = [](std::string const& name, size_t iters, auto&& tab)
+    {
+        samples_t samples;
+        samples.reserve(iters);
+
+        for (size_t iter = 0; iter < iters; iter++)
+        {
+            const auto begin = clock_t_::now();
+            tab(iter);
+            samples.push_back(toUsec(clock_t_::now() - begin));
+        }
+
+        printSamples(name, samples);
+    };
+
+    benchTab("complete/command (rescan)", rescanIters, [&pathEnv](size_t iter)
+    {
+        rescanPath(pathEnv, "tool_" + std::to_string(iter % 1000));
+    });
+    benchTab("complete/command (index)", completeIters, [&completer, &candidates](size_t iter)
+    {
+        completer.findCommands("tool_" + std::to_string(iter % 1000), candidates);
+    });
+    benchTab("complete/file (cached)", completeIters,
+             [&completer, &candidates, &dirPath](size_t iter)
+    {
+        completer.findFiles(std::string(dirPath) + "/tool_" + std::to_string(iter % 1000),
+                            candidates);
+    });
+
+    setenv("PATH", savedPath.c_str(), 1);
+
+    for (size_t idx = 0; idx < binaries; idx++)
+        unlink((std::string(dirPath) + "/tool_" + std::to_string(idx)).c_str());
+    rmdir(dirPath);
+}
+
+// `true` behind a PATH of directories that don't have it
+void benchPathHash(void)
+{
+    const char * oldPath = getenv("PATH");
+    const std::string savedPath = oldPath ? oldPath : "";
+    std::vector<std::string> dirs;
+    std::string pathEnv;
+
+    for (size_t idx = 0; idx < pathDirs; idx++)
+    {
+        char dirPath[] = "/tmp/nanoshell_bench_path.XXXXXX";
+        if (mkdtemp(dirPath) == nullptr)
+            break;
+        dirs.push_back(dirPath);
+        pathEnv += std::string(dirPath) + ":";
+    }
+
+    pathEnv += savedPath;
+    setenv("PATH", pathEnv.c_str(), 1);
+
+    auto benchRun = [](std::string const& name, auto&& run)
+    {
+        samples_t samples;
+        samples.reserve(hashIters);
+
+        for (size_t iter = 0; iter < hashIters; iter++)
+        {
+            const auto begin = clock_t_::now();
+            run();
+            samples.push_back(toUsec(clock_t_::now() - begin));
+        }
+
+        printSamples(name, samples);
+    };
+
+    std::string path;
+    benchRun("hash/lookup (walk)", [&path](void)
+    {
+        Process::clearPathHash();
+        Process::hashPath("true", path);
+    });
+    benchRun("hash/lookup (hashed)", [&path](void)
+    {
+        Process::hashPath("true", path);
+    });
+
+    // what ProcessSpawn_ did before: posix_spawnp walks PATH with execve
+    char * const argv[] = {(char *)"true", nullptr};
+    benchRun("hash/spawn (posix_spawnp)", [&argv](void)
+    {
+        pid_t pid;
+        int wstatus;
+        if (posix_spawnp(&pid, argv[0], nullptr, nullptr, argv, environ) == 0)
+            waitpid(pid, &wstatus, 0);
+    });
+    benchRun("hash/spawn (hashed)", [](void)
+    {
+        Process process({"true"});
+        process.join();
+    });
+
+    setenv("PATH", savedPath.c_str(), 1);
+    Process::clearPathHash();
+
+    for (auto const& dir : dirs)
+        rmdir(dir.c_str());
+}
+
+// script lines per second without a terminal, external and builtin
+void benchBatch(void)
+{
+    auto benchScript = [](std::string const& name, std::string const& cmdLine)
+    {
+        std::string script;
+        for (size_t line = 0; line < batchLines; line++)
+            script += cmdLine + "\n";
+
+        batch::Batch batch;
+        const auto begin = clock_t_::now();
+        batch.runString(script);
+        const double usec = toUsec(clock_t_::now() - begin);
+
+        std::cout   << std::left << std::setw(32) << name << std::right
+                    << std::fixed << std::setprecision(1)
+                    << " lines/s " << std::setw(9) << batchLines / usec * 1e6 << "\n";
+
+        addResult(name, {{"lines_per_s", batchLines / usec * 1e6}});
+    };
+
+    benchScript("batch/script (/bin/true)", "/bin/true");
+    benchScript("batch/script (noop)", "noop");
+
+    // a redirection instead of an extra cat and a pipe copy
+    char filePath[] = "/tmp/nanoshell_bench_redir.XXXXXX";
+    const int fd = mkstemp(filePath);
+    if (fd != -1)
+    {
+        const std::string chunk(64 * 1024, 'x');
+        for (size_t cnt = 0; cnt < 16; cnt++)
+            (void)!write(fd, chunk.data(), chunk.size());
+        close(fd);
+
+        benchScript("batch/redir (cat f | wc)", std::string("cat ") + filePath + " | wc -c > /dev/null");
+        benchScript("batch/redir (wc < f)", std::string("wc -c < ") + filePath + " > /dev/null");
+        unlink(filePath);
+    }
+
+    Process::setJobControl(true);
+}
+
+// the same builtin in a clone child and called by the shell itself
+void benchBuiltin(void)
+{
+    auto benchCall = [](std::string const& name, bool isInline)
+    {
+        samples_t samples;
+        samples.reserve(builtinIters);
+
+        for (size_t iter = 0; iter < builtinIters; iter++)
+        {
+            const auto begin = clock_t_::now();
+            Process process({"noop"}, Process::defStdFds, Process::defClsFds,
+                            Process::noPgid, isInline);
+            process.join();
+            samples.push_back(toUsec(clock_t_::now() - begin));
+        }
+
+        printSamples(name, samples);
+    };
+
+    benchCall("builtin/noop (clone)", false);
+    benchCall("builtin/noop (inline)", true);
+}
+
+// a whole command line the way the shell runs it: analyze, create, join
+int runCmdLine(std::string const& cmdLine)
+{
+    parser::CmdTree cmdTree;
+    const auto type = analyze::analyzeCmdLine(cmdLine, cmdTree);
+    const auto taskWrapper = analyze::createTask(cmdTree, type, true);
+    if (!taskWrapper)
+        return -1;
+
+    const int status = analyze::joinTask(taskWrapper->first, type);
+    std::visit([](auto task) { delete task; }, taskWrapper->first);
+    return status;
+}
+
+// Boolean and Ppipe latency, Ppipe throughput and the builtin lookup
+void benchTask(void)
+{
+    Process::setJobControl(false);
+
+    auto benchLine = [](std::string const& name, std::string const& cmdLine)
+    {
+        samples_t samples;
+        samples.reserve(taskIters);
+
+        for (size_t iter = 0; iter < taskIters; iter++)
+        {
+            const auto begin = clock_t_::now();
+            runCmdLine(cmdLine);
+            samples.push_back(toUsec(clock_t_::now() - begin));
+        }
+
+        printSamples(name, samples);
+    };
+
+    benchLine("task/single (true)", "true");
+    benchLine("task/boolean (true && true)", "true && true");
+    benchLine("task/boolean (false || true)", "false || true");
+    benchLine("task/ppipe (true | true)", "true | true");
+    benchLine("task/ppipe (noop | noop)", "noop | noop");
+
+    auto benchPipe = [](std::string const& name, size_t stages)
+    {
+        std::string cmdLine = "head -c " + std::to_string(pipeBytes) + " /dev/zero";
+        for (size_t stage = 1; stage < stages; stage++)
+            cmdLine += " | /bin/cat";
+        cmdLine += " > /dev/null";
+
+        const auto begin = clock_t_::now();
+        for (size_t iter = 0; iter < pipeIters; iter++)
+            runCmdLine(cmdLine);
+        const double usec = toUsec(clock_t_::now() - begin);
+        const double mbPerSec = pipeIters * pipeBytes / usec;
+
+        std::cout   << std::left << std::setw(32) << name << std::right
+                    << std::fixed << std::setprecision(1)
+                    << " MB/s    " << std::setw(9) << mbPerSec << "\n";
+
+        addResult(name, {{"mb_per_s", mbPerSec}});
+    };
+
+    benchPipe("task/ppipe 2 stages", 2);
+    benchPipe("task/ppipe 4 stages", 4);
+
+    samples_t samples;
+    samples.reserve(taskIters);
+
+    // the registry lookup every command pays before it spawns
+    for (size_t iter = 0; iter < taskIters; iter++)
+    {
+        const auto begin = clock_t_::now();
+        for (size_t idx = 0; idx < lookupBatch; idx++)
+            Process::isBuiltin(idx & 1 ? "noop" : "ls");
+        samples.push_back(toUsec(clock_t_::now() - begin));
+    }
+
+    printSamples("task/builtin lookup x1000", samples);
+    Process::setJobControl(true);
+}
+
+// what the shell pays per SIGCHLD with many background jobs alive:
+// a nonblocking reap with nothing to report, and a job finishing
+void benchReap(void)
+{
+    for (size_t live : liveJobs)
+    {
+        std::vector<std::unique_ptr<Process>> jobs;
+        for (size_t job = 0; job < live; job++)
+            jobs.emplace_back(new Process({"sleep", "60"}));
+
+        samples_t idle, done;
+        idle.reserve(taskIters);
+        done.reserve(taskIters);
+
+        for (size_t iter = 0; iter < taskIters; iter++)
+        {
+            Process::events_t events;
+
+            auto begin = clock_t_::now();
+            Process::reap(true, events);
+            idle.push_back(toUsec(clock_t_::now() - begin));
+
+            begin = clock_t_::now();
+            Process process({"/bin/true"});
+            while (!process.isDone(true))
+                Process::reap(false, events);
+            done.push_back(toUsec(clock_t_::now() - begin));
+        }
+
+        const std::string suffix = " (" + std::to_string(live) + " live)";
+        printSamples("reap/idle" + suffix, idle);
+        printSamples("reap/spawn+exit" + suffix, done);
+
+        for (auto& job : jobs)
+        {
+            job->KILL(Process::EKill::HUP);
+            job->join();
+        }
+    }
+}
+
+// cost of the self-metrics on the hot paths, per statsBatch records
+void benchStats(void)
+{
+    using stats::Stats;
+    using stats::EMetric;
+
+    auto benchRecord = [](std::string const& name, auto&& record)
+    {
+        samples_t samples;
+        samples.reserve(statsIters);
+
+        for (size_t iter = 0; iter < statsIters; iter++)
+        {
+            const auto begin = clock_t_::now();
+            for (size_t idx = 0; idx < statsBatch; idx++)
+                record(idx);
+            samples.push_back(toUsec(clock_t_::now() - begin));
+        }
+
+        printSamples(name, samples);
+    };
+
+    benchRecord("stats/record x1000", [](size_t idx)
+    {
+        Stats::get().record(EMetric::PARSE, idx * 997);
+    });
+    benchRecord("stats/timer x1000", [](size_t)
+    {
+        Stats::Timer timer(EMetric::PARSE);
+    });
+
+    Stats::get().reset();
+}
+
+bool isSameContent(std::string const& lhsPath, std::string const& rhsPath)
+{
+    std::ifstream lhs(lhsPath, std::ios::binary), rhs(rhsPath, std::ios::binary);
+    return lhs && rhs && std::equal(std::istreambuf_iterator<char>(lhs),
+                                    std::istreambuf_iterator<char>(),
+                                    std::istreambuf_iterator<char>(rhs),
+                                    std::istreambuf_iterator<char>());
+}
+
+// the cat builtin (sendfile, splice, copy_file_range) against coreutils
+void benchCopy(void)
+{
+    char srcPath[] = "/tmp/nanoshell_bench_copy.XXXXXX";
+    const int fd = mkstemp(srcPath);
+    if (fd == -1)
+        return;
+
+    const std::string chunk(1024 * 1024, 'x');
+    for (size_t size = 0; size < copyBytes; size += chunk.size())
+        (void)!write(fd, chunk.data(), chunk.size());
+    close(fd);
+
+    const std::string src = srcPath;
+    const std::string dst = src + ".out";
+
+    auto benchCmd = [](std::string const& name, std::string const& cmdLine)
+    {
+        std::string script;
+        for (size_t iter = 0; iter < copyIters; iter++)
+            script += cmdLine + "\n";
+
+        batch::Batch batch;
+        const auto begin = clock_t_::now();
+        batch.runString(script);
+        const double usec = toUsec(clock_t_::now() - begin);
+
+        std::cout   << std::left << std::setw(32) << name << std::right
+                    << std::fixed << std::setprecision(1)
+                    << " MiB/s   " << std::setw(9)
+                    << copyIters * copyBytes / usec * 1e6 / (1024 * 1024) << "\n";
+
+        addResult(name, {{"mib_per_s", copyIters * copyBytes / usec * 1e6 / (1024 * 1024)}});
+    };
+
+    benchCmd("copy/file (/bin/cat)", "/bin/cat " + src + " > " + dst);
+    benchCmd("copy/file (cat)", "cat " + src + " > " + dst);
+    benchCmd("copy/pipe (/bin/cat)", "/bin/cat " + src + " | /bin/cat > " + dst);
+    benchCmd("copy/pipe (cat)", "cat " + src + " | cat > " + dst);
+    benchCmd("copy/pipe (pv)", "cat " + src + " | pv | cat > " + dst);
+
+    // a pv in the middle passes the bytes and nothing else
+    if (!isSameContent(src, dst))
+    {
+        std::cerr << "copy/pipe (pv): " << dst << " differs from " << src << "\n";
+        exit(EXIT_FAILURE);
+    }
+
+    Process::setJobControl(true);
+    unlink(dst.c_str());
+    unlink(src.c_str());
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    const auto defBackend = Process::getSpawnBackend();
+
+    auto benchSpawnAll = [defBackend](void)
+    {
+        benchSpawn("");
+
+        // fork cost grows with the parent's page tables, vfork/posix_spawn don't
+        void * ballast = mmap(NULL, ballastBytes, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ballast != MAP_FAILED)
+        {
+            memset(ballast, 1, ballastBytes);
+            benchSpawn("+512MiB");
+            munmap(ballast, ballastBytes);
+        }
+
+        Process::setSpawnBackend(defBackend);
+    };
+
+    const std::vector<std::pair<std::string, std::function<void(void)>>> sections = {
+        {"spawn",       benchSpawnAll},
+        {"parse",       benchParse},
+        {"editor",      benchEditor},
+        {"history",     benchHistory},
+        {"complete",    benchComplete},
+        {"hash",        benchPathHash},
+        {"batch",       benchBatch},
+        {"builtin",     benchBuiltin},
+        {"task",        benchTask},
+        {"reap",        benchReap},
+        {"stats",       benchStats},
+        {"copy",        benchCopy}
+    };
+
+    std::string jsonPath;
+    std::vector<std::string> selected;
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        auto isSection = [&argv, arg](auto const& section) { return section.first == argv[arg]; };
+
+        if (strcmp(argv[arg], "--json") == 0 && arg + 1 < argc)
+            jsonPath = argv[++arg];
+        else if (std::any_of(sections.begin(), sections.end(), isSection))
+            selected.push_back(argv[arg]);
+        else
+        {
+            std::cerr << "usage: nanoshell_bench [--json <file>] [section]...\nsections:";
+            for (auto const& section : sections)
+                std::cerr << " " << section.first;
+            std::cerr << "\n";
+            return 2;
+        }
+    }
+
+    for (auto const& [name, bench] : sections)
+        if (selected.empty() || std::find(selected.begin(), selected.end(), name) != selected.end())
+            bench();
+
+    if (!jsonPath.empty() && !writeJson(jsonPath, defBackend))
+    {
+        std::cerr << jsonPath << ": can't write the results\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -2,8 +2,10 @@
 #include "single.hpp"
 #include "ppipe.hpp"
 #include "boolean.hpp"
+#include "parser.hpp"
 #include <variant>
 #include <optional>
+#include <ostream>
 
 namespace analyze {
 
@@ -19,7 +21,53 @@ using task_t        = std::variant<single::Single*,ppipe::Ppipe*,boolean::Boolea
 using pairTask_t    = std::pair<task_t, bool>;
 using optPairTask_t = std::optional<pairTask_t>;
 
-ETypeCmdLine    analyzeCmdLine  (std::string const& cmdLine) noexcept;
-optPairTask_t   createTask      (std::string const& cmdLine, ETypeCmdLine typeCmdLine) noexcept;
+constexpr const int64_t killGraceNs     = 2ll * 1000 * 1000 * 1000;   // = 2 s
+constexpr const int     timeoutStatus   = 124;  // like timeout(1)
+
+// wall clock limit of a running task
+struct Deadline
+{
+    int64_t atNs        = 0;        // steady clock, 0: nothing more to do
+    bool    isExpired   = false;    // TERM is sent, KILL is next
+};
+
+ETypeCmdLine    analyzeCmdLine  (std::string const& cmdLine,
+                                 parser::CmdTree& cmdTree) noexcept;
+// isQuiet: nothing on stdout, cmdTree.error is left for the caller
+// stdFds: stdin, stdout and stderr of the whole task, -1 is the shell's one
+optPairTask_t   createTask      (parser::CmdTree const& cmdTree,
+                                 ETypeCmdLine typeCmdLine,
+                                 bool isQuiet = false,
+                                 ::process::Process::stdfds_t const& stdFds =
+                                     ::process::Process::defStdFds) noexcept;
+// waits for the task, exit code of the last stage, 128 + N if killed
+int             joinTask        (task_t const& task,
+                                 ETypeCmdLine typeCmdLine) noexcept;
+// past deadline.atNs TERM (and CONT, a stopped task can't die) goes to the
+// task, killGraceNs later KILL; true when it signalled the task
+bool            expireTask      (task_t const& task,
+                                 int64_t nowNs,
+                                 Deadline& deadline) noexcept;
+// joinTask that expires the task on the way, timeoutStatus if it had to
+int             joinTaskUntil   (task_t const& task,
+                                 ETypeCmdLine typeCmdLine,
+                                 Deadline& deadline) noexcept;
+// limit that ended a finished task: "wall", "cpu" (SIGXCPU or the SIGKILL
+// after it), empty if none or one that can't be told from the outside
+std::string     getBreach       (task_t const& task,
+                                 ETypeCmdLine typeCmdLine,
+                                 Deadline const& deadline);
+// processes of the task in order, of a Boolean only the pipelines that ran
+std::vector<::process::Process const*>
+                getProcesses    (task_t const& task,
+                                 ETypeCmdLine typeCmdLine) noexcept;
+// "user 0.120s sys 0.010s maxrss 3.4MiB flt 120/0 csw 3/1"
+std::string     formatUsage     (::process::Process::Usage const& usage);
+// `time` report of a finished task: a line per process and, for several,
+// a total one with wallNs of the whole job
+void            reportUsage     (task_t const& task,
+                                 ETypeCmdLine typeCmdLine,
+                                 int64_t wallNs,
+                                 std::ostream& out) noexcept;
 
 } // namespace analyze
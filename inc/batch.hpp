@@ -0,0 +1,60 @@
+#pragma once
+#include "analyze.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <tuple>
+
+namespace batch {
+
+// Runs command lines without a terminal: no prompt, no job control, input
+// is read in big chunks. Every line is waited for before the next one
+// unless it ends with '&', background tasks are waited for at the end.
+//
+// A wall clock limit is kept by polling the task, of a background one
+// only when the next line starts and at the end.
+//
+// Blank lines and lines starting with '#' (a #! line too) are skipped,
+// `exit [N]` stops reading. Programs reading stdin of a piped script
+// see what is left after the chunk already read by the shell.
+class Batch
+{
+    using task_t    = analyze::task_t;
+    using type_t    = analyze::ETypeCmdLine;
+
+    static constexpr const size_t chunkSize_    = 64 * 1024; // = 64 KiB
+    static constexpr const int    syntaxStatus_ = 2;        // like sh
+    static constexpr const int    noFileStatus_ = 127;
+
+public:
+    // isReport: "line N: status S" on stderr after every command line
+    explicit Batch(bool isReport = false) noexcept;
+    ~Batch(void) noexcept;
+
+    Batch(Batch const& batch)           = delete;
+    Batch operator=(Batch const& batch) = delete;
+
+    // all of them return the status of the last command line
+    int     runString   (std::string_view script) noexcept;
+    int     runFile     (std::string const& path) noexcept;
+    int     runFd       (int fd)                noexcept;
+    int     runLine     (std::string const& cmdLine) noexcept;
+
+    bool    isExit      (void)                  const noexcept;
+    int     getStatus   (void)                  const noexcept;
+
+private:
+    void    report_     (void)                  const noexcept;
+    void    reapBackground_(bool isAsynk)       noexcept;
+
+    static void deleteTask_(task_t const& task) noexcept;
+
+private:
+    const bool  isReport_;
+    bool        isExit_     = false;
+    int         status_     = 0;
+    size_t      lineNo_     = 0;
+    std::vector<std::tuple<task_t, type_t, analyze::Deadline>> background_;
+};
+
+} // namespace batch
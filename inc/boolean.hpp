@@ -1,46 +1,83 @@
 #pragma once
 #include "process.hpp"
+#include "single.hpp"
+#include "ppipe.hpp"
+#include "parser.hpp"
+#include "pool.hpp"
+#include <variant>
 
 namespace boolean {
 
+// Pipelines joined by ';', '&&' and '||', run one after another as one job.
+// '&&' and '||' have equal precedence and group to the left, ';' runs the
+// next pipeline whatever the status; a pipeline that is skipped leaves the
+// status of the list as it was, like in POSIX sh. Every pipeline gets its
+// own process group and the terminal goes straight from one to the next,
+// never back to the shell in between. SIGINT of a pipeline or KILL of the
+// list stops the rest from running.
 class Boolean
 {
-    using argv_t    = ::process::Process::argv_t;
+    using Pipeline  = ::parser::Pipeline;
     using Process   = ::process::Process;
+    using stdfds_t  = ::process::Process::stdfds_t;
     using EKill     = ::process::Process::EKill;
+    using element_t = std::variant<single::Single*, ppipe::Ppipe*>;
     static constexpr const int successStatus = ::process::Process::successStatus;
     static constexpr const int failureStatus = ::process::Process::failureStatus;
 
 public:
-    enum class EOper : uint8_t { AND, OR };
+    using EOper = ::parser::EOper;
 
-    Boolean(argv_t const& argv1, argv_t const& argv2,
-            bool isForeground = true, EOper oper = EOper::AND) noexcept;
+    // opers[i] joins pipelines[i] and [i + 1], stdFds go to every pipeline
+    Boolean(std::vector<Pipeline> const& pipelines, std::vector<EOper> const& opers,
+            bool isForeground = true,
+            stdfds_t const& stdFds = Process::defStdFds) noexcept;
     ~Boolean(void) noexcept;
 
+    // tasks come and go with every command, their memory is pooled
+    static void * operator new      (size_t size);
+    static void   operator delete   (void * ptr, size_t size) noexcept;
+
+    // process group of the running pipeline
     int                     getPid(void)                const noexcept;
-    std::pair<int,int>      getPairPid(void)            const noexcept;
+    // of every pipeline that ran or runs, in order
+    std::vector<int>        getPids(void)               const noexcept;
+    std::vector<Process const*>
+                            getProcesses(void)          const noexcept;
     void KILL               (EKill sig = EKill::INT)    const noexcept;
+    // starts the next pipeline as soon as the running one is done
     bool isDone             (bool isAsynk = true,
                              int * pwstatus = nullptr)  noexcept;
+    // status of the last pipeline that ran, 128 + N if it was killed
+    int  join               (void)                      noexcept;
     bool isSuccess          (void)                      noexcept;
-    std::pair<bool,bool>    isTermBySig(void)           noexcept;
+    // some pipeline may run without a child, no SIGCHLD for it
+    bool isInThread         (void)                      const noexcept;
+    // for the pipelines not started yet, after fg or bg
+    void setForeground      (bool isForeground)         noexcept;
 
 private:
-    bool isNeedSecondProcess_   (int status)const noexcept;
-    void createSecondProcess_   (void)      noexcept;
+    void start_             (size_t idx)                noexcept;
+    bool startNext_         (void)                      noexcept;
+    bool isElementDone_     (bool isAsynk, int * pwstatus) noexcept;
+    void joinElement_       (void)                      noexcept;
 
 private:
-    argv_t          argv2_;
-    const   bool    isForeground_;
-    const   EOper   oper_;
-    const   int     termPid_;
-    Process * process1_ = nullptr;
-    Process * process2_ = nullptr;
-    bool isDone_        = false;
+    std::vector<Pipeline>   pipelines_;
+    std::vector<EOper>      opers_;
+    std::vector<element_t>  elements_;  // started ones, the last one runs
+    size_t                  current_    = 0;    // pipeline of elements_.back()
+    bool                    isForeground_;
+    const   stdfds_t        stdFds_;
+    const   int             termPid_;
+    int                     status_     = successStatus;
+    bool                    isDone_     = false;
+    bool                    isInThread_ = false;
+    mutable bool            isAborted_  = false;
 };
 
-std::pair<Boolean *,bool> make_boolean(std::string const& cmdLine);
+std::pair<Boolean *,bool>  make_boolean(parser::CmdTree const& cmdTree,
+                                        process::Process::stdfds_t const& stdFds =
+                                            process::Process::defStdFds);
 
 } // namespace boolean
-
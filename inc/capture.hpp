@@ -0,0 +1,57 @@
+#pragma once
+#include "process.hpp"
+#include <string_view>
+#include <ostream>
+#include <cstdint>
+
+namespace capture {
+
+// Output of a background job kept in memory instead of the terminal.
+//
+// stdout and stderr of the job go into a pipe, the shell drains it into a
+// ring of limit bytes whenever it's readable, at the prompt and while a
+// foreground job runs, so a chatty job costs at most limit bytes and loses
+// its oldest output first. The ring is mapped
+// without reserve: a job that prints little touches few pages of it.
+class Capture
+{
+public:
+    static constexpr const size_t defLimit  = 1024 * 1024;  // = 1 MiB
+    static constexpr const size_t minLimit  = 4096;
+    static constexpr const size_t maxLimit  = 1024 * 1024 * 1024;   // = 1 GiB
+
+    explicit Capture(size_t limit = defLimit) noexcept;
+    ~Capture(void) noexcept;
+
+    Capture(Capture const& capture)             = delete;
+    Capture operator=(Capture const& capture)   = delete;
+
+    // false when the ring couldn't be mapped, nothing else works then
+    bool        isValid     (void)  const noexcept;
+    // stdout and stderr of the job, stdin stays the shell's
+    ::process::Process::stdfds_t getStdFds(void) const noexcept;
+    // read end, for epoll
+    int         getFd       (void)  const noexcept;
+    size_t      getLimit    (void)  const noexcept;
+    // bytes written by the job so far, kept or not
+    uint64_t    getTotal    (void)  const noexcept;
+    uint64_t    getDropped  (void)  const noexcept;
+    // reads whatever is in the pipe without blocking, bytes read
+    size_t      drain       (void)  noexcept;
+    // the job is done: reads the rest and closes the pipe, the ring stays
+    void        finish      (void)  noexcept;
+    // what is kept, the oldest byte first
+    void        print       (std::ostream& out) const;
+
+    // "65536", "64K" or "1M", 0 if it's none of them or above maxLimit
+    static size_t parseSize (std::string_view str) noexcept;
+
+private:
+    char *      ring_   = nullptr;
+    size_t      limit_;
+    uint64_t    total_  = 0;        // the next byte goes to total_ % limit_
+    int         readFd_ = -1;
+    int         writeFd_= -1;
+};
+
+} // namespace capture
@@ -0,0 +1,80 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+namespace complete {
+
+// Command and file name completion over cached directory listings.
+//
+// Every listed directory is watched with inotify and patched from its
+// events, so a Tab never rescans a directory: PATH directories feed the
+// sorted executable index, other directories are kept for file names
+// until the least recently used one is evicted.
+class Completer
+{
+    struct Entry_
+    {
+        std::string name;
+        bool        isDir;
+    };
+
+    struct Dir_
+    {
+        std::string         path;
+        std::vector<Entry_> entries;    // sorted by name
+        bool                isPath  = false;
+        uint64_t            lastUse = 0;
+    };
+
+    struct Name_
+    {
+        std::string name;
+        uint32_t    refs;   // PATH directories having it, builtins count once
+    };
+
+    static constexpr const size_t maxDirs_ = 64;    // besides PATH ones
+
+public:
+    Completer(void) noexcept;
+    ~Completer(void) noexcept;
+
+    Completer(Completer const& completer)           = delete;
+    Completer operator=(Completer const& completer) = delete;
+
+    // inotify descriptor, readable when a cached directory has changed
+    int     getFd       (void)                      const noexcept;
+    void    handleEvents(void)                      noexcept;
+
+    // candidates are whole words replacing [wordBegin, end of line)
+    void    complete    (std::string_view line, size_t wordBegin,
+                         std::vector<std::string>& candidates) noexcept;
+    void    findCommands(std::string_view prefix,
+                         std::vector<std::string>& candidates) noexcept;
+    void    findFiles   (std::string_view word,
+                         std::vector<std::string>& candidates) noexcept;
+
+private:
+    void    updatePath_ (void)                      noexcept;
+    Dir_ *  getDir_     (std::string const& path, bool isPath) noexcept;
+    void    dropDir_    (int wd)                    noexcept;
+    void    evictDirs_  (void)                      noexcept;
+    void    addName_    (std::string const& name)   noexcept;
+    void    removeName_ (std::string const& name)   noexcept;
+
+    static bool listDir_(std::string const& path, std::vector<Entry_>& entries) noexcept;
+
+private:
+    int         inotifyFd_  = -1;
+    std::string pathEnv_;               // PATH the index was built for
+    bool        isIndexed_  = false;
+    uint64_t    useClock_   = 0;
+
+    std::vector<Name_>                      names_;     // sorted by name
+    std::unordered_map<int, Dir_>           dirs_;      // by watch descriptor
+    std::unordered_map<std::string, int>    dirWds_;
+};
+
+} // namespace complete
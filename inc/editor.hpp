@@ -0,0 +1,131 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace editor {
+
+// Line editing state machine. Input bytes are fed in bursts of any size,
+// the echo of a whole burst is collected and sent with one write()
+class LineEditor
+{
+    enum class EEscape : uint8_t
+    {
+        NONE,
+        ESC,    // got \033
+        CSI     // got \033[ or \033O
+    };
+
+    enum class ESpecialAscii : uint8_t
+    {
+        CTRL_A      = 1,
+        CTRL_D      = 4,
+        CTRL_E      = 5,
+        CTRL_G      = 7,
+        BS          = 8,
+        TAB         = 9,
+        ENTER       = 10,
+        CTRL_K      = 11,
+        CR          = 13,
+        CTRL_R      = 18,
+        CTRL_U      = 21,
+        ESC         = 27,
+        BACKSPACE   = 127
+    };
+
+public:
+    enum class EAction : uint8_t
+    {
+        NONE,   // line isn't finished, feed more
+        ENTER,
+        EOF_    // CTRL + D on empty line
+    };
+
+    // Incremental search backend. An empty query starts a new search,
+    // isOlder asks for the next older match of the same query.
+    // Returns false if nothing matches, match is left as it was.
+    using searcher_t = std::function<bool(std::string_view query, bool isOlder,
+                                          std::string& match)>;
+
+    // Fills candidates for the word [wordBegin, end of line) before the
+    // cursor, each of them is the whole word to put in its place
+    using completer_t = std::function<void(std::string_view line, size_t wordBegin,
+                                           std::vector<std::string>& candidates)>;
+
+    struct EchoStats
+    {
+        uint64_t bursts     = 0;
+        uint64_t bytes      = 0;
+        uint64_t totalNs    = 0;    // read() return to write() return
+        uint64_t maxNs      = 0;
+    };
+
+    explicit LineEditor(int outFd = 1) noexcept;
+
+    // prompt is already on the screen, it's printed again after listings
+    void                begin       (std::string_view prompt = {}) noexcept;
+    // consumes bytes up to and including the one that finishes the line,
+    // the rest of the burst belongs to the next line
+    EAction             feed        (char const * buf, size_t size,
+                                     size_t& used)      noexcept;
+    void                flush       (void)              noexcept;
+    // prints the line again after something else wrote to the terminal
+    void                redraw      (void)              noexcept;
+
+    std::string const&  getLine     (void)              const noexcept;
+    void                setSearcher (searcher_t searcher) noexcept;
+    void                setCompleter(completer_t completer) noexcept;
+    void                addEchoSample(uint64_t ns, size_t bytes) noexcept;
+    EchoStats const&    getEchoStats(void)              const noexcept;
+
+private:
+    void insert_        (std::string_view str)  noexcept;
+    void complete_      (void)                  noexcept;
+    void erase_         (bool isBackward)       noexcept;
+    void killTo_        (size_t pos)            noexcept;
+    void moveTo_        (size_t cursor)         noexcept;
+    void escapeChar_    (char ch)               noexcept;
+    void putTail_       (size_t cleared)        noexcept;
+    void put_           (std::string_view str)  noexcept;
+    void putMove_       (size_t cnt, char dir)  noexcept;
+    void startSearch_   (void)                  noexcept;
+    bool searchChar_    (char ch)               noexcept;
+    void search_        (bool isOlder)          noexcept;
+    void showSearch_    (void)                  noexcept;
+    void stopSearch_    (bool isAccept)         noexcept;
+
+    static constexpr const std::string_view clearEscapeSeq_ = "\33[K";
+    static constexpr const std::string_view bellEscapeSeq_  = "\7";
+    static constexpr const std::string_view searchPrompt_   = "(reverse-i-search)`";
+    static constexpr const std::string_view failedPrompt_   = "(failed reverse-i-search)`";
+
+    static constexpr const size_t maxListed_ = 100;     // candidates shown on Tab
+
+    static constexpr const int ASCII_BEGIN_ = 32;   // space
+    static constexpr const int ASCII_END_   = 126;
+
+private:
+    const int   outFd_;
+    std::string line_;
+    size_t      cursor_     = 0;
+    std::string out_;           // pending echo of the current burst
+    std::string prompt_;
+    EEscape     escape_     = EEscape::NONE;
+    std::string escapeSeq_;
+    EchoStats   echoStats_;
+
+    searcher_t  searcher_;
+    bool        isSearch_   = false;
+    bool        isFailed_   = false;
+    std::string query_;
+    std::string match_;
+    std::string savedLine_;     // restored when the search is cancelled
+    size_t      shown_      = 0;    // chars of the search line on screen
+
+    completer_t completer_;
+    std::vector<std::string> candidates_;
+};
+
+} // namespace editor
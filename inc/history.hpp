@@ -0,0 +1,140 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <sys/types.h>
+
+namespace history {
+
+struct Entry
+{
+    std::string_view cmdLine;   // points into the mapped file
+    int64_t     startNs     = 0;    // unix time
+    int64_t     durationNs  = 0;
+    int32_t     status      = 0;    // exit code, 128 + signal if killed
+    uint8_t     type        = 0;    // analyze::ETypeCmdLine
+    uint64_t    offset      = 0;    // record position, set by readers
+    uint64_t    size        = 0;
+};
+
+// Append-only history shared by every shell of the user.
+//
+// <path>      header + records, each record framed by its size on both
+//             ends, so it's walked backwards without any index
+// <path>.idx  (8 byte prefix key, offset) pairs sorted by command line,
+//             covers the records up to its dataEnd. Appends past it
+//             form an unsorted tail, merged in by the appender once it
+//             outgrows 1/64 of the index
+// <path>.sig  (bigram bloom, offset) pair per record in append order,
+//             ctrl + r scans it and reads only records that may match
+//
+// Writers serialize on flock() of the data file, readers take no locks:
+// the end offset in the header is updated only after the record is written.
+class History
+{
+    struct Header_
+    {
+        char        magic[8];
+        uint64_t    end;        // first byte after the last record
+        uint64_t    count;
+        uint64_t    reserved[5];
+    };
+
+    struct RecordHead_
+    {
+        uint32_t    size;       // whole record, footer included
+        uint32_t    cmdLen;
+        int64_t     startNs;
+        int64_t     durationNs;
+        int32_t     status;
+        uint8_t     type;
+        uint8_t     pad[3];
+    };
+
+    struct IndexHeader_
+    {
+        char        magic[8];
+        uint64_t    count;
+        uint64_t    dataEnd;    // records before it are indexed
+        uint64_t    reserved[5];
+    };
+
+    struct IndexEntry_
+    {
+        uint64_t    key;        // first 8 bytes of the command, big endian
+        uint64_t    offset;
+    };
+
+    struct SigEntry_
+    {
+        uint64_t    sig;        // bit per hashed pair of adjacent chars
+        uint64_t    offset;
+    };
+
+    struct Map_
+    {
+        void *      addr    = nullptr;
+        size_t      size    = 0;
+        ino_t       ino     = 0;
+    };
+
+    static constexpr const char     dataMagic_[8]   = {'N','S','H','I','S','T','1','\0'};
+    static constexpr const char     indexMagic_[8]  = {'N','S','H','I','D','X','1','\0'};
+    static constexpr const size_t   growStep_       = 1024 * 1024; // = 1 MiB
+    static constexpr const size_t   maxTail_        = 1024;
+    static constexpr const size_t   tailRatio_      = 64;
+    static constexpr const size_t   maxCmdLen_      = 64 * 1024;
+
+public:
+    History(void) noexcept = default;
+    ~History(void) noexcept;
+
+    History(History const& history)             = delete;
+    History operator=(History const& history)   = delete;
+
+    // $NANOSHELL_HISTORY or ~/.nanoshell_history, empty if neither is known
+    static std::string defaultPath(void) noexcept;
+
+    bool    open        (std::string const& path) noexcept;
+    void    close       (void)                  noexcept;
+    bool    isOpen      (void)                  const noexcept;
+    bool    append      (Entry const& entry)    noexcept;
+    size_t  size        (void)                  noexcept;
+
+    // Newest record containing query that ends at or before pos,
+    // pos == 0 means the end of the history. Continue with pos = entry.offset
+    // for an older match, or offset + size to re-check the current one.
+    bool    searchBack  (std::string_view query, uint64_t pos,
+                         Entry& entry)          noexcept;
+    // previous record, pos as for searchBack
+    bool    prev        (uint64_t pos, Entry& entry) noexcept;
+    // distinct command lines starting with prefix in lexicographic order
+    void    findPrefix  (std::string_view prefix, size_t limit,
+                         std::vector<Entry>& entries) noexcept;
+
+private:
+    bool    refresh_        (void)                  noexcept;
+    bool    refreshIndex_   (void)                  noexcept;
+    bool    readAt_         (uint64_t offset, Entry& entry) const noexcept;
+    bool    mergeIndex_     (uint64_t dataEnd)      noexcept;
+    bool    scanBack_       (std::string_view query, uint64_t pos,
+                             uint64_t limit, Entry& entry) noexcept;
+    uint64_t getEnd_        (void)                  const noexcept;
+
+    static uint64_t makeKey_    (std::string_view cmdLine) noexcept;
+    static uint64_t makeSig_    (std::string_view cmdLine) noexcept;
+    static bool     remap_      (int fd, Map_& map) noexcept;
+    static void     unmap_      (Map_& map)         noexcept;
+
+private:
+    std::string path_;
+    std::string indexPath_;
+    int         fd_     = -1;
+    int         sigFd_  = -1;
+    Map_        data_;
+    Map_        index_;
+    Map_        sig_;
+};
+
+} // namespace history
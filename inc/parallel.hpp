@@ -0,0 +1,78 @@
+#pragma once
+#include "process.hpp"
+#include "stream.hpp"
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+
+namespace parallel {
+
+constexpr const char * builtinName = "parallel";
+
+// parallel [-j N] [-a file] <cmd> [arg]... [::: item...]
+//
+// Runs <cmd> once per item: {} in the args is replaced with the item, or
+// the item is appended when there is no {}. Items come after :::, from
+// the lines of -a file, or else from the lines of stdin. Runs in a child
+// of its own, so the shell sees one job and its process group.
+int run(::process::Process::argv_t const& argv, stream::Io& io) noexcept;
+
+// At most N commands at once (online CPUs by default). Each slot owns a
+// deque of items and takes from its front, an idle slot steals the back
+// half of the longest deque. Stdout and stderr of a command are kept in
+// memfds and written out in one go when it's done, so the output of
+// different commands never interleaves.
+class Runner
+{
+    using Process   = ::process::Process;
+    using argv_t    = Process::argv_t;
+
+    struct Slot_
+    {
+        std::deque<size_t>          items;
+        std::unique_ptr<Process>    process;
+        size_t                      item    = 0;
+        int64_t                     startNs = 0;
+        int                         outFd   = -1;
+        int                         errFd   = -1;
+    };
+
+    struct Result_
+    {
+        int         status      = 0;
+        int64_t     durationNs  = 0;
+    };
+
+    static constexpr const int maxStatus_ = 101;    // failed jobs, like GNU parallel
+
+public:
+    Runner(argv_t const& cmd, std::vector<std::string> const& items,
+           size_t jobs, stream::Io& io) noexcept;
+    ~Runner(void) noexcept;
+
+    Runner(Runner const& runner)            = delete;
+    Runner operator=(Runner const& runner)  = delete;
+
+    // number of failed commands, at most 101
+    int     run         (void)              noexcept;
+
+private:
+    bool    takeItem_   (size_t slot)       noexcept;
+    void    launch_     (size_t slot)       noexcept;
+    void    finish_     (size_t slot)       noexcept;
+    void    flushFd_    (int fd, stream::Stream& stream) noexcept;
+    void    printSummary_(int64_t wallNs)   noexcept;
+    argv_t  makeArgv_   (std::string const& item) const noexcept;
+
+private:
+    const argv_t                        cmd_;
+    std::vector<std::string> const&     items_;
+    stream::Io&                         io_;
+    std::vector<Slot_>                  slots_;
+    std::vector<Result_>                results_;
+    int                                 nullFd_ = -1;   // stdin of commands
+    size_t                              stolen_ = 0;
+};
+
+} // namespace parallel
@@ -0,0 +1,88 @@
+#pragma once
+#include "process.hpp"
+#include <string_view>
+
+namespace parser {
+
+enum class EToken : uint8_t
+{
+    WORD,
+    PIPE,   // |
+    AND,    // &&
+    OR,     // ||
+    AMP,    // &
+    SEMI,   // ;
+    REDIR,  // [N]<, [N]>, [N]>>, [N]>&M, &>, &>>
+    END,
+    ERROR
+};
+
+struct Token
+{
+    EToken              type;
+    std::string_view    text;       // raw text, quotes included
+    bool                isQuoted = false;
+};
+
+// Single pass, no backtracking: every byte is looked at once
+class Lexer
+{
+public:
+    explicit Lexer(std::string_view line) noexcept;
+    Token               next(void)          noexcept;
+    size_t              getPos(void)        const noexcept;
+
+private:
+    static bool isSpace_(char ch) noexcept;
+    static bool isMeta_ (char ch) noexcept;
+    static bool isFd_   (char ch) noexcept;
+
+private:
+    std::string_view    line_;
+    size_t              pos_ = 0;
+};
+
+using argv_t      = ::process::Process::argv_t;
+using redirs_t    = ::process::Process::redirs_t;
+using limits_t    = ::process::Process::Limits;
+
+enum class EOper : uint8_t { AND, OR, SEQ };
+
+struct Command
+{
+    argv_t                  argv;
+    redirs_t                redirs;     // in the order they were written
+    limits_t                limits = {};    // the line's ones, without the defaults
+};
+
+struct Pipeline
+{
+    std::vector<Command>    commands;
+};
+
+// line := [ 'time' ] [ 'priority' N ] [ 'limit' { OPTION VALUE } ] list
+// list := pipeline { ('&&' | '||' | ';') pipeline } [ ';' ] [ '&' ]
+// '&' puts the whole list in the background
+// pipeline := command { '|' command }
+// command := { WORD | REDIR [WORD] }, at least one WORD outside REDIR
+struct CmdTree
+{
+    std::vector<Pipeline>   pipelines;
+    std::vector<EOper>      opers;      // opers[i] joins pipelines[i] and [i + 1]
+    bool                    isForeground = true;
+    bool                    isTimed = false;    // report the cost when done
+    limits_t                limits = {};    // of every command too, wallSec of the job
+    int                     priority = 0;   // in the background queue, higher starts first
+    std::string             error;      // set when parse failed
+};
+
+bool parse(std::string_view line, CmdTree& tree) noexcept;
+
+// an option of 'limit' and of the shell's `limits`: -t SEC of cpu,
+// -v SIZE[K|M|G] of address space, -n N files, -u N processes,
+// -w SEC of wall clock, -c LIST of cpus to run on ("0-3,6");
+// false if either is wrong
+bool parseLimit(std::string_view option, std::string_view value,
+                limits_t& limits) noexcept;
+
+} // namespace parser
@@ -0,0 +1,80 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+#include <sched.h>
+
+namespace place {
+
+// "0-3,6" into cpus, false on a malformed list or a cpu past CPU_SETSIZE
+bool        parseCpus   (std::string_view list, cpu_set_t& cpus) noexcept;
+std::string formatCpus  (cpu_set_t const& cpus);
+
+// How busy the whole system is, in percent. With PSI: the share of the
+// last 10 s some task waited for a cpu or for memory; without it cpu is
+// the 1 min load average per allowed cpu and memory is 0.
+struct Pressure
+{
+    double      cpu     = 0;
+    double      memory  = 0;
+    bool        isPsi   = false;
+};
+
+Pressure    readPressure(void) noexcept;
+
+// Core sets for background jobs.
+//
+// A set is width physical cores (SMT siblings together) of one NUMA node,
+// out of the cpus the shell may run on, so a job never spreads its threads
+// and its memory over two nodes. pick() takes the set with the least load
+// per cpu: busy time of its cpus in /proc/stat since the previous pick plus
+// one for every job placed there and not released yet, the latter because
+// a job just started doesn't show in /proc/stat at all. PSI is system wide,
+// it can't tell one set from another.
+class Placer
+{
+    struct Set_
+    {
+        cpu_set_t   cpus;
+        size_t      cnt;            // CPU_COUNT of cpus
+        size_t      jobs    = 0;
+        double      busy    = 0;    // cpus worth of busy time, last sample
+    };
+
+    struct Tick_
+    {
+        uint64_t    busy    = 0;
+        uint64_t    total   = 0;
+    };
+
+public:
+    static constexpr const size_t defWidth = 1;
+
+    explicit Placer(size_t width = defWidth) noexcept;
+
+    Placer(Placer const& placer)            = delete;
+    Placer operator=(Placer const& placer)  = delete;
+
+    // rebuilds the sets, jobs placed before are released by their old ids
+    void                setWidth    (size_t width)  noexcept;
+    size_t              getWidth    (void)          const noexcept;
+    // id of the set for a new job, -1 when there is only one set
+    int                 pick        (void)          noexcept;
+    void                release     (int id)        noexcept;
+    cpu_set_t const&    getCpus     (int id)        const noexcept;
+    // a line per set: cpus, busy at the last sample and jobs
+    void                print       (std::ostream& out) const;
+
+private:
+    void                build_      (void);
+    void                sample_     (void)          noexcept;
+
+private:
+    size_t              width_;
+    std::vector<Set_>   sets_;
+    std::vector<Tick_>  ticks_;     // by cpu, /proc/stat at the last sample
+};
+
+} // namespace place
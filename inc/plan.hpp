@@ -0,0 +1,60 @@
+#pragma once
+#include "parser.hpp"
+#include <string>
+#include <string_view>
+#include <list>
+#include <unordered_map>
+#include <cstdint>
+
+namespace plan {
+
+// Parsed command lines by their text, the least recently used one goes
+// first when full. A line means the same whatever PATH, the plugins or
+// the cwd are: programs are looked up in the path hash and builtins in
+// plugin::Registry when a task starts, both keep themselves up to date,
+// so nothing here needs to be invalidated by them.
+class Cache
+{
+    struct Entry_
+    {
+        uint64_t            hash;
+        std::string         cmdLine;
+        parser::CmdTree     cmdTree;
+        uint8_t             type;       // analyze::ETypeCmdLine
+    };
+
+    static constexpr const size_t maxEntries_ = 256;
+
+public:
+    struct Counters
+    {
+        uint64_t    hits        = 0;
+        uint64_t    misses      = 0;
+        uint64_t    evictions   = 0;
+        size_t      size        = 0;
+    };
+
+    static Cache& get(void) noexcept;
+
+    Cache(Cache const& cache)               = delete;
+    Cache operator=(Cache const& cache)     = delete;
+
+    // copies the plan out on a hit
+    bool        find        (std::string_view cmdLine, parser::CmdTree& cmdTree,
+                             uint8_t& type)     noexcept;
+    void        add         (std::string_view cmdLine, parser::CmdTree const& cmdTree,
+                             uint8_t type)      noexcept;
+    void        clear       (void)              noexcept;
+    Counters    getCounters (void)              const noexcept;
+    void        resetCounters(void)             noexcept;
+
+private:
+    Cache(void) noexcept = default;
+
+private:
+    std::list<Entry_>   entries_;   // most recently used first
+    std::unordered_map<uint64_t, std::list<Entry_>::iterator> index_;
+    Counters            counters_;
+};
+
+} // namespace plan
@@ -0,0 +1,40 @@
+#pragma once
+#include "process.hpp"
+#include <cstdint>
+
+// What a builtin library exports. Every plugin defines
+//
+//     extern "C" plugin::Descriptor const nanoshell_plugin = {...};
+//
+// and the shell reads the table when a name is first looked up. Build it
+// with -fno-gnu-unique, glibc never unloads a library with unique symbols
+// and reload would keep the old code.
+namespace plugin {
+
+using entry_t = int(::process::Process::argv_t const& argv, stream::Io& io);
+
+enum EFlags : uint32_t
+{
+    NONE        = 0,
+    IN_PROCESS  = 1 << 0    // may run in the shell or on a shell thread instead
+                            // of a child, so must not exit or assert on input
+};
+
+struct Builtin
+{
+    const char *    name;
+    entry_t *       entry;
+    uint32_t        flags;
+};
+
+struct Descriptor
+{
+    uint32_t        version;    // abiVersion the plugin was built with
+    uint32_t        count;
+    Builtin const * builtins;
+};
+
+constexpr const uint32_t abiVersion     = 1;
+constexpr const char *   descriptorSym  = "nanoshell_plugin";
+
+} // namespace plugin
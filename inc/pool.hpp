@@ -0,0 +1,82 @@
+#pragma once
+#include <cstddef>
+#include <new>
+
+namespace pool {
+
+// Free list of blocks for objects created and destroyed once per command.
+// A freed block goes to the next allocation of the same type instead of
+// back to malloc, at most maxFree of them are kept around.
+// Not thread safe: tasks are created and retired by the shell thread only.
+template<typename T, size_t maxFree = 64>
+class Pool
+{
+    union Block_
+    {
+        Block_ *    next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    struct FreeList_
+    {
+        Block_ *    head    = nullptr;
+        size_t      cnt     = 0;
+
+        ~FreeList_(void) noexcept
+        {
+            while (head != nullptr)
+            {
+                Block_ * block = head;
+                head = head->next;
+                delete block;
+            }
+        }
+    };
+
+public:
+    static void * alloc(size_t size)
+    {
+        // a derived type has its own size, nothing to reuse for it
+        if (size != sizeof(T))
+            return ::operator new(size);
+
+        FreeList_& freeList = freeList_();
+        if (freeList.head == nullptr)
+            return new Block_;
+
+        Block_ * block = freeList.head;
+        freeList.head = block->next;
+        freeList.cnt--;
+        return block;
+    }
+
+    static void free(void * ptr, size_t size) noexcept
+    {
+        if (ptr == nullptr)
+            return;
+        if (size != sizeof(T))
+            return ::operator delete(ptr);
+
+        FreeList_& freeList = freeList_();
+        Block_ * block = (Block_ *)ptr;
+
+        if (freeList.cnt == maxFree)
+        {
+            delete block;
+            return;
+        }
+
+        block->next = freeList.head;
+        freeList.head = block;
+        freeList.cnt++;
+    }
+
+private:
+    static FreeList_& freeList_(void) noexcept
+    {
+        static FreeList_ freeList;
+        return freeList;
+    }
+};
+
+} // namespace pool
@@ -1,39 +1,62 @@
 #pragma once
 #include "process.hpp"
+#include "parser.hpp"
+#include "stream.hpp"
+#include "pool.hpp"
+#include <memory>
 
 namespace ppipe {
 
 class Ppipe
 {
-    using pipe_t    = int[2];
+    using pipe_t    = std::array<int, 2>;
     using argv_t    = ::process::Process::argv_t;
+    using commands_t= std::vector<parser::Command>;
     using Process   = ::process::Process;
+    using stdfds_t  = ::process::Process::stdfds_t;
     using EKill     = ::process::Process::EKill;
     static constexpr const int successStatus = ::process::Process::successStatus;
     static constexpr const int failureStatus = ::process::Process::failureStatus;
 
 public:
-    Ppipe(argv_t const& argv1, argv_t const& argv2, bool isForeground = true) noexcept;
+    // stdFds: stdin of the first stage, stdout and stderr of the last one,
+    // -1 is the shell's one
+    explicit Ppipe(commands_t const& commands, bool isForeground = true,
+                   stdfds_t const& stdFds = Process::defStdFds) noexcept;
     ~Ppipe(void) noexcept;
 
-    std::pair<int,int>      getPid(void)                const noexcept;
+    // tasks come and go with every command, their memory is pooled
+    static void * operator new      (size_t size);
+    static void   operator delete   (void * ptr, size_t size) noexcept;
+
+    size_t                  size(void)                  const noexcept;
+    std::vector<int>        getPid(void)                const noexcept;
+    int                     getPgid(void)               const noexcept;
+    Process&                getProcess(size_t stage)    const noexcept;
     void                    KILL(EKill sig = EKill::INT)const noexcept;
     bool                    isDone(bool isAsynk = true,
-                                   std::pair<int*,int*> pwstatus
-                                   = {nullptr, nullptr}) noexcept;
+                                   std::vector<int> * pwstatus = nullptr) noexcept;
     bool                    isSuccess(void)             noexcept;
-    std::pair<bool,bool>    isTermBySig(void)           noexcept;
-    std::pair<int,int>      join(void)                  noexcept;
+    std::vector<bool>       isTermBySig(void)           noexcept;
+    std::vector<int>        join(void)                  noexcept;
+    bool                    isInThread(void)            const noexcept;
+
+private:
+    void spawnProcesses_    (commands_t const& commands) noexcept;
+    void spawnThreads_      (commands_t const& commands) noexcept;
 
 private:
     const bool isForeground_;
+    const stdfds_t stdFds_;
     const int termPid_;
-    pipe_t pipe_        = {-1, -1};
-    Process * process1_ = nullptr;
-    Process * process2_ = nullptr;
-    bool isClosedPipe_  = false;
+    bool isInThread_ = false;
+    std::vector<std::unique_ptr<stream::Ring>>      rings_;
+    std::vector<std::unique_ptr<stream::Stream>>    streams_;
+    std::vector<Process *> processes_;
 };
 
-std::pair<Ppipe *,bool> make_ppipe(std::string const& cmdLine);
+std::pair<Ppipe *,bool> make_ppipe(parser::CmdTree const& cmdTree,
+                                   process::Process::stdfds_t const& stdFds =
+                                       process::Process::defStdFds);
 
 } // namespace pipe
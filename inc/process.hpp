@@ -5,6 +5,13 @@
 #include <string>
 #include <unordered_map>
 #include <functional>
+#include <array>
+#include <thread>
+#include <atomic>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sched.h>
+#include "stream.hpp"
 
 namespace process {
 
@@ -13,6 +20,9 @@ struct Process
     using argv_t    = std::vector<std::string>;
     using stdfds_t  = std::array<int, 3>;
     using clsfds_t  = std::array<int, 3>;
+    using event_t   = std::pair<int, int>;  // pid and wstatus
+    using events_t  = std::vector<event_t>;
+    using builtin_t = std::function<int(argv_t const&, stream::Io&)>;
 
     static constexpr const size_t maxArgc       = 256;
     static constexpr const stdfds_t defStdFds   = {-1, -1, -1};
@@ -21,17 +31,99 @@ struct Process
     static constexpr const int successStatus = 0;
     static constexpr const int failureStatus = 1;
 
+    static constexpr const int noPgid  = -1; // inherit shell's group
+    static constexpr const int newPgid = 0;  // child becomes group leader
+
     enum class EKill : uint8_t
     {
-        HUP, INT, QUIT, TSTP, TTIN, TTOU, TERM, CONT
+        HUP, INT, QUIT, TSTP, TTIN, TTOU, TERM, CONT, KILL
+    };
+
+    // <, >, >> and N>&M of a command
+    enum class ERedir : uint8_t
+    {
+        IN,
+        OUT,
+        APPEND,
+        DUP
+    };
+
+    struct Redirect
+    {
+        ERedir      type;
+        int         fd;             // 0, 1 or 2
+        std::string path;           // empty for DUP
+        int         dupFd = -1;     // DUP: fd becomes a copy of dupFd
+    };
+
+    using redirs_t = std::vector<Redirect>;
+
+    // what a finished process cost, from wait4 (getrusage for builtins
+    // in the shell, whose maxRssKb stays 0: the shell's one means nothing)
+    struct Usage
+    {
+        int64_t wallNs      = 0;
+        int64_t userUs      = 0;
+        int64_t sysUs       = 0;
+        long    maxRssKb    = 0;
+        long    minFlt      = 0;    // page faults without and with i/o
+        long    majFlt      = 0;
+        long    volCsw      = 0;    // context switches: waits and preemptions
+        long    involCsw    = 0;
+    };
+
+    // of a child process, 0 is no limit. wallSec is up to the shell, the
+    // process only has to be a child for it: threads can't be signalled.
+    // No member initializers, {} zeroes it (and it's a default argument below)
+    struct Limits
+    {
+        uint64_t cpuSec;    // RLIMIT_CPU: SIGXCPU, a second later SIGKILL
+        uint64_t asBytes;   // RLIMIT_AS: allocations past it fail
+        uint64_t files;     // RLIMIT_NOFILE
+        uint64_t procs;     // RLIMIT_NPROC, of every process of the user
+        uint64_t wallSec;
+        cpu_set_t cpus;     // sched_setaffinity, empty: the shell's ones
+    };
+
+    struct HashEntry
+    {
+        std::string name;
+        std::string path;
+        size_t      hits = 0;   // launches that skipped the PATH walk
+    };
+
+    // backend used for external programs (builtins always use clone)
+    enum class ESpawn : uint8_t
+    {
+        FORK,
+        VFORK,
+        POSIX_SPAWN
     };
 
+    // isInline: an in-process builtin runs to the end right here in the
+    // shell, on stdFds without dup2 and with no child at all (not when one
+    // of stdFds is a pipe, the other end may not be read yet).
+    // redirs are applied in order after stdFds, files are opened by the
+    // child (by the shell with O_CLOEXEC for an inline builtin); a file
+    // that can't be opened fails the command with failureStatus.
+    // limits and the cpu set, the default ones filled in, are set by the
+    // child before exec; a limited builtin never runs inline.
     explicit Process(argv_t const& argv,
                      stdfds_t const& stdFds = defStdFds,
-                     clsfds_t const& clsFds = defClsFds) noexcept;
+                     clsfds_t const& clsFds = defClsFds,
+                     int pgid = noPgid,
+                     bool isInline = false,
+                     redirs_t const& redirs = {},
+                     Limits const& limits = {}) noexcept;
     explicit Process(argv_t && argv,
                      stdfds_t const& stdFds = defStdFds,
-                     clsfds_t const& clsFds = defClsFds) noexcept;
+                     clsfds_t const& clsFds = defClsFds,
+                     int pgid = noPgid,
+                     bool isInline = false,
+                     redirs_t const& redirs = {},
+                     Limits const& limits = {}) noexcept;
+    // builtin run by a thread of the shell, i/o goes through io
+    explicit Process(argv_t const& argv, stream::Io const& io) noexcept;
 
     Process(Process const& process)             = delete;
     Process(Process && process)                 = delete;
@@ -47,59 +139,129 @@ struct Process
                                          int * pwstatus = nullptr) noexcept;
     bool            isSuccess           (void)                  noexcept;
     bool            isTermBySig         (void)                  noexcept;
+    bool            isStopped           (void)                  const noexcept;
+    // what the last isDone() or reap() saw, never waits for the child
+    bool            isReaped            (void)                  const noexcept;
+    bool            isInThread          (void)                  const noexcept;
+    // ran in the shell itself, done as soon as constructed, no pid
+    bool            isInline            (void)                  const noexcept;
     int             join                (void)                  noexcept;
+    // zeros until done
+    Usage const&    getUsage            (void)                  const noexcept;
+    // signal that ended the process, 0 if it exited or runs
+    int             getTermSig          (void)                  const noexcept;
+    Limits const&   getLimits           (void)                  const noexcept;
 
-private:
-    using signature_t       = int(Process::argv_t const&);
-    using callback_t        = std::function<signature_t>;
-    using map_callbacks_t   = std::unordered_map<std::string, callback_t>;
+    static ESpawn           getSpawnBackend (void)          noexcept;
+    static void             setSpawnBackend (ESpawn spawn)  noexcept;
+    static bool             parseSpawnBackend(std::string const& name,
+                                              ESpawn& spawn) noexcept;
+    static char const*      spawnBackendName(ESpawn spawn)  noexcept;
+    // off without a terminal: children stay in the shell's process group
+    // and nobody calls tcsetpgrp
+    static bool             isJobControl    (void)          noexcept;
+    static void             setJobControl   (bool isJobControl) noexcept;
+    // limits of every command, a field set for the command itself wins
+    static Limits           getDefaultLimits(void)          noexcept;
+    static void             setDefaultLimits(Limits const& limits) noexcept;
+    static Limits           applyDefaultLimits(Limits const& limits) noexcept;
+    // with the default ones, is any of limits set: the command needs a child
+    static bool             isLimited       (Limits const& limits) noexcept;
+    // looked up in plugin::Registry, may open plugin libraries
+    static bool             isBuiltin       (std::string const& name) noexcept;
+    static std::vector<std::string> getBuiltinNames(void)   noexcept;
+    // builtin implemented by the shell itself, isThreadSafe: may run in a
+    // shell thread, otherwise always gets a child process of its own
+    static void             addBuiltin      (std::string const& name,
+                                             builtin_t const& builtin,
+                                             bool isThreadSafe = true) noexcept;
+    static bool             isThreadSafeBuiltin(std::string const& name) noexcept;
+
+    // Where PATH puts an external program, walked once per name and cached.
+    // A cached path is checked to be executable before it's returned, the
+    // whole cache is dropped when PATH changes. Hits from relative PATH
+    // entries depend on the cwd and are never cached.
+    static bool             hashPath        (std::string const& name, std::string& path,
+                                             bool isHit = false) noexcept;
+    static void             clearPathHash   (void)          noexcept;
+    static std::vector<HashEntry> getPathHash(void)         noexcept;
 
-    static constexpr const char * notFoundSym       = "notFound";
-    static constexpr const char * fileSharedLib     = "./map_callbacks.so";
-    static constexpr const char * fileSymSharedLib  = "./map_callbacks.txt";
-    static constexpr const int  STACK_SIZE_         = 2 * 1024 * 1024; // = 2 MiB
+    // Reap state changes of any child with waitpid(-1), hand them to the
+    // owning Process and append them to events. Blocks for the first event
+    // unless isAsynk. Returns the number of events.
+    static size_t           reap            (bool isAsynk, events_t& events) noexcept;
+    // becomes readable when a builtin thread finishes
+    static int              getThreadEventFd(void)          noexcept;
 
-    void Process_       (void) noexcept;
+private:
+    void Process_       (bool isInline) noexcept;
+    void ProcessInline_ (void) noexcept;
     void ProcessClone_  (void) noexcept;
     void ProcessExec_   (void) noexcept;
+    void ProcessFork_   (void) noexcept;
+    void ProcessVfork_  (void) noexcept;
+    bool ProcessSpawn_  (void) noexcept;
+    void joinThread_    (void) noexcept;
+    void update_        (int wstatus, struct rusage const& rusage) noexcept;
+    void resetSigMask_  (void) noexcept;
     void setStdFds_     (void) noexcept;
+    void setRedirs_     (void) noexcept;
+    void setPgid_       (void) noexcept;
+    void setLimits_     (void) noexcept;
+    bool isPathExec_    (void) const noexcept;
+    bool isPipeFd_      (void) const noexcept;
+    bool hashExec_      (std::string& file) const noexcept;
 
-    static bool             checkSymMapCallbacks_(std::string const& sym)noexcept;
-    static map_callbacks_t* mapCallbacks_       (map_callbacks_t * mapCallback = nullptr) noexcept;
-    static void             initMapCallbacks_   (void)          noexcept;
+    static std::unordered_map<int, Process*>& registry_(void) noexcept;
     static int              routine_            (void * arg)    noexcept;
 
 
-    char* const* makeExecArgv_(argv_t const& argv) const noexcept;
+    using execArgv_t = std::array<char const *, maxArgc + 1>;
 
+    // fills execArgv, it lives on the parent's stack until exec
+    char* const* makeExecArgv_(argv_t const& argv, execArgv_t& execArgv) const noexcept;
+
+    // may run in a vfork child: exec_argv must be built by the parent
+    // and only _exit is allowed on failure
     template<typename Exec>
-    void exec_(argv_t const& argv, Exec&& exec) noexcept
+    void exec_(char* const* exec_argv, Exec&& exec) noexcept
     {
-        const auto exec_argv = makeExecArgv_(argv);
-
         if (exec(exec_argv[0], exec_argv) == -1)
         {
             perror("exec");
-            exit(EXIT_FAILURE);
+            _exit(EXIT_FAILURE);
         }
     }
 
     struct routineArg_
     {
-        explicit routineArg_(Process * process, callback_t * callback) noexcept;
+        explicit routineArg_(Process * process, builtin_t const * builtin) noexcept;
         Process * process;
-        callback_t * callback;
+        builtin_t const * builtin;
     };
 
 private:
     const argv_t argv_;
     const stdfds_t stdfds_= defStdFds;
     const clsfds_t clsfds_= defClsFds;
+    const int pgid_ = noPgid;
+    const redirs_t redirs_;
+    const Limits limits_ = {};
     int pid_        = -1;
     int status_     = -1;
     bool isDone_      = false;
     bool isTermBySig_ = false;
-    char * STACK_   = nullptr;
+    bool isStopped_   = false;
+    bool isEvent_     = false; // reaped by reap(), not yet seen by isDone
+    int eventWstatus_ = 0;
+    bool isInline_    = false;
+    int64_t startNs_  = 0;  // steady clock
+    Usage usage_;
+
+    const bool          isInThread_ = false;
+    std::thread         thread_;
+    std::atomic<bool>   isThreadDone_{false};
+    int                 threadStatus_ = -1;
 };
 
 inline void PRINT_ERR(std::string const& msg) noexcept
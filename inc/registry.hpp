@@ -0,0 +1,72 @@
+#pragma once
+#include "plugin.hpp"
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace plugin {
+
+// Builtins by name: the shell's own ones and those of plugin libraries.
+//
+// Libraries are *.so files from $NANOSHELL_PLUGIN_PATH (directories or
+// files separated by ':'), the directory of the executable by default.
+// Nothing is opened at startup: a lookup of an unknown name opens the
+// libraries not opened yet in search path order until one of them has
+// it. The first library with a name wins, shell builtins win over all.
+class Registry
+{
+    using builtin_t = ::process::Process::builtin_t;
+
+    struct Library_
+    {
+        std::string path;
+        void *      handle      = nullptr;
+        bool        isTried     = false;    // opened, or failed to
+    };
+
+    struct Builtin_
+    {
+        builtin_t   builtin;
+        uint32_t    flags;
+        size_t      library;    // noLibrary_ for shell builtins
+    };
+
+    static constexpr const size_t noLibrary_ = -1;
+
+public:
+    static Registry& get(void) noexcept;
+
+    Registry(Registry const& registry)              = delete;
+    Registry operator=(Registry const& registry)    = delete;
+
+    // nullptr if no library has it, the pointer stays valid until reload
+    builtin_t const *           find        (std::string const& name)   noexcept;
+    bool                        isInProcess (std::string const& name)   noexcept;
+    void                        add         (std::string const& name,
+                                             builtin_t const& builtin,
+                                             uint32_t flags)            noexcept;
+    // opens every library
+    std::vector<std::string>    getNames    (void)                      noexcept;
+    // Closes and opens again the library with this path or file name,
+    // every open one if name is empty, and picks up new files on the
+    // search path. Messages for the user go to report.
+    bool                        reload      (std::string const& name,
+                                             std::string& report)       noexcept;
+
+private:
+    Registry(void) noexcept = default;
+    ~Registry(void) noexcept;
+
+    void    scan_   (void)                          noexcept;
+    bool    load_   (size_t library, std::string& error) noexcept;
+    void    unload_ (size_t library)                noexcept;
+
+    static std::string defaultPath_(void) noexcept;
+
+private:
+    bool                                        isScanned_ = false;
+    std::vector<Library_>                       libraries_;     // search path order
+    std::unordered_map<std::string, Builtin_>   builtins_;
+};
+
+} // namespace plugin
@@ -1,20 +1,21 @@
 #pragma once
 #include "analyze.hpp"
+#include "editor.hpp"
+#include "history.hpp"
+#include "complete.hpp"
+#include "capture.hpp"
+#include "place.hpp"
 #include <string_view>
 #include <array>
+#include <optional>
+#include <memory>
+#include <set>
+#include <tuple>
 
 namespace shell {
 
 class Shell
 {
-    enum class ESpecialAscii : uint8_t
-    {
-        BACKSPACE   = 127,
-        ENTER       = 10,
-        SPACE       = 32,
-        CTRL_D      = 4
-    };
-
     enum class EColors : uint8_t
     {
         DEFAULT = 0,
@@ -28,12 +29,20 @@ class Shell
         STOPPED,
         DONE,
         RUN_STOPPED, // only for pipe
+        QUEUED,      // background one waiting for a free slot
         UNKNOWN
     };
 
     using strview_t     = std::string_view;
     using array_colors_t= std::array<strview_t, (int)EColors::BLUE + 1>;
 
+    static constexpr const size_t maxFinishedTasks_ = 16; // kept for jobs
+    static constexpr const int64_t admitIntervalNs_ = 1000 * 1000 * 1000; // adaptive queue
+    static constexpr const double defPressureLimit_ = 10;  // percent, see place::Pressure
+
+    // higher priority first, then in order of enter; the job id last
+    using queueKey_t    = std::tuple<int, uint64_t, size_t>;
+
     static constexpr const array_colors_t colorsEscapeSeq_ =
     {
         "\033[0m",
@@ -41,19 +50,19 @@ class Shell
         "\033[1;34m"
     };
 
-    static constexpr const strview_t delEscapeSeq_   = "\10\33[K";
-    static constexpr const strview_t bellEscapeSeq_  = "\7";
-    static constexpr const strview_t leftEscapeSeq_  = "\033[1D";
-    static constexpr const strview_t rightEscapeSeq_ = "\033[1C";
-
-    static constexpr const int ASCII_BEGIN_ = 33;
-    static constexpr const int ASCII_END_   = 126;
-
 public:
     static constexpr const strview_t exitCmd = "exit";
     static constexpr const strview_t jobsCmd = "jobs";
     static constexpr const strview_t fgCmd = "fg";
     static constexpr const strview_t bgCmd = "bg";
+    static constexpr const strview_t historyCmd = "history";
+    static constexpr const strview_t hashCmd = "hash";
+    static constexpr const strview_t reloadCmd = "reload";
+    static constexpr const strview_t statsCmd = "stats";
+    static constexpr const strview_t captureCmd = "capture";
+    static constexpr const strview_t limitsCmd = "limits";
+    static constexpr const strview_t placementCmd = "placement";
+    static constexpr const strview_t queueCmd = "queue";
 
     Shell(void)     noexcept;
     ~Shell(void)    noexcept;
@@ -72,33 +81,126 @@ struct TaskItem
 {
     analyze::task_t         task;
     bool                    isForeground;
-    std::string const&      cmdLine;
+    std::string             cmdLine;
     analyze::ETypeCmdLine   type;
     EStateTask              state = EStateTask::RUN;
+    int64_t                 startNs = 0;    // unix time of enter
+    int64_t                 startSteadyNs = 0;
+    bool                    isTimed = false;    // `time` report when done
+    std::shared_ptr<::capture::Capture> capture = nullptr; // output of a background job
+    uint64_t                wallSec = 0;    // 0: no wall clock limit
+    analyze::Deadline       deadline = {};
+    std::string             breach = "";    // limit that ended it, see getBreach
+    int                     cpuSet = -1;    // of the placer, -1: not placed by it
+    int                     priority = 0;   // in the queue
+    uint64_t                queueSeq = 0;
+    std::shared_ptr<parser::CmdTree> cmdTree = nullptr;   // of a queued one, task is unset
 };
 
     void                printPreviewMessage(void)   const noexcept;
     SmartCmdLine        getSmartCmdLine(void)       noexcept;
-    void                addTaskItem(TaskItem item)  noexcept;
-    void                jobs(void)                  const noexcept;
+    // starts the line or queues it when it's a background one and the
+    // running ones are too many or the system is too busy
+    void                runTask(parser::CmdTree& cmdTree,
+                                analyze::ETypeCmdLine type) noexcept;
+    bool                isJobsCmd(void)             const;
+    void                jobs(void)                  noexcept;
     bool                isControlFlowCmd(void)      const;
     void                fg(size_t idx)              noexcept;
     void                bg(size_t idx)              noexcept;
+    bool                isHistoryCmd(void)          const;
+    void                history(void)               noexcept;
+    bool                isHashCmd(void)             const;
+    void                hash(void)                  noexcept;
+    bool                isStatsCmd(void)            const;
+    void                stats(void)                 noexcept;
+    bool                isReloadCmd(void)           const;
+    void                reload(void)                noexcept;
+    bool                isLimitsCmd(void)           const;
+    void                limits(void)                noexcept;
+    bool                isQueueCmd(void)            const;
+    void                queue(void)                 noexcept;
+    bool                isPlacementCmd(void)        const;
+    void                placement(void)             noexcept;
+    // cpus of a new background job in the automatic placement, id of the
+    // set it got or -1
+    int                 placeTask(parser::CmdTree& cmdTree) noexcept;
+    // a placed task that didn't start after all
+    void                unplaceTask(int cpuSet)     noexcept;
+    bool                isCaptureCmd(void)          const;
+    void                capture(void)               noexcept;
+    // where a new task writes, nullptr: to the terminal
+    std::shared_ptr<::capture::Capture>
+                        makeCapture(bool isForeground) const noexcept;
 
 private:
     void applyColor_    (EColors color, bool isFlush = true) const noexcept;
     void printMessage_  (std::string const& message, EColors color) const noexcept;
-    char getChar_       (void)                      noexcept;
+    std::string getPreviewMessage_(void)            const;
+    bool readInput_     (void)                      noexcept;
     void waitTasks_     (void)                      noexcept;
+    void indexTask_     (size_t idx)                noexcept;
+    bool startTask_     (size_t idx, parser::CmdTree& cmdTree,
+                         bool isQuiet)              noexcept;
+    bool startQueued_   (size_t idx, bool isForeground) noexcept;
+    void trimTasks_     (void)                      noexcept;
+    void admitTasks_    (void)                      noexcept;
+    bool canAdmit_      (void)                      const noexcept;
+    size_t runningJobs_ (void)                      const noexcept;
+    bool isTimerDue_    (void)                      const noexcept;
+    bool isInThreadTask_(TaskItem const& item)      const noexcept;
+    void drainEventFds_ (void)                      noexcept;
+    void pollEventFds_  (void)                      noexcept;
+    bool isCapturing_   (void)                      const noexcept;
+    void expireTasks_   (void)                      noexcept;
+    void recordTask_    (TaskItem& item)            noexcept;
+    void retireTasks_   (void)                      noexcept;
+    void describeTask_  (size_t idx, TaskItem const& item,
+                         std::ostream& out)         const;
+    bool searchHistory_ (std::string_view query, bool isOlder,
+                         std::string& match)        noexcept;
+    bool drainCapture_  (int fd)                    noexcept;
 
 private:
-    char        char_;
-    size_t      pos_ = 0;
     std::string cmdLine_;
+    editor::LineEditor editor_;
+    std::string inBuf_;         // bytes read but not fed to the editor yet
+    size_t      inPos_ = 0;
+    int64_t     enterNs_ = 0;
+    int64_t     enterSteadyNs_ = 0;
+    int64_t     wakeNs_ = 0;        // SIGCHLD seen by epoll, not reaped yet
+
+    history::History history_;
+    complete::Completer completer_;
+    uint64_t    searchBegin_ = 0;   // current ctrl + r match in history_
+    uint64_t    searchEnd_ = 0;
     sigset_t    sigset1_;
     sigset_t    sigset2_;
-    std::vector<TaskItem> tasks_;
+    std::vector<std::optional<TaskItem>> tasks_;   // by job id, free ids are reused
+    std::vector<size_t> doneTasks_;     // finished, not retired yet
+    std::vector<std::string> finishedTasks_;    // ring of the last retired ones
+    size_t finishedHead_ = 0;
     size_t fgTaskIdx_ = -1;
+
+    int         epollFd_    = -1;
+    int         sigFd_      = -1;   // SIGCHLD as a readable fd
+    int         timerFd_    = -1;   // the nearest wall clock limit of a job
+    bool        isTimerArmed_ = false;
+    std::unordered_map<int, size_t> pidToTask_;
+    std::vector<size_t> threadTasks_;   // builtin pipelines and inline builtins, no SIGCHLD
+
+    place::Placer placer_;
+    bool        isPlaceAuto_ = false;   // background jobs go to the least loaded cpus
+
+    std::set<queueKey_t> queued_;   // background jobs not started yet
+    uint64_t    queueSeq_ = 0;
+    size_t      maxJobs_ = 0;       // running background ones, 0: no limit
+    double      pressureLimit_ = 0; // percent, 0: the pressure doesn't matter
+    int64_t     admitNs_ = 0;       // the last one started by the adaptive queue
+
+    size_t      captureLimit_ = 0;  // per background job, 0: they write to the terminal
+    // by job id, a finished job's one stays until the id is taken again
+    std::vector<std::shared_ptr<::capture::Capture>> captures_;
 };
 
 } // namespace shell
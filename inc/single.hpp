@@ -1,18 +1,30 @@
 #pragma once
 #include "process.hpp"
+#include "parser.hpp"
+#include "pool.hpp"
 
 namespace single {
 
 struct Single : public process::Process
 {
-    Single(argv_t const& argv, bool isForeground = true) noexcept;
+    // stdFds: where stdin, stdout and stderr go, -1 is the shell's one
+    Single(argv_t const& argv, bool isForeground = true,
+           redirs_t const& redirs = {},
+           stdfds_t const& stdFds = defStdFds,
+           Limits const& limits = {}) noexcept;
     ~Single(void) noexcept;
 
+    // tasks come and go with every command, their memory is pooled
+    static void * operator new      (size_t size);
+    static void   operator delete   (void * ptr, size_t size) noexcept;
+
 private:
     const bool  isForeground_;
     const int   termPid_;
 };
 
-std::pair<Single *,bool>  make_single(std::string const& cmdLine);
+std::pair<Single *,bool>  make_single(parser::CmdTree const& cmdTree,
+                                      process::Process::stdfds_t const& stdFds =
+                                          process::Process::defStdFds);
 
 } // namespace single
@@ -0,0 +1,110 @@
+#pragma once
+#include <string>
+#include <ostream>
+#include <atomic>
+#include <cstdint>
+
+namespace stats {
+
+enum class EMetric : uint8_t
+{
+    PARSE,      // analyzeCmdLine
+    SPAWN,      // fork/vfork/posix_spawn/clone of one process
+    START,      // enter pressed to job started, parse and spawns included
+    REAP,       // SIGCHLD (or wait4 return) to job states updated
+    PROMPT,     // prompt rendered and flushed
+    COUNT
+};
+
+// Latency histograms of the shell itself.
+//
+// Every metric is a log-linear histogram: 2^subBits linear buckets per
+// power of two of nanoseconds, so a bucket is at most 1/16 wide of its
+// value, plus count, sum, min and max. Recording is a few relaxed atomic
+// adds on the caller's thread, no locks, no allocation.
+//
+// The table lives in a shared mapping. publish() moves it to a file that
+// monitors map read-only with the layout below (native endianness): they
+// may see a bucket before the count that goes with it, nothing worse.
+class Stats
+{
+public:
+    static constexpr const uint32_t subBits     = 4;
+    static constexpr const uint32_t maxBits     = 40;   // ~18 min, longer is clamped
+    static constexpr const uint32_t bucketCount = (maxBits - subBits + 1) << subBits;
+    static constexpr const uint32_t metricCount = (uint32_t)EMetric::COUNT;
+
+    struct Histogram
+    {
+        char                    name[16];
+        std::atomic<uint64_t>   count;
+        std::atomic<uint64_t>   sumNs;
+        std::atomic<uint64_t>   minNs;      // UINT64_MAX while empty
+        std::atomic<uint64_t>   maxNs;
+        std::atomic<uint64_t>   buckets[bucketCount];
+    };
+
+    struct Table
+    {
+        char        magic[8];
+        uint32_t    version;
+        uint32_t    subBits;
+        uint32_t    metricCount;
+        uint32_t    bucketCount;
+        int32_t     pid;
+        uint32_t    pad;
+        int64_t     startNs;    // unix time of the shell start
+        Histogram   metrics[Stats::metricCount];
+    };
+
+    static constexpr const char     magic[8]    = {'N','S','S','T','A','T','1','\0'};
+    static constexpr const uint32_t version     = 1;
+
+    // records the time from construction to destruction
+    class Timer
+    {
+    public:
+        Timer(EMetric metric) noexcept;
+        ~Timer(void) noexcept;
+    private:
+        EMetric metric_;
+        int64_t beginNs_;
+    };
+
+    static Stats& get(void) noexcept;
+
+    Stats(Stats const& stats)               = delete;
+    Stats operator=(Stats const& stats)     = delete;
+
+    // CLOCK_MONOTONIC, what every metric and every job duration is measured with
+    static int64_t  nowNs       (void) noexcept;
+    // $NANOSHELL_STATS, or nanoshell.<pid>.stats in $XDG_RUNTIME_DIR or /tmp
+    static std::string defaultPath(void) noexcept;
+    // bucket of a value and the highest value the bucket holds
+    static uint32_t toBucket    (uint64_t ns) noexcept;
+    static uint64_t fromBucket  (uint32_t bucket) noexcept;
+
+    void        record      (EMetric metric, int64_t ns) noexcept;
+    void        reset       (void)                      noexcept;
+    // before any other thread records, the file is removed at exit; it is
+    // created anew, readable by the user only, never through a symlink
+    bool        publish     (std::string const& path)   noexcept;
+    std::string const& getPath(void)                    const noexcept;
+    // value below which permille of the samples are, 0 if none
+    uint64_t    getPercentile(EMetric metric, uint32_t permille) const noexcept;
+    Histogram const& getHistogram(EMetric metric)       const noexcept;
+    void        print       (std::ostream& out)         const;
+
+private:
+    Stats(void) noexcept;
+    ~Stats(void) noexcept;
+
+    static Table *  map_    (int fd) noexcept;
+    static void     init_   (Table& table) noexcept;
+
+private:
+    Table *     table_  = nullptr;
+    std::string path_;      // empty until published
+};
+
+} // namespace stats
@@ -0,0 +1,140 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <string_view>
+#include <cstdint>
+#include <sys/types.h>
+#include <errno.h>
+
+namespace stream {
+
+// Byte stream endpoint handed to builtins instead of raw fds,
+// so a builtin can run in a clone child as well as in a shell thread
+class Stream
+{
+public:
+    virtual ~Stream(void) noexcept = default;
+
+    // both return -1 and set errno on error, read returns 0 on EOF
+    virtual ssize_t read    (void * buf, size_t size)       noexcept = 0;
+    virtual ssize_t write   (void const * buf, size_t size) noexcept = 0;
+    // underlying descriptor, -1 when the stream isn't backed by one
+    virtual int     getFd   (void)                          const noexcept;
+    // EOF for the peer, the stream must not be used afterwards
+    virtual void    close   (void)                          noexcept;
+
+    // inline: builtins in shared libraries can't link against the shell
+    bool writeAll(void const * buf, size_t size) noexcept
+    {
+        auto ptr = (char const *)buf;
+
+        while (size)
+        {
+            const ssize_t written = write(ptr, size);
+
+            if (written == -1 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                return false;
+
+            ptr  += written;
+            size -= written;
+        }
+
+        return true;
+    }
+
+    bool print(std::string_view str) noexcept
+    {
+        return writeAll(str.data(), str.size());
+    }
+};
+
+class FdStream : public Stream
+{
+public:
+    explicit FdStream(int fd, bool isOwner = false) noexcept;
+    ~FdStream(void) noexcept override;
+
+    ssize_t read    (void * buf, size_t size)       noexcept override;
+    ssize_t write   (void const * buf, size_t size) noexcept override;
+    int     getFd   (void)                          const noexcept override;
+    void    close   (void)                          noexcept override;
+
+private:
+    int     fd_;
+    bool    isOwner_;
+};
+
+// Lock-free single producer / single consumer byte ring.
+// Only a side that has to sleep (empty or full ring) touches the futex.
+class Ring
+{
+public:
+    static constexpr const size_t defCapacity = 64 * 1024; // = 64 KiB
+
+    explicit Ring(size_t capacity = defCapacity) noexcept;
+    ~Ring(void) noexcept;
+
+    Ring(Ring const& ring)              = delete;
+    Ring operator=(Ring const& ring)    = delete;
+
+    ssize_t read        (void * buf, size_t size)       noexcept;
+    ssize_t write       (void const * buf, size_t size) noexcept;
+    void    closeRead   (void)                          noexcept;
+    void    closeWrite  (void)                          noexcept;
+
+private:
+    void    wait_       (uint32_t seq)                  noexcept;
+    void    wake_       (void)                          noexcept;
+
+private:
+    char *          buf_;
+    const size_t    mask_;
+
+    alignas(64) std::atomic<size_t>     head_{0};   // consumer position
+    alignas(64) std::atomic<size_t>     tail_{0};   // producer position
+    alignas(64) std::atomic<uint32_t>   seq_{0};    // futex word
+    std::atomic<uint32_t>               waiters_{0};
+    std::atomic<bool>                   isReadClosed_{false};
+    std::atomic<bool>                   isWriteClosed_{false};
+};
+
+class RingReader : public Stream
+{
+public:
+    explicit RingReader(Ring& ring) noexcept;
+    ~RingReader(void) noexcept override;
+
+    ssize_t read    (void * buf, size_t size)       noexcept override;
+    ssize_t write   (void const * buf, size_t size) noexcept override;
+    void    close   (void)                          noexcept override;
+
+private:
+    Ring&   ring_;
+    bool    isClosed_ = false;
+};
+
+class RingWriter : public Stream
+{
+public:
+    explicit RingWriter(Ring& ring) noexcept;
+    ~RingWriter(void) noexcept override;
+
+    ssize_t read    (void * buf, size_t size)       noexcept override;
+    ssize_t write   (void const * buf, size_t size) noexcept override;
+    void    close   (void)                          noexcept override;
+
+private:
+    Ring&   ring_;
+    bool    isClosed_ = false;
+};
+
+struct Io
+{
+    Stream& in;
+    Stream& out;
+    Stream& err;
+};
+
+} // namespace stream
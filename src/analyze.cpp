@@ -1,71 +1,53 @@
 #include "../inc/analyze.hpp"
-#include <regex>
+#include "../inc/stats.hpp"
+#include "../inc/plan.hpp"
+#include <sstream>
+#include <iomanip>
+#include <signal.h>
+#include <time.h>
 
 using namespace analyze;
 
 namespace {
 
-const std::string patternSpaces =
-"^[ ]*";
-const std::string patternArgvPrefix_ =
-"(([ ]+)((\"[^\"]+\")|([-_\\w\\d.,/]+)))+";
-const std::string patternArgvPostfix_ =
-"(((\"[^\"]+\")|([-_\\w\\d.,/]+))([ ]+))+";
-const std::string patternBackground_ =
-"[ ]*( &)?[ ]*$";
-
-const std::string patternSingle =
-    patternSpaces                               +
-    "((\"[^\"]+\")|([-_\\w\\d.,/]+))"           +
-    "(([ ]+)((\"[^\"]+\")|([-_\\w\\d.,/]+)))*"  +
-    patternBackground_;
-
-const std::string patternPpipe =
-    patternSpaces                       +
-    patternArgvPostfix_                 +
-    "\\|{1}"                            +
-    patternArgvPrefix_                  +
-    patternBackground_;
-
-const std::string patternBoolean =
-    patternSpaces                       +
-    patternArgvPostfix_                 +
-    "(&&|\\|\\|)"                       +
-    patternArgvPrefix_                  +
-    patternBackground_;
+std::string seconds(int64_t ns)
+{
+    std::ostringstream sstream;
+    sstream << std::fixed << std::setprecision(3) << ns / 1e9 << "s";
+    return sstream.str();
+}
 
 } // namespace
 
-
-ETypeCmdLine analyze::analyzeCmdLine(std::string const& cmdLine) noexcept
+ETypeCmdLine analyze::analyzeCmdLine(std::string const& cmdLine,
+                                     parser::CmdTree& cmdTree) noexcept
 {
-    static const auto flags =   std::regex_constants::ECMAScript |
-                                std::regex_constants::icase;
-    static const std::regex regexSingle (patternSingle, flags);
-    static const std::regex regexPpipe  (patternPpipe,  flags);
-    static const std::regex regexBoolean(patternBoolean,flags);
+    stats::Stats::Timer timer(stats::EMetric::PARSE);
 
-    auto checkRegEx = [&cmdLine](std::regex const& pattern)
-    {
-        const auto begin_ = std::sregex_iterator(
-            cmdLine.begin(), cmdLine.end(), pattern);
-        const auto end_   = std::sregex_iterator();
-        const int cnt_    = std::distance(begin_, end_);
-
-        return (bool)(cnt_ == 1);
-    };
-
-    if (checkRegEx(regexSingle))
-        return ETypeCmdLine::SINGLE;
-    else if (checkRegEx(regexPpipe))
-        return ETypeCmdLine::PPIPE;
-    else if (checkRegEx(regexBoolean))
-        return ETypeCmdLine::BOOLEAN;
-    else
+    uint8_t cached;
+    if (plan::Cache::get().find(cmdLine, cmdTree, cached))
+        return (ETypeCmdLine)cached;
+
+    // lines that don't parse aren't worth keeping
+    if (!parser::parse(cmdLine, cmdTree))
         return ETypeCmdLine::UNKNOWN;
+
+    const auto& pipelines = cmdTree.pipelines;
+    ETypeCmdLine type;
+
+    if (pipelines.size() == 1 && pipelines[0].commands.size() == 1)
+        type = ETypeCmdLine::SINGLE;
+    else if (pipelines.size() == 1)
+        type = ETypeCmdLine::PPIPE;
+    else
+        type = ETypeCmdLine::BOOLEAN;
+
+    plan::Cache::get().add(cmdLine, cmdTree, (uint8_t)type);
+    return type;
 }
 
-optPairTask_t analyze::createTask(std::string const& cmdLine, ETypeCmdLine typeCmdLine) noexcept
+optPairTask_t analyze::createTask(parser::CmdTree const& cmdTree, ETypeCmdLine typeCmdLine,
+                                  bool isQuiet, ::process::Process::stdfds_t const& stdFds) noexcept
 {
     optPairTask_t task_{};
 
@@ -73,22 +55,27 @@ optPairTask_t analyze::createTask(std::string const& cmdLine, ETypeCmdLine typeC
     {
         if (typeCmdLine == ETypeCmdLine::SINGLE)
         {
-            std::cout << "SINGLE\n";
-            task_ = ::single::make_single(cmdLine);
+            if (!isQuiet)
+                std::cout << "SINGLE\n";
+            task_ = ::single::make_single(cmdTree, stdFds);
         }
         else if (typeCmdLine == ETypeCmdLine::PPIPE)
         {
-            std::cout << "PPIPE\n";
-            task_ = ::ppipe::make_ppipe(cmdLine);
+            if (!isQuiet)
+                std::cout << "PPIPE\n";
+            task_ = ::ppipe::make_ppipe(cmdTree, stdFds);
         }
         else if (typeCmdLine == ETypeCmdLine::BOOLEAN)
         {
-            std::cout << "BOOLEAN\n";
-            task_ = ::boolean::make_boolean(cmdLine);
+            if (!isQuiet)
+                std::cout << "BOOLEAN\n";
+            task_ = ::boolean::make_boolean(cmdTree, stdFds);
         }
-        else if (typeCmdLine == ETypeCmdLine::UNKNOWN)
+        else if (typeCmdLine == ETypeCmdLine::UNKNOWN && !isQuiet)
         {
             std::cout << "UNKNOWN\n";
+            if (!cmdTree.error.empty())
+                std::cout << cmdTree.error << "\n";
             std::cout << "Wrong command's format or bug x_x\n";
         }
 
@@ -102,3 +89,172 @@ optPairTask_t analyze::createTask(std::string const& cmdLine, ETypeCmdLine typeC
 
     return task_;
 }
+
+int analyze::joinTask(task_t const& task, ETypeCmdLine typeCmdLine) noexcept
+{
+    int status = 0;
+
+    if (typeCmdLine == ETypeCmdLine::SINGLE)
+    {
+        auto singleProcess = std::get<single::Single*>(task);
+        status = singleProcess->join();
+        if (singleProcess->isTermBySig())
+            status += 128;
+    }
+    else if (typeCmdLine == ETypeCmdLine::PPIPE)
+    {
+        auto ppipeProcess = std::get<ppipe::Ppipe*>(task);
+        status = ppipeProcess->join().back();
+        if (ppipeProcess->isTermBySig().back())
+            status += 128;
+    }
+    else if (typeCmdLine == ETypeCmdLine::BOOLEAN)
+    {
+        status = std::get<boolean::Boolean*>(task)->join();
+    }
+
+    return status;
+}
+
+bool analyze::expireTask(task_t const& task, int64_t nowNs, Deadline& deadline) noexcept
+{
+    using EKill = ::process::Process::EKill;
+
+    if (!deadline.atNs || nowNs < deadline.atNs)
+        return false;
+
+    if (!deadline.isExpired)
+    {
+        std::visit([](auto task) { task->KILL(EKill::TERM); task->KILL(EKill::CONT); }, task);
+        deadline.isExpired  = true;
+        deadline.atNs       = nowNs + killGraceNs;
+    }
+    else
+    {
+        std::visit([](auto task) { task->KILL(EKill::KILL); }, task);
+        deadline.atNs       = 0;
+    }
+
+    return true;
+}
+
+int analyze::joinTaskUntil(task_t const& task, ETypeCmdLine typeCmdLine,
+                           Deadline& deadline) noexcept
+{
+    // nothing to wait on with a timeout for all kinds of tasks, so poll
+    const struct timespec pollTs = {0, 10 * 1000 * 1000};  // = 10 ms
+
+    while (deadline.atNs && !std::visit([](auto task) { return task->isDone(true); }, task))
+    {
+        expireTask(task, stats::Stats::nowNs(), deadline);
+        nanosleep(&pollTs, NULL);
+    }
+
+    const int status = joinTask(task, typeCmdLine);
+    return deadline.isExpired ? timeoutStatus : status;
+}
+
+std::string analyze::getBreach(task_t const& task, ETypeCmdLine typeCmdLine,
+                               Deadline const& deadline)
+{
+    if (deadline.isExpired)
+        return "wall";
+
+    for (auto const * process : getProcesses(task, typeCmdLine))
+    {
+        const auto& usage   = process->getUsage();
+        const int64_t cpuUs = (int64_t)process->getLimits().cpuSec * 1000 * 1000;
+        const int sig       = process->getTermSig();
+
+        if (sig == SIGXCPU || (sig == SIGKILL && cpuUs && usage.userUs + usage.sysUs >= cpuUs))
+            return "cpu";
+    }
+
+    return "";
+}
+
+std::vector<::process::Process const*> analyze::getProcesses(task_t const& task,
+                                                             ETypeCmdLine typeCmdLine) noexcept
+{
+    std::vector<::process::Process const*> processes;
+
+    try
+    {
+        if (typeCmdLine == ETypeCmdLine::SINGLE)
+            processes.push_back(std::get<single::Single*>(task));
+        else if (typeCmdLine == ETypeCmdLine::PPIPE)
+        {
+            auto ppipeProcess = std::get<ppipe::Ppipe*>(task);
+            for (size_t stage = 0; stage < ppipeProcess->size(); stage++)
+                processes.push_back(&ppipeProcess->getProcess(stage));
+        }
+        else if (typeCmdLine == ETypeCmdLine::BOOLEAN)
+            processes = std::get<boolean::Boolean*>(task)->getProcesses();
+    }
+    catch (std::bad_alloc const& err)
+    {
+        ::process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    return processes;
+}
+
+std::string analyze::formatUsage(::process::Process::Usage const& usage)
+{
+    std::ostringstream sstream;
+
+    sstream << "user " << seconds(usage.userUs * 1000) << " sys " << seconds(usage.sysUs * 1000)
+            << " maxrss ";
+    if (usage.maxRssKb)
+        sstream << std::fixed << std::setprecision(1) << usage.maxRssKb / 1024.0 << "MiB";
+    else
+        sstream << "-";
+
+    sstream << " flt " << usage.minFlt << "/" << usage.majFlt
+            << " csw " << usage.volCsw << "/" << usage.involCsw;
+
+    return sstream.str();
+}
+
+void analyze::reportUsage(task_t const& task, ETypeCmdLine typeCmdLine, int64_t wallNs,
+                          std::ostream& out) noexcept
+{
+    const auto processes = getProcesses(task, typeCmdLine);
+
+    try
+    {
+        if (processes.size() == 1)
+        {
+            out << "real " << seconds(wallNs) << " " << formatUsage(processes[0]->getUsage()) << "\n";
+            return;
+        }
+
+        ::process::Process::Usage total;
+
+        for (size_t idx = 0; idx < processes.size(); idx++)
+        {
+            auto const& usage = processes[idx]->getUsage();
+
+            out << "[" << idx << "]";
+            for (auto const& arg : processes[idx]->getArgv())
+                out << " " << arg;
+            out << ": real " << seconds(usage.wallNs) << " " << formatUsage(usage) << "\n";
+
+            total.userUs    += usage.userUs;
+            total.sysUs     += usage.sysUs;
+            total.maxRssKb  = std::max(total.maxRssKb, usage.maxRssKb);
+            total.minFlt    += usage.minFlt;
+            total.majFlt    += usage.majFlt;
+            total.volCsw    += usage.volCsw;
+            total.involCsw  += usage.involCsw;
+        }
+
+        out << "total: real " << seconds(wallNs) << " " << formatUsage(total) << "\n";
+    }
+    catch (std::exception const& err)
+    {
+        ::process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
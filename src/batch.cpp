@@ -0,0 +1,232 @@
+#include "../inc/batch.hpp"
+#include "../inc/stats.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <variant>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+
+using namespace batch;
+
+Batch::Batch(bool isReport) noexcept
+    : isReport_(isReport)
+{
+    ::process::Process::setJobControl(false);
+}
+
+Batch::~Batch(void) noexcept
+{
+    reapBackground_(false);
+}
+
+int Batch::runString(std::string_view script) noexcept
+{
+    try
+    {
+        while (!script.empty() && !isExit_)
+        {
+            const size_t newline = script.find('\n');
+            runLine(std::string(script.substr(0, newline)));
+            script = newline == std::string_view::npos ? "" : script.substr(newline + 1);
+        }
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    return status_;
+}
+
+int Batch::runFile(std::string const& path) noexcept
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        perror(path.c_str());
+        return status_ = noFileStatus_;
+    }
+
+    runFd(fd);
+    close(fd);
+    return status_;
+}
+
+int Batch::runFd(int fd) noexcept
+{
+    char chunk[chunkSize_];
+    std::string cmdLine;
+
+    try
+    {
+        while (!isExit_)
+        {
+            const ssize_t readed = read(fd, chunk, sizeof(chunk));
+
+            if (readed == -1 && errno == EINTR)
+                continue;
+            if (readed == -1)
+            {
+                perror("read");
+                break;
+            }
+            if (readed == 0)
+                break;
+
+            // a line may span chunks, only its tail is copied
+            std::string_view rest(chunk, readed);
+            size_t newline;
+
+            while (!isExit_ && (newline = rest.find('\n')) != std::string_view::npos)
+            {
+                cmdLine.append(rest.data(), newline);
+                runLine(cmdLine);
+                cmdLine.clear();
+                rest.remove_prefix(newline + 1);
+            }
+
+            cmdLine.append(rest);
+        }
+
+        if (!isExit_ && !cmdLine.empty())
+            runLine(cmdLine);
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    return status_;
+}
+
+int Batch::runLine(std::string const& cmdLine) noexcept
+{
+    lineNo_++;
+    reapBackground_(true);
+
+    const size_t first = cmdLine.find_first_not_of(" \t\r");
+    if (first == std::string::npos || cmdLine[first] == '#')
+        return status_;
+
+    try
+    {
+        std::stringstream sstream(cmdLine);
+        std::string cmd;
+        sstream >> cmd;
+
+        if (cmd == "exit")
+        {
+            int status = status_;
+            if (sstream >> status)
+                status_ = status & 0xff;
+            isExit_ = true;
+            return status_;
+        }
+
+        parser::CmdTree cmdTree;
+        const auto typeCmdLine = analyze::analyzeCmdLine(cmdLine, cmdTree);
+
+        if (typeCmdLine == type_t::UNKNOWN)
+        {
+            std::cerr << "nanoshell: line " << lineNo_ << ": "
+                      << (cmdTree.error.empty() ? "wrong command's format" : cmdTree.error)
+                      << std::endl;
+            status_ = syntaxStatus_;
+            report_();
+            return status_;
+        }
+
+        const auto beginNs = ::stats::Stats::nowNs();
+        const auto taskWrapper = analyze::createTask(cmdTree, typeCmdLine, true);
+        if (!taskWrapper)
+            return status_;
+
+        const auto [task, isForeground] = *taskWrapper;
+        const uint64_t wallSec = ::process::Process::applyDefaultLimits(cmdTree.limits).wallSec;
+
+        analyze::Deadline deadline;
+        if (wallSec)
+            deadline.atNs = beginNs + (int64_t)wallSec * 1000 * 1000 * 1000;
+
+        if (isForeground)
+        {
+            status_ = analyze::joinTaskUntil(task, typeCmdLine, deadline);
+            if (deadline.isExpired)
+                std::cerr << "nanoshell: line " << lineNo_ << ": timed out" << std::endl;
+            if (cmdTree.isTimed)
+                analyze::reportUsage(task, typeCmdLine, ::stats::Stats::nowNs() - beginNs,
+                                     std::cerr);
+            deleteTask_(task);
+        }
+        else
+        {
+            background_.emplace_back(task, typeCmdLine, deadline);
+            status_ = ::process::Process::successStatus;
+        }
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    report_();
+    return status_;
+}
+
+bool Batch::isExit(void) const noexcept
+{
+    return isExit_;
+}
+
+int Batch::getStatus(void) const noexcept
+{
+    return status_;
+}
+
+
+/// Below private interface implementation
+
+void Batch::report_(void) const noexcept
+{
+    if (isReport_)
+        std::cerr << "line " << lineNo_ << ": status " << status_ << std::endl;
+}
+
+void Batch::reapBackground_(bool isAsynk) noexcept
+{
+    for (size_t pos = 0; pos < background_.size();)
+    {
+        auto& [task, type, deadline] = background_[pos];
+        analyze::expireTask(task, ::stats::Stats::nowNs(), deadline);
+
+        // a blocking wait can't keep the deadline, joinTaskUntil below does
+        const bool isDone = std::visit([isAsynk, &deadline](auto task)
+        {
+            return task->isDone(isAsynk || deadline.atNs);
+        }, task);
+
+        // a blocking isDone returns on stops too
+        if (!isDone && isAsynk)
+        {
+            pos++;
+            continue;
+        }
+
+        analyze::joinTaskUntil(task, type, deadline);
+        deleteTask_(task);
+        background_[pos] = background_.back();
+        background_.pop_back();
+    }
+}
+
+void Batch::deleteTask_(task_t const& task) noexcept
+{
+    std::visit([](auto task) { delete task; }, task);
+}
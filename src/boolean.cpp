@@ -2,18 +2,24 @@
 
 #include <sys/types.h>
 #include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
 #include <cassert>
-#include <sstream>
 
 using namespace boolean;
 
 
-Boolean::Boolean(argv_t const& argv1, argv_t const& argv2, bool isForeground, EOper oper) noexcept
-    : argv2_(argv2), isForeground_(isForeground), oper_(oper), termPid_(getpid())
+Boolean::Boolean(std::vector<Pipeline> const& pipelines, std::vector<EOper> const& opers,
+                 bool isForeground, stdfds_t const& stdFds) noexcept
+    : isForeground_(isForeground), stdFds_(stdFds), termPid_(getpid())
 {
+    assert(pipelines.size() >= 2 && opers.size() + 1 == pipelines.size());
+
     try
     {
-        process1_ = new Process(argv1);
+        pipelines_  = pipelines;
+        opers_      = opers;
+        elements_.reserve(pipelines_.size());
     }
     catch (std::bad_alloc const& err)
     {
@@ -21,182 +27,242 @@ Boolean::Boolean(argv_t const& argv1, argv_t const& argv2, bool isForeground, EO
         exit(EXIT_FAILURE);
     }
 
-    setpgid(process1_->getPid(), process1_->getPid());
+    // the same checks Single and Ppipe do to run without a child
+    for (auto const& pipeline : pipelines_)
+    {
+        bool isChildless = true;
+        for (auto const& command : pipeline.commands)
+            isChildless = isChildless && Process::isThreadSafeBuiltin(command.argv[0]) &&
+                          !Process::isLimited(command.limits) &&
+                          (pipeline.commands.size() == 1 || command.redirs.empty());
+        isInThread_ = isInThread_ || isChildless;
+    }
 
-    if (isForeground_)
-        tcsetpgrp(0, process1_->getPid());
-    else
-        tcsetpgrp(0, termPid_);
+    start_(0);
 }
 
 Boolean::~Boolean(void) noexcept
 {
-    assert(process1_);
-    isSuccess(); // wait
+    join();
 
-    delete process1_;
-    if (process2_ != nullptr)
-        delete process2_;
+    for (auto element : elements_)
+        std::visit([](auto task) { delete task; }, element);
 
-    if (isForeground_)
+    if (isForeground_ && Process::isJobControl())
         tcsetpgrp(0, termPid_);
 }
 
-bool Boolean::isDone(bool isAsynk, int * pwstatus) noexcept
+void * Boolean::operator new(size_t size)
+{
+    return pool::Pool<Boolean>::alloc(size);
+}
+
+void Boolean::operator delete(void * ptr, size_t size) noexcept
+{
+    pool::Pool<Boolean>::free(ptr, size);
+}
+
+int Boolean::getPid(void) const noexcept
 {
-    assert(process1_);
-    const bool isDone1  = process1_->isDone(isAsynk, pwstatus);
-    bool isDone2        = false;
+    assert(!elements_.empty());
+
+    if (auto singleProcess = std::get_if<single::Single*>(&elements_.back()))
+        return (*singleProcess)->getPid();
+    else
+        return std::get<ppipe::Ppipe*>(elements_.back())->getPgid();
+}
 
-    if (isDone1)
+std::vector<int> Boolean::getPids(void) const noexcept
+{
+    std::vector<int> pids;
+
+    try
+    {
+        for (auto const * process : getProcesses())
+            pids.push_back(process->getPid());
+    }
+    catch (std::bad_alloc const& err)
     {
-        const int status1 = process1_->join();
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
 
-        if (process2_ != nullptr)
-        {
-            isDone2 = process2_->isDone(isAsynk, pwstatus);
-        }
-        else if (isNeedSecondProcess_(status1))
-        {
-            createSecondProcess_();
-            isDone2 = process2_->isDone(isAsynk, pwstatus);
-        }
-        else
+    return pids;
+}
+
+std::vector<::process::Process const*> Boolean::getProcesses(void) const noexcept
+{
+    std::vector<Process const*> processes;
+
+    try
+    {
+        for (auto element : elements_)
         {
-            isDone2 = true;
+            if (auto singleProcess = std::get_if<single::Single*>(&element))
+            {
+                processes.push_back(*singleProcess);
+                continue;
+            }
+
+            auto ppipeProcess = std::get<ppipe::Ppipe*>(element);
+            for (size_t stage = 0; stage < ppipeProcess->size(); stage++)
+                processes.push_back(&ppipeProcess->getProcess(stage));
         }
     }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
 
-    isDone_ = isDone1 && isDone2;
-    return isDone_;
+    return processes;
 }
 
-int Boolean::getPid(void) const noexcept
+void Boolean::KILL(EKill sig) const noexcept
 {
-    if (process2_)
-        return process2_->getPid();
-    else
-        return process1_->getPid();
+    // only the running pipeline gets it, the rest just never starts
+    if (sig != EKill::CONT && sig != EKill::TSTP &&
+        sig != EKill::TTIN && sig != EKill::TTOU)
+        isAborted_ = true;
+
+    std::visit([sig](auto task) { task->KILL(sig); }, elements_.back());
 }
 
-std::pair<int,int> Boolean::getPairPid(void) const noexcept
+bool Boolean::isDone(bool isAsynk, int * pwstatus) noexcept
 {
-    if (process2_)
-        return std::make_pair(process1_->getPid(), process2_->getPid());
-    else
-        return std::make_pair(process1_->getPid(), -1);
+    while (!isDone_ && isElementDone_(isAsynk, pwstatus))
+        if (!startNext_())
+            isDone_ = true;
+
+    return isDone_;
 }
 
-bool Boolean::isSuccess(void) noexcept
+int Boolean::join(void) noexcept
 {
-    assert(process1_);
-    const int status1   = process1_->join();
-    int status2         = failureStatus;
-
-    if (!isDone_)
+    while (!isDone_)
     {
-        if (isNeedSecondProcess_(status1))
-            createSecondProcess_();
-        if (process2_)
-            status2 = process2_->join();
-        isDone_ = true;
-    }
-    else if (process2_ != nullptr)
-    {
-        status2 = process2_->join();
+        joinElement_();
+        isDone(true);
     }
 
-    if (oper_ == EOper::AND)
-        return (status1 == successStatus) && (status2 == successStatus);
-    else
-        return (status1 == successStatus) || (status2 == successStatus);
+    return status_;
 }
 
-std::pair<bool,bool> Boolean::isTermBySig(void) noexcept
+bool Boolean::isSuccess(void) noexcept
 {
-    isSuccess(); // wait
-    const bool isTermBySig2 = process2_ ? process2_->isTermBySig() : false;
-    return std::make_pair(process1_->isTermBySig(), isTermBySig2);
+    return join() == successStatus;
 }
 
-void Boolean::KILL(EKill sig) const noexcept
+bool Boolean::isInThread(void) const noexcept
 {
-    // at one time work only one process
-    // or process1_ or process2_
-    if (process2_ != nullptr)
-        process2_->KILL(sig);
-    else
-        process1_->KILL(sig);
+    return isInThread_;
 }
 
-bool Boolean::isNeedSecondProcess_(int status) const noexcept
+void Boolean::setForeground(bool isForeground) noexcept
 {
-    return  ((oper_ == EOper::AND && status == successStatus) ||
-             (oper_ == EOper::OR && status == failureStatus)) &&
-            (process2_ == nullptr);
+    isForeground_ = isForeground;
 }
 
-void Boolean::createSecondProcess_(void) noexcept
+
+/// Below private interface implementation
+
+void Boolean::start_(size_t idx) noexcept
 {
+    assert(idx < pipelines_.size());
+    auto const& commands = pipelines_[idx].commands;
+    current_ = idx;
+
     try
     {
-        process2_ = new Process(std::move(argv2_));
-        setpgid(process2_->getPid(), process2_->getPid());
+        if (commands.size() == 1)
+            elements_.push_back(new single::Single(commands[0].argv, isForeground_,
+                                                   commands[0].redirs, stdFds_,
+                                                   commands[0].limits));
+        else
+            elements_.push_back(new ppipe::Ppipe(commands, isForeground_, stdFds_));
     }
     catch (std::bad_alloc const& err)
     {
         process::PRINT_ERR(err.what());
         exit(EXIT_FAILURE);
     }
-
-    if (isForeground_)
-        tcsetpgrp(0, process2_->getPid());
 }
 
-std::pair<Boolean *,bool> boolean::make_boolean(std::string const& cmdLine)
+bool Boolean::startNext_(void) noexcept
 {
-    assert(cmdLine.size() > 0);
-
-    std::stringstream sstream(cmdLine);
-    std::vector<std::string> argv1;
-    std::vector<std::string> argv2;
+    bool isInterrupted = false;
 
-    bool isSecondPart   = false;
-    bool isForeground   = true;
-    Boolean::EOper oper = Boolean::EOper::AND;
-
-    while (!sstream.eof())
+    if (auto singleProcess = std::get_if<single::Single*>(&elements_.back()))
     {
-        std::string token; sstream >> token;
-        if (token == "")
-            continue;
-        if (token == "||" || token == "&&")
+        status_ = (*singleProcess)->join();
+        if ((*singleProcess)->isTermBySig())
         {
-            isSecondPart = true;
-            if (token == "||")
-                oper = Boolean::EOper::OR;
-            continue;
+            isInterrupted = status_ == SIGINT;
+            status_ += 128;
         }
-        if (token == "&")
+    }
+    else
+    {
+        auto ppipeProcess = std::get<ppipe::Ppipe*>(elements_.back());
+        status_ = ppipeProcess->join().back();
+        if (ppipeProcess->isTermBySig().back())
         {
-            isForeground = false;
-            break;
+            isInterrupted = status_ == SIGINT;
+            status_ += 128;
         }
-        if (token[0] == '"')
+    }
+
+    if (isInterrupted || isAborted_)
+        return false;
+
+    for (size_t idx = current_ + 1; idx < pipelines_.size(); idx++)
+    {
+        const EOper oper = opers_[idx - 1];
+        const bool isRun = oper == EOper::SEQ ||
+                           (oper == EOper::AND) == (status_ == successStatus);
+
+        if (isRun)
         {
-            token.pop_back();
-            token.erase(0, 1);
+            start_(idx);
+            return true;
         }
+    }
 
-        if (isSecondPart)
-            argv2.push_back(token);
-        else
-            argv1.push_back(token);
+    return false;
+}
+
+bool Boolean::isElementDone_(bool isAsynk, int * pwstatus) noexcept
+{
+    if (auto singleProcess = std::get_if<single::Single*>(&elements_.back()))
+        return (*singleProcess)->isDone(isAsynk, pwstatus);
+
+    std::vector<int> wstatuses;
+    const bool isDone = std::get<ppipe::Ppipe*>(elements_.back())->isDone(isAsynk, &wstatuses);
+
+    // a stop or continue of any stage is one of the whole list
+    if (pwstatus)
+    {
+        *pwstatus = 0;
+        for (int wstatus : wstatuses)
+            if (WIFSTOPPED(wstatus) || WIFCONTINUED(wstatus))
+                *pwstatus = wstatus;
     }
 
-    Boolean * booleanProcess = new Boolean(argv1, argv2, isForeground, oper);
-    return std::make_pair(booleanProcess, isForeground);
+    return isDone;
 }
 
+void Boolean::joinElement_(void) noexcept
+{
+    std::visit([](auto task) { task->join(); }, elements_.back());
+}
+
+std::pair<Boolean *,bool> boolean::make_boolean(parser::CmdTree const& cmdTree,
+                                                process::Process::stdfds_t const& stdFds)
+{
+    assert(cmdTree.pipelines.size() >= 2);
 
+    const bool isForeground = cmdTree.isForeground;
 
+    Boolean * booleanProcess = new Boolean(cmdTree.pipelines, cmdTree.opers, isForeground, stdFds);
+    return std::make_pair(booleanProcess, isForeground);
+}
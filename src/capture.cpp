@@ -0,0 +1,156 @@
+#include "../inc/capture.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+using namespace capture;
+
+Capture::Capture(size_t limit) noexcept
+    : limit_(std::max(limit, minLimit))
+{
+    // no address space for it is up to the caller, not a reason to exit
+    void * addr = mmap(NULL, limit_, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (addr == MAP_FAILED)
+        return;
+    ring_ = (char *)addr;
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1)
+    {
+        perror("pipe2");
+        exit(EXIT_FAILURE);
+    }
+
+    readFd_  = fds[0];
+    writeFd_ = fds[1];
+    assert(fcntl(readFd_, F_SETFL, O_NONBLOCK) != -1);
+
+    // the job runs ahead this far between two drains, past that it blocks
+    // until the shell reads; a foreground job on shell threads keeps the
+    // shell from reading until it's done. A bigger pipe than allowed is
+    // not an error, the default one stays
+    fcntl(writeFd_, F_SETPIPE_SZ, (int)std::min(limit_, defLimit));
+}
+
+Capture::~Capture(void) noexcept
+{
+    if (readFd_ != -1)
+        close(readFd_);
+    if (writeFd_ != -1)
+        close(writeFd_);
+
+    if (ring_)
+        assert(munmap(ring_, limit_) == 0);
+}
+
+bool Capture::isValid(void) const noexcept
+{
+    return ring_ != nullptr;
+}
+
+::process::Process::stdfds_t Capture::getStdFds(void) const noexcept
+{
+    return {-1, writeFd_, writeFd_};
+}
+
+int Capture::getFd(void) const noexcept
+{
+    return readFd_;
+}
+
+size_t Capture::getLimit(void) const noexcept
+{
+    return limit_;
+}
+
+uint64_t Capture::getTotal(void) const noexcept
+{
+    return total_;
+}
+
+uint64_t Capture::getDropped(void) const noexcept
+{
+    return total_ > limit_ ? total_ - limit_ : 0;
+}
+
+size_t Capture::drain(void) noexcept
+{
+    size_t readed = 0;
+
+    while (readFd_ != -1)
+    {
+        // straight into the ring, up to its end at most
+        const size_t pos = total_ % limit_;
+        const ssize_t cnt = read(readFd_, ring_ + pos, limit_ - pos);
+
+        if (cnt > 0)
+        {
+            total_ += cnt;
+            readed += cnt;
+        }
+        else if (cnt == -1 && errno == EINTR)
+            continue;
+        else
+            break;  // empty (EAGAIN) or no writers left
+    }
+
+    return readed;
+}
+
+void Capture::finish(void) noexcept
+{
+    // a child of the job may still hold the pipe, it gets SIGPIPE
+    if (writeFd_ != -1)
+        assert(close(writeFd_) == 0);
+    writeFd_ = -1;
+
+    drain();
+
+    if (readFd_ != -1)
+        assert(close(readFd_) == 0);
+    readFd_ = -1;
+}
+
+void Capture::print(std::ostream& out) const
+{
+    const size_t kept  = std::min<uint64_t>(total_, limit_);
+    const size_t begin = (total_ - kept) % limit_;
+    const size_t first = std::min(kept, limit_ - begin);
+
+    out.write(ring_ + begin, first);
+    out.write(ring_, kept - first);
+}
+
+size_t Capture::parseSize(std::string_view str) noexcept
+{
+    size_t size = 0, pos = 0;
+
+    for (; pos < str.size() && '0' <= str[pos] && str[pos] <= '9'; pos++)
+    {
+        if (size > SIZE_MAX / 10 / 1024 / 1024)
+            return 0;
+        size = size * 10 + (str[pos] - '0');
+    }
+
+    if (pos == 0 || pos + 1 < str.size())
+        return 0;
+
+    if (pos + 1 == str.size())
+    {
+        if (str[pos] == 'K' || str[pos] == 'k')
+            size *= 1024;
+        else if (str[pos] == 'M' || str[pos] == 'm')
+            size *= 1024 * 1024;
+        else
+            return 0;
+    }
+
+    return size <= maxLimit ? size : 0;
+}
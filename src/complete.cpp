@@ -0,0 +1,455 @@
+#include "../inc/complete.hpp"
+#include "../inc/process.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <climits>
+#include <iterator>
+
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+using namespace complete;
+
+namespace {
+
+const uint32_t watchMask =
+    IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+    IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+bool isPrefix(std::string_view str, std::string_view prefix) noexcept
+{
+    return str.substr(0, prefix.size()) == prefix;
+}
+
+} // namespace
+
+Completer::Completer(void) noexcept
+{
+    inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    assert(inotifyFd_ != -1);
+}
+
+Completer::~Completer(void) noexcept
+{
+    close(inotifyFd_);
+}
+
+int Completer::getFd(void) const noexcept
+{
+    return inotifyFd_;
+}
+
+void Completer::handleEvents(void) noexcept
+{
+    alignas(struct inotify_event) char buf[4096];
+
+    auto findEntry = [](Dir_& dir, std::string_view name)
+    {
+        return std::lower_bound(dir.entries.begin(), dir.entries.end(), name,
+            [](Entry_ const& entry, std::string_view name) { return entry.name < name; });
+    };
+
+    try
+    {
+        ssize_t readed;
+        while ((readed = read(inotifyFd_, buf, sizeof(buf))) > 0)
+        for (char * ptr = buf; ptr < buf + readed; )
+        {
+            auto event = (struct inotify_event const *)ptr;
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            // lost events, nothing cached can be trusted
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                for (auto const& [wd, dir] : dirs_)
+                    inotify_rm_watch(inotifyFd_, wd);
+
+                dirs_.clear();
+                dirWds_.clear();
+                names_.clear();
+                pathEnv_.clear();
+                isIndexed_ = false;
+                continue;
+            }
+
+            const auto it = dirs_.find(event->wd);
+            if (it == dirs_.end())
+                continue;
+
+            Dir_& dir = it->second;
+
+            if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF))
+            {
+                inotify_rm_watch(inotifyFd_, event->wd);
+                dropDir_(event->wd);
+                continue;
+            }
+
+            if (event->len == 0)
+                continue;
+
+            const std::string name = event->name;
+            const bool isDir = event->mask & IN_ISDIR;
+            auto pos = findEntry(dir, name);
+            const bool isFound = pos != dir.entries.end() && pos->name == name;
+
+            if ((event->mask & (IN_CREATE | IN_MOVED_TO)) && !isFound)
+            {
+                dir.entries.insert(pos, {name, isDir});
+                if (dir.isPath && !isDir)
+                    addName_(name);
+            }
+            else if ((event->mask & (IN_DELETE | IN_MOVED_FROM)) && isFound)
+            {
+                if (dir.isPath && !pos->isDir)
+                    removeName_(name);
+                dir.entries.erase(pos);
+            }
+        }
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+void Completer::complete(std::string_view line, size_t wordBegin,
+                         std::vector<std::string>& candidates) noexcept
+{
+    const auto word = line.substr(wordBegin);
+
+    // the first word of a pipeline stage names a command
+    size_t pos = wordBegin;
+    while (pos && (line[pos - 1] == ' ' || line[pos - 1] == '\t'))
+        pos--;
+
+    const bool isCommand = pos == 0 || strchr("|&;(", line[pos - 1]);
+
+    if (isCommand && word.find('/') == std::string_view::npos)
+        findCommands(word, candidates);
+    else
+        findFiles(word, candidates);
+}
+
+void Completer::findCommands(std::string_view prefix,
+                             std::vector<std::string>& candidates) noexcept
+{
+    candidates.clear();
+    updatePath_();
+
+    auto it = std::lower_bound(names_.begin(), names_.end(), prefix,
+        [](Name_ const& name, std::string_view prefix) { return name.name < prefix; });
+
+    try
+    {
+        for (; it != names_.end() && isPrefix(it->name, prefix); it++)
+            candidates.push_back(it->name);
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+void Completer::findFiles(std::string_view word, std::vector<std::string>& candidates) noexcept
+{
+    candidates.clear();
+
+    const size_t slash  = word.rfind('/');
+    const auto dirPart  = slash == std::string_view::npos ? "" : word.substr(0, slash + 1);
+    const auto base     = word.substr(dirPart.size());
+
+    try
+    {
+        // cached by absolute path, the shell may cd away
+        std::string path(dirPart);
+        if (path.empty() || path[0] != '/')
+        {
+            char cwd[PATH_MAX];
+            if (getcwd(cwd, sizeof(cwd)) == nullptr)
+                return;
+            path = std::string(cwd) + "/" + path;
+        }
+
+        Dir_ * dir = getDir_(path, false);
+        if (dir == nullptr)
+            return;
+
+        auto it = std::lower_bound(dir->entries.begin(), dir->entries.end(), base,
+            [](Entry_ const& entry, std::string_view base) { return entry.name < base; });
+
+        for (; it != dir->entries.end() && isPrefix(it->name, base); it++)
+        {
+            // hidden files only when asked for
+            if (it->name[0] == '.' && (base.empty() || base[0] != '.'))
+                continue;
+
+            candidates.push_back(std::string(dirPart) + it->name + (it->isDir ? "/" : ""));
+        }
+
+        evictDirs_();
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+void Completer::updatePath_(void) noexcept
+{
+    const char * pathEnv = getenv("PATH");
+    if (pathEnv == nullptr)
+        pathEnv = "";
+
+    try
+    {
+        // another PATH, so another index
+        if (pathEnv_ != pathEnv || names_.empty())
+        {
+            pathEnv_ = pathEnv;
+            names_.clear();
+
+            for (auto& [wd, dir] : dirs_)
+                dir.isPath = false;
+            for (auto const& name : ::process::Process::getBuiltinNames())
+                addName_(name);
+
+            isIndexed_ = false;
+        }
+
+        // also picks up PATH directories created after they were dropped
+        if (!isIndexed_)
+        {
+            std::string_view rest = pathEnv_;
+
+            while (!rest.empty())
+            {
+                const size_t colon = rest.find(':');
+                const auto dir = rest.substr(0, colon);
+                rest = colon == std::string_view::npos ? "" : rest.substr(colon + 1);
+
+                if (!dir.empty())
+                    getDir_(std::string(dir), true);
+            }
+
+            isIndexed_ = true;
+        }
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+Completer::Dir_ * Completer::getDir_(std::string const& path, bool isPath) noexcept
+{
+    try
+    {
+        auto wdIt = dirWds_.find(path);
+        int wd = wdIt == dirWds_.end() ? -1 : wdIt->second;
+
+        if (wd == -1)
+        {
+            // watch first, so nothing changed after listing is missed
+            wd = inotify_add_watch(inotifyFd_, path.c_str(), watchMask);
+            if (wd == -1)
+                return nullptr;
+
+            dirWds_[path] = wd;
+        }
+
+        // the same directory may be known under another path
+        auto dirIt = dirs_.find(wd);
+        if (dirIt == dirs_.end())
+        {
+            Dir_ dir;
+            dir.path = path;
+
+            if (!listDir_(path, dir.entries))
+            {
+                inotify_rm_watch(inotifyFd_, wd);
+                dirWds_.erase(path);
+                return nullptr;
+            }
+
+            dirIt = dirs_.emplace(wd, std::move(dir)).first;
+        }
+
+        Dir_& dir = dirIt->second;
+        dir.lastUse = ++useClock_;
+
+        // entries are sorted too, so a whole directory is merged at once
+        if (isPath && !dir.isPath)
+        {
+            dir.isPath = true;
+
+            std::vector<Name_> merged;
+            merged.reserve(names_.size() + dir.entries.size());
+            auto it = names_.begin();
+
+            for (auto const& entry : dir.entries)
+            {
+                if (entry.isDir)
+                    continue;
+
+                while (it != names_.end() && it->name < entry.name)
+                    merged.push_back(std::move(*it++));
+
+                if (it != names_.end() && it->name == entry.name)
+                {
+                    merged.push_back(std::move(*it++));
+                    merged.back().refs++;
+                }
+                else
+                    merged.push_back({entry.name, 1});
+            }
+
+            std::move(it, names_.end(), std::back_inserter(merged));
+            names_ = std::move(merged);
+        }
+
+        return &dir;
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+void Completer::dropDir_(int wd) noexcept
+{
+    const auto it = dirs_.find(wd);
+    if (it == dirs_.end())
+        return;
+
+    if (it->second.isPath)
+    {
+        for (auto const& entry : it->second.entries)
+            if (!entry.isDir)
+                removeName_(entry.name);
+        isIndexed_ = false;
+    }
+
+    for (auto wdIt = dirWds_.begin(); wdIt != dirWds_.end();)
+    {
+        if (wdIt->second == wd)
+            wdIt = dirWds_.erase(wdIt);
+        else
+            wdIt++;
+    }
+
+    dirs_.erase(it);
+}
+
+void Completer::evictDirs_(void) noexcept
+{
+    while (true)
+    {
+        size_t cnt = 0;
+        int oldestWd = -1;
+        uint64_t oldestUse = UINT64_MAX;
+
+        for (auto const& [wd, dir] : dirs_)
+        {
+            if (dir.isPath)
+                continue;
+
+            cnt++;
+            if (dir.lastUse < oldestUse)
+            {
+                oldestUse   = dir.lastUse;
+                oldestWd    = wd;
+            }
+        }
+
+        if (cnt <= maxDirs_)
+            return;
+
+        inotify_rm_watch(inotifyFd_, oldestWd);
+        dropDir_(oldestWd);
+    }
+}
+
+void Completer::addName_(std::string const& name) noexcept
+{
+    auto it = std::lower_bound(names_.begin(), names_.end(), name,
+        [](Name_ const& item, std::string const& name) { return item.name < name; });
+
+    if (it != names_.end() && it->name == name)
+    {
+        it->refs++;
+        return;
+    }
+
+    try
+    {
+        names_.insert(it, {name, 1});
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+void Completer::removeName_(std::string const& name) noexcept
+{
+    auto it = std::lower_bound(names_.begin(), names_.end(), name,
+        [](Name_ const& item, std::string const& name) { return item.name < name; });
+
+    if (it == names_.end() || it->name != name)
+        return;
+
+    if (--it->refs == 0)
+        names_.erase(it);
+}
+
+// d_type only, a stat per entry is what freezes NFS-backed PATHs
+bool Completer::listDir_(std::string const& path, std::vector<Entry_>& entries) noexcept
+{
+    DIR * dir = opendir(path.c_str());
+    if (dir == nullptr)
+        return false;
+
+    try
+    {
+        while (struct dirent * dirent = readdir(dir))
+        {
+            const char * name = dirent->d_name;
+            if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+                continue;
+
+            bool isDir = dirent->d_type == DT_DIR;
+
+            struct stat st;
+            if (dirent->d_type == DT_UNKNOWN && fstatat(dirfd(dir), name, &st, 0) == 0)
+                isDir = S_ISDIR(st.st_mode);
+
+            entries.push_back({name, isDir});
+        }
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    closedir(dir);
+
+    std::sort(entries.begin(), entries.end(), [](Entry_ const& lhs, Entry_ const& rhs)
+    {
+        return lhs.name < rhs.name;
+    });
+
+    return true;
+}
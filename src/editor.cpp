@@ -0,0 +1,498 @@
+#include "../inc/editor.hpp"
+#include "../inc/process.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+#include <errno.h>
+
+using namespace editor;
+
+LineEditor::LineEditor(int outFd) noexcept
+    : outFd_(outFd)
+{}
+
+void LineEditor::begin(std::string_view prompt) noexcept
+{
+    try
+    {
+        prompt_ = prompt;
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    line_.resize(0);
+    out_.resize(0);
+    cursor_ = 0;
+    escape_ = EEscape::NONE;
+    isSearch_ = false;
+    shown_  = 0;
+}
+
+LineEditor::EAction LineEditor::feed(char const * buf, size_t size, size_t& used) noexcept
+{
+    for (used = 0; used < size; )
+    {
+        const char ch = buf[used++];
+
+        if (escape_ != EEscape::NONE)
+        {
+            escapeChar_(ch);
+            continue;
+        }
+
+        // any key the search doesn't know ends it and is handled as usual
+        if (isSearch_ && searchChar_(ch))
+            continue;
+
+        if (ASCII_BEGIN_ <= ch && ch <= ASCII_END_)
+        {
+            insert_(std::string_view(&ch, 1));
+            continue;
+        }
+
+        switch ((ESpecialAscii)ch)
+        {
+        case ESpecialAscii::ENTER:
+        case ESpecialAscii::CR:
+            return EAction::ENTER;
+        case ESpecialAscii::CTRL_D:
+            if (line_.empty())
+                return EAction::EOF_;
+            erase_(false);
+            break;
+        case ESpecialAscii::BACKSPACE:
+        case ESpecialAscii::BS:
+            erase_(true);
+            break;
+        case ESpecialAscii::CTRL_A:
+            moveTo_(0);
+            break;
+        case ESpecialAscii::CTRL_E:
+            moveTo_(line_.size());
+            break;
+        case ESpecialAscii::CTRL_U:
+            killTo_(0);
+            break;
+        case ESpecialAscii::CTRL_K:
+            killTo_(line_.size());
+            break;
+        case ESpecialAscii::CTRL_R:
+            startSearch_();
+            break;
+        case ESpecialAscii::TAB:
+            complete_();
+            break;
+        case ESpecialAscii::ESC:
+            escape_ = EEscape::ESC;
+            break;
+        case ESpecialAscii::CTRL_G:
+        default:
+            break;
+        }
+    }
+
+    return EAction::NONE;
+}
+
+void LineEditor::flush(void) noexcept
+{
+    size_t written = 0;
+
+    while (written < out_.size())
+    {
+        const ssize_t cnt = write(outFd_, out_.data() + written, out_.size() - written);
+
+        if (cnt == -1 && errno == EINTR)
+            continue;
+        if (cnt <= 0)
+            break;
+
+        written += cnt;
+    }
+
+    out_.resize(0);
+}
+
+void LineEditor::redraw(void) noexcept
+{
+    if (isSearch_)
+    {
+        shown_ = 0;
+        showSearch_();
+        return;
+    }
+
+    put_(line_);
+    putMove_(line_.size() - cursor_, 'D');
+}
+
+std::string const& LineEditor::getLine(void) const noexcept
+{
+    return line_;
+}
+
+void LineEditor::setSearcher(searcher_t searcher) noexcept
+{
+    searcher_ = std::move(searcher);
+}
+
+void LineEditor::setCompleter(completer_t completer) noexcept
+{
+    completer_ = std::move(completer);
+}
+
+void LineEditor::addEchoSample(uint64_t ns, size_t bytes) noexcept
+{
+    echoStats_.bursts++;
+    echoStats_.bytes    += bytes;
+    echoStats_.totalNs  += ns;
+    echoStats_.maxNs    = std::max(echoStats_.maxNs, ns);
+}
+
+LineEditor::EchoStats const& LineEditor::getEchoStats(void) const noexcept
+{
+    return echoStats_;
+}
+
+void LineEditor::insert_(std::string_view str) noexcept
+{
+    try
+    {
+        line_.insert(cursor_, str);
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    // typing at the end of line is the common case, the tail is empty then
+    put_(std::string_view(line_).substr(cursor_));
+    cursor_ += str.size();
+    putMove_(line_.size() - cursor_, 'D');
+}
+
+void LineEditor::complete_(void) noexcept
+{
+    if (!completer_)
+    {
+        put_(bellEscapeSeq_);
+        return;
+    }
+
+    auto isBreak = [](char ch) { return strchr(" \t|&;<>()", ch) != nullptr; };
+
+    size_t wordBegin = cursor_;
+    while (wordBegin && !isBreak(line_[wordBegin - 1]))
+        wordBegin--;
+
+    const std::string_view line = std::string_view(line_).substr(0, cursor_);
+    const size_t wordSize = cursor_ - wordBegin;
+    completer_(line, wordBegin, candidates_);
+
+    if (candidates_.empty())
+    {
+        put_(bellEscapeSeq_);
+        return;
+    }
+
+    // the single candidate is finished off, many share a common prefix
+    std::string_view common = candidates_[0];
+    for (auto const& candidate : candidates_)
+    {
+        const auto mismatch = std::mismatch(common.begin(), common.end(),
+                                            candidate.begin(), candidate.end());
+        common = common.substr(0, mismatch.first - common.begin());
+    }
+
+    if (candidates_.size() == 1)
+    {
+        insert_(common.substr(wordSize));
+        if (common.back() != '/')
+            insert_(" ");
+        return;
+    }
+
+    if (common.size() > wordSize)
+    {
+        insert_(common.substr(wordSize));
+        return;
+    }
+
+    // nothing to add, so show the choice below and draw the line again
+    put_("\n");
+    for (size_t idx = 0; idx < std::min(candidates_.size(), maxListed_); idx++)
+    {
+        std::string_view name = candidates_[idx];
+        const size_t slash = name.substr(0, name.size() - 1).rfind('/');
+        if (slash != std::string_view::npos)
+            name = name.substr(slash + 1);
+
+        put_(name);
+        put_("  ");
+    }
+
+    if (candidates_.size() > maxListed_)
+    {
+        char buf[64];
+        const int len = snprintf(buf, sizeof(buf), "... %zu more",
+                                 candidates_.size() - maxListed_);
+        put_(std::string_view(buf, len));
+    }
+
+    put_("\n");
+    put_(prompt_);
+    redraw();
+}
+
+void LineEditor::erase_(bool isBackward) noexcept
+{
+    if ((isBackward && cursor_ == 0) || (!isBackward && cursor_ == line_.size()))
+    {
+        put_(bellEscapeSeq_);
+        return;
+    }
+
+    if (isBackward)
+    {
+        cursor_--;
+        putMove_(1, 'D');
+    }
+
+    line_.erase(cursor_, 1);
+    putTail_(1);
+}
+
+void LineEditor::killTo_(size_t pos) noexcept
+{
+    if (pos < cursor_)
+    {
+        const size_t cnt = cursor_ - pos;
+        putMove_(cnt, 'D');
+        line_.erase(pos, cnt);
+        cursor_ = pos;
+        putTail_(cnt);
+    }
+    else
+    {
+        line_.resize(cursor_);
+        put_(clearEscapeSeq_);
+    }
+}
+
+void LineEditor::moveTo_(size_t cursor) noexcept
+{
+    if (cursor < cursor_)
+        putMove_(cursor_ - cursor, 'D');
+    else
+        putMove_(cursor - cursor_, 'C');
+
+    cursor_ = cursor;
+}
+
+void LineEditor::escapeChar_(char ch) noexcept
+{
+    if (escape_ == EEscape::ESC)
+    {
+        // alt + key and the like are dropped
+        escape_ = (ch == '[' || ch == 'O') ? EEscape::CSI : EEscape::NONE;
+        escapeSeq_.resize(0);
+        return;
+    }
+
+    // parameters until the final byte
+    if (ch < 0x40 || ch > 0x7e)
+    {
+        if (escapeSeq_.size() < 8)
+            escapeSeq_.push_back(ch);
+        return;
+    }
+
+    escape_ = EEscape::NONE;
+
+    if (ch == 'D' && cursor_ > 0)
+        moveTo_(cursor_ - 1);
+    else if (ch == 'C' && cursor_ < line_.size())
+        moveTo_(cursor_ + 1);
+    else if (ch == 'H')
+        moveTo_(0);
+    else if (ch == 'F')
+        moveTo_(line_.size());
+    else if (ch == '~')
+    {
+        if (escapeSeq_ == "1" || escapeSeq_ == "7")
+            moveTo_(0);
+        else if (escapeSeq_ == "4" || escapeSeq_ == "8")
+            moveTo_(line_.size());
+        else if (escapeSeq_ == "3")
+            erase_(false);
+    }
+}
+
+// rewrites the line right of the cursor, the screen had `cleared` more chars
+void LineEditor::putTail_(size_t cleared) noexcept
+{
+    const size_t tail = line_.size() - cursor_;
+
+    put_(std::string_view(line_).substr(cursor_));
+    if (cleared)
+        put_(clearEscapeSeq_);
+    putMove_(tail, 'D');
+}
+
+void LineEditor::put_(std::string_view str) noexcept
+{
+    try
+    {
+        out_.append(str);
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+void LineEditor::putMove_(size_t cnt, char dir) noexcept
+{
+    if (cnt == 0)
+        return;
+
+    char buf[32];
+    const int len = snprintf(buf, sizeof(buf), "\33[%zu%c", cnt, dir);
+    put_(std::string_view(buf, len));
+}
+
+void LineEditor::startSearch_(void) noexcept
+{
+    if (!searcher_)
+    {
+        put_(bellEscapeSeq_);
+        return;
+    }
+
+    try
+    {
+        savedLine_ = line_;
+        query_.resize(0);
+        match_.resize(0);
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    moveTo_(0);
+    put_(clearEscapeSeq_);
+
+    isSearch_   = true;
+    shown_      = 0;
+    search_(false);
+}
+
+bool LineEditor::searchChar_(char ch) noexcept
+{
+    if (ASCII_BEGIN_ <= ch && ch <= ASCII_END_)
+    {
+        try
+        {
+            query_.push_back(ch);
+        }
+        catch (std::bad_alloc const& err)
+        {
+            process::PRINT_ERR(err.what());
+            exit(EXIT_FAILURE);
+        }
+
+        search_(false);
+        return true;
+    }
+
+    const auto key = (ESpecialAscii)ch;
+
+    if (key == ESpecialAscii::CTRL_R)
+        search_(true);
+    else if (key == ESpecialAscii::BACKSPACE || key == ESpecialAscii::BS)
+    {
+        if (query_.empty())
+            put_(bellEscapeSeq_);
+        else
+        {
+            query_.pop_back();
+            search_(false);
+        }
+    }
+    else if (key == ESpecialAscii::CTRL_G)
+        stopSearch_(false);
+    else
+    {
+        stopSearch_(true);
+        return false;
+    }
+
+    return true;
+}
+
+void LineEditor::search_(bool isOlder) noexcept
+{
+    try
+    {
+        if (query_.empty())
+        {
+            searcher_({}, false, match_);
+            match_.resize(0);
+            isFailed_ = false;
+        }
+        else
+            isFailed_ = !searcher_(query_, isOlder, match_);
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    showSearch_();
+}
+
+void LineEditor::showSearch_(void) noexcept
+{
+    const auto prompt = isFailed_ ? failedPrompt_ : searchPrompt_;
+
+    putMove_(shown_, 'D');
+    put_(clearEscapeSeq_);
+    put_(prompt);
+    put_(query_);
+    put_("': ");
+    put_(match_);
+
+    shown_ = prompt.size() + query_.size() + 3 + match_.size();
+}
+
+void LineEditor::stopSearch_(bool isAccept) noexcept
+{
+    putMove_(shown_, 'D');
+    put_(clearEscapeSeq_);
+
+    try
+    {
+        line_ = (isAccept && !match_.empty()) ? match_ : savedLine_;
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    isSearch_   = false;
+    shown_      = 0;
+    cursor_     = line_.size();
+    put_(line_);
+}
@@ -0,0 +1,598 @@
+#include "../inc/history.hpp"
+#include "../inc/process.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+using namespace history;
+
+namespace {
+
+bool pwriteAll(int fd, void const * buf, size_t size, off_t offset) noexcept
+{
+    auto ptr = (char const *)buf;
+
+    while (size)
+    {
+        const ssize_t written = pwrite(fd, ptr, size, offset);
+
+        if (written == -1 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+
+        ptr     += written;
+        offset  += written;
+        size    -= written;
+    }
+
+    return true;
+}
+
+bool lockFile(int fd, int oper) noexcept
+{
+    while (flock(fd, oper) == -1)
+        if (errno != EINTR)
+            return false;
+    return true;
+}
+
+constexpr uint64_t align8(uint64_t size) noexcept
+{
+    return (size + 7) & ~(uint64_t)7;
+}
+
+} // namespace
+
+History::~History(void) noexcept
+{
+    close();
+}
+
+std::string History::defaultPath(void) noexcept
+{
+    try
+    {
+        if (const char * path = getenv("NANOSHELL_HISTORY"))
+            return path;
+        if (const char * home = getenv("HOME"))
+            return std::string(home) + "/.nanoshell_history";
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    return {};
+}
+
+bool History::open(std::string const& path) noexcept
+{
+    close();
+
+    try
+    {
+        path_       = path;
+        indexPath_  = path + ".idx";
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    sigFd_ = ::open((path_ + ".sig").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd_ == -1 || sigFd_ == -1)
+    {
+        close();
+        return false;
+    }
+
+    if (!lockFile(fd_, LOCK_EX))
+    {
+        close();
+        return false;
+    }
+
+    // the first shell to open the file lays out the header
+    Header_ header = {};
+    bool isValid = pread(fd_, &header, sizeof(header), 0) == sizeof(header) &&
+                   memcmp(header.magic, dataMagic_, sizeof(dataMagic_)) == 0;
+
+    struct stat st;
+    if (!isValid && fstat(fd_, &st) == 0 && st.st_size == 0)
+    {
+        header = {};
+        memcpy(header.magic, dataMagic_, sizeof(dataMagic_));
+        header.end = sizeof(Header_);
+        isValid = ftruncate(fd_, growStep_) == 0 &&
+                  pwriteAll(fd_, &header, sizeof(header), 0);
+    }
+
+    lockFile(fd_, LOCK_UN);
+
+    if (!isValid || !remap_(fd_, data_))
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void History::close(void) noexcept
+{
+    unmap_(data_);
+    unmap_(index_);
+    unmap_(sig_);
+
+    for (int * fd : {&fd_, &sigFd_})
+    {
+        if (*fd != -1)
+            ::close(*fd);
+        *fd = -1;
+    }
+}
+
+bool History::isOpen(void) const noexcept
+{
+    return fd_ != -1;
+}
+
+bool History::append(Entry const& entry) noexcept
+{
+    if (!isOpen())
+        return false;
+
+    const uint32_t cmdLen   = std::min(entry.cmdLine.size(), maxCmdLen_);
+    const uint32_t recSize  = align8(sizeof(RecordHead_) + cmdLen) + sizeof(uint64_t);
+    std::vector<char> record;
+
+    try
+    {
+        record.resize(recSize, 0);
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    RecordHead_ head = {};
+    head.size       = recSize;
+    head.cmdLen     = cmdLen;
+    head.startNs    = entry.startNs;
+    head.durationNs = entry.durationNs;
+    head.status     = entry.status;
+    head.type       = entry.type;
+
+    memcpy(record.data(), &head, sizeof(head));
+    memcpy(record.data() + sizeof(head), entry.cmdLine.data(), cmdLen);
+    memcpy(record.data() + recSize - sizeof(uint64_t), &recSize, sizeof(recSize));
+
+    if (!lockFile(fd_, LOCK_EX))
+        return false;
+
+    bool isOk = false;
+    Header_ header;
+    struct stat st;
+
+    if (pread(fd_, &header, sizeof(header), 0) == sizeof(header) && fstat(fd_, &st) == 0)
+    {
+        // grow in big steps, so readers rarely have to remap
+        const uint64_t newEnd = header.end + recSize;
+        const bool isRoom = (uint64_t)st.st_size >= newEnd ||
+            ftruncate(fd_, (newEnd + growStep_ - 1) / growStep_ * growStep_) == 0;
+
+        if (isRoom && pwriteAll(fd_, record.data(), recSize, header.end))
+        {
+            // publish the record only after it's complete
+            header.end = newEnd;
+            header.count++;
+            isOk = pwriteAll(fd_, &header.end, 2 * sizeof(uint64_t),
+                             offsetof(Header_, end));
+
+            // a missing signature only makes ctrl + r read the record itself
+            const SigEntry_ sigEntry = {makeSig_(entry.cmdLine.substr(0, cmdLen)),
+                                        newEnd - recSize};
+            const uint64_t sigPos = (header.count - 1) * sizeof(SigEntry_);
+            struct stat sigSt;
+
+            if (isOk && fstat(sigFd_, &sigSt) == 0 &&
+                ((uint64_t)sigSt.st_size >= sigPos + sizeof(SigEntry_) ||
+                 ftruncate(sigFd_, (sigPos / growStep_ + 1) * growStep_) == 0))
+                pwriteAll(sigFd_, &sigEntry, sizeof(sigEntry), sigPos);
+        }
+
+        IndexHeader_ indexHeader = {};
+        const int indexFd = ::open(indexPath_.c_str(), O_RDONLY | O_CLOEXEC);
+        if (indexFd != -1)
+        {
+            if (pread(indexFd, &indexHeader, sizeof(indexHeader), 0) != sizeof(indexHeader))
+                indexHeader = {};
+            ::close(indexFd);
+        }
+
+        // the tail may grow with the index, that keeps merges amortized O(1)
+        const uint64_t maxTail = std::max<uint64_t>(maxTail_, indexHeader.count / tailRatio_);
+        if (isOk && header.count - indexHeader.count > maxTail)
+            mergeIndex_(header.end);
+    }
+
+    lockFile(fd_, LOCK_UN);
+    return isOk;
+}
+
+size_t History::size(void) noexcept
+{
+    if (!refresh_())
+        return 0;
+
+    auto header = (Header_ *)data_.addr;
+    return __atomic_load_n(&header->count, __ATOMIC_ACQUIRE);
+}
+
+bool History::searchBack(std::string_view query, uint64_t pos, Entry& entry) noexcept
+{
+    if (!refresh_())
+        return false;
+
+    const uint64_t end = getEnd_();
+    if (pos == 0 || pos > end)
+        pos = end;
+
+    struct stat st;
+    if (fstat(sigFd_, &st) == -1 ||
+        ((size_t)st.st_size != sig_.size && (st.st_size == 0 || !remap_(sigFd_, sig_))))
+        return scanBack_(query, pos, 0, entry);
+
+    // signatures are in offset order, all zero past the last written one
+    auto header = (Header_ const *)data_.addr;
+    auto sigs   = (SigEntry_ const *)sig_.addr;
+    size_t cnt  = std::min<uint64_t>(__atomic_load_n(&header->count, __ATOMIC_ACQUIRE),
+                                     sig_.size / sizeof(SigEntry_));
+    while (cnt && sigs[cnt - 1].offset == 0)
+        cnt--;
+
+    // records the signatures don't cover yet
+    uint64_t limit = 0;
+    if (cnt && readAt_(sigs[cnt - 1].offset, entry))
+        limit = entry.offset + entry.size;
+    if (pos > limit && scanBack_(query, pos, limit, entry))
+        return true;
+
+    auto it = std::lower_bound(sigs, sigs + cnt, pos, [](SigEntry_ const& item, uint64_t pos)
+    {
+        return item.offset < pos;
+    });
+
+    const uint64_t sig = makeSig_(query);
+    auto base = (char const *)data_.addr;
+
+    while (it-- != sigs)
+    {
+        if ((it->sig & sig) != sig || !readAt_(it->offset, entry))
+            continue;
+
+        if (memmem(base + it->offset + sizeof(RecordHead_), entry.cmdLine.size(),
+                   query.data(), query.size()))
+            return true;
+    }
+
+    return false;
+}
+
+bool History::prev(uint64_t pos, Entry& entry) noexcept
+{
+    if (!refresh_())
+        return false;
+
+    const uint64_t end = getEnd_();
+    if (pos == 0 || pos > end)
+        pos = end;
+
+    if (pos < sizeof(Header_) + sizeof(RecordHead_) + sizeof(uint64_t))
+        return false;
+
+    uint32_t recSize;
+    memcpy(&recSize, (char *)data_.addr + pos - sizeof(uint64_t), sizeof(recSize));
+
+    if (recSize > pos - sizeof(Header_))
+        return false;
+
+    return readAt_(pos - recSize, entry) && entry.size == recSize;
+}
+
+void History::findPrefix(std::string_view prefix, size_t limit,
+                         std::vector<Entry>& entries) noexcept
+{
+    entries.clear();
+    if (!refresh_())
+        return;
+
+    const uint64_t end = getEnd_();
+    uint64_t tailBegin = sizeof(Header_);
+
+    try
+    {
+        Entry entry;
+
+        if (refreshIndex_())
+        {
+            auto indexHeader = (IndexHeader_ const *)index_.addr;
+            auto begin  = (IndexEntry_ const *)(indexHeader + 1);
+            auto last   = begin + indexHeader->count;
+            tailBegin   = std::min(indexHeader->dataEnd, end);
+
+            // compares 8 bytes at once, the command itself only on a tie
+            const uint64_t key = makeKey_(prefix);
+            auto isLess = [this, key, &entry](IndexEntry_ const& item, std::string_view prefix)
+            {
+                if (item.key != key)
+                    return item.key < key;
+                return readAt_(item.offset, entry) && entry.cmdLine < prefix;
+            };
+
+            // equal commands are adjacent, the last one is the newest
+            for (auto it = std::lower_bound(begin, last, prefix, isLess);
+                 it != last && entries.size() < limit; it++)
+            {
+                if (!readAt_(it->offset, entry) ||
+                    entry.cmdLine.substr(0, prefix.size()) != prefix)
+                    break;
+
+                if (!entries.empty() && entries.back().cmdLine == entry.cmdLine)
+                    entries.back() = entry;
+                else
+                    entries.push_back(entry);
+            }
+        }
+
+        for (uint64_t pos = tailBegin; pos < end && readAt_(pos, entry); pos += entry.size)
+            if (entry.cmdLine.substr(0, prefix.size()) == prefix)
+                entries.push_back(entry);
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    // the tail is unsorted and may repeat indexed commands
+    std::stable_sort(entries.begin(), entries.end(), [](Entry const& lhs, Entry const& rhs)
+    {
+        return lhs.cmdLine < rhs.cmdLine;
+    });
+
+    size_t cnt = 0;
+    for (size_t idx = 0; idx < entries.size(); idx++)
+    {
+        if (cnt && entries[cnt - 1].cmdLine == entries[idx].cmdLine)
+            entries[cnt - 1] = entries[idx];
+        else
+            entries[cnt++] = entries[idx];
+    }
+
+    entries.resize(std::min(cnt, limit));
+}
+
+// walks records back from pos, stops at limit
+bool History::scanBack_(std::string_view query, uint64_t pos,
+                        uint64_t limit, Entry& entry) noexcept
+{
+    while (pos > limit && prev(pos, entry))
+    {
+        if (entry.cmdLine.find(query) != std::string_view::npos)
+            return true;
+        pos = entry.offset;
+    }
+
+    return false;
+}
+
+bool History::refresh_(void) noexcept
+{
+    if (!isOpen())
+        return false;
+
+    // the header is always mapped, the file only grows
+    auto header = (Header_ const *)data_.addr;
+    if (__atomic_load_n(&header->end, __ATOMIC_ACQUIRE) > data_.size)
+        return remap_(fd_, data_);
+
+    return true;
+}
+
+bool History::refreshIndex_(void) noexcept
+{
+    struct stat st;
+    if (stat(indexPath_.c_str(), &st) == -1)
+    {
+        unmap_(index_);
+        return false;
+    }
+
+    // a merge replaces the file, so a new inode means a new index
+    if (index_.addr == nullptr || index_.ino != st.st_ino || index_.size != (size_t)st.st_size)
+    {
+        const int fd = ::open(indexPath_.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            return false;
+
+        unmap_(index_);
+        const bool isMapped = remap_(fd, index_);
+        ::close(fd);
+
+        if (!isMapped)
+            return false;
+    }
+
+    auto indexHeader = (IndexHeader_ const *)index_.addr;
+    const bool isValid =
+        index_.size >= sizeof(IndexHeader_) &&
+        memcmp(indexHeader->magic, indexMagic_, sizeof(indexMagic_)) == 0 &&
+        indexHeader->count <= (index_.size - sizeof(IndexHeader_)) / sizeof(IndexEntry_);
+
+    if (!isValid)
+        unmap_(index_);
+    return isValid;
+}
+
+bool History::readAt_(uint64_t offset, Entry& entry) const noexcept
+{
+    const uint64_t end = getEnd_();
+    if (offset < sizeof(Header_) || offset + sizeof(RecordHead_) > end || offset % 8)
+        return false;
+
+    auto head = (RecordHead_ const *)((char const *)data_.addr + offset);
+    if (head->size > end - offset ||
+        sizeof(RecordHead_) + head->cmdLen + sizeof(uint64_t) > head->size)
+        return false;
+
+    entry.cmdLine   = std::string_view((char const *)(head + 1), head->cmdLen);
+    entry.startNs   = head->startNs;
+    entry.durationNs= head->durationNs;
+    entry.status    = head->status;
+    entry.type      = head->type;
+    entry.offset    = offset;
+    entry.size      = head->size;
+    return true;
+}
+
+// called with the data file locked
+bool History::mergeIndex_(uint64_t dataEnd) noexcept
+{
+    if (!refresh_())
+        return false;
+
+    std::vector<IndexEntry_> tail, merged;
+    uint64_t pos = sizeof(Header_);
+    Entry entry, other;
+
+    auto isLess = [this, &entry, &other](IndexEntry_ const& lhs, IndexEntry_ const& rhs)
+    {
+        if (lhs.key != rhs.key)
+            return lhs.key < rhs.key;
+        readAt_(lhs.offset, entry);
+        readAt_(rhs.offset, other);
+        if (entry.cmdLine != other.cmdLine)
+            return entry.cmdLine < other.cmdLine;
+        return lhs.offset < rhs.offset;
+    };
+
+    try
+    {
+        IndexEntry_ const * begin = nullptr;
+        size_t count = 0;
+
+        if (refreshIndex_())
+        {
+            auto indexHeader = (IndexHeader_ const *)index_.addr;
+            begin   = (IndexEntry_ const *)(indexHeader + 1);
+            count   = indexHeader->count;
+            pos     = indexHeader->dataEnd;
+        }
+
+        for (; pos < dataEnd && readAt_(pos, entry); pos += entry.size)
+            tail.push_back({makeKey_(entry.cmdLine), pos});
+
+        std::sort(tail.begin(), tail.end(), isLess);
+        merged.resize(count + tail.size());
+        std::merge(begin, begin + count, tail.begin(), tail.end(), merged.begin(), isLess);
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    IndexHeader_ indexHeader = {};
+    memcpy(indexHeader.magic, indexMagic_, sizeof(indexMagic_));
+    indexHeader.count   = merged.size();
+    indexHeader.dataEnd = pos;
+
+    // readers keep the old file mapped until they notice the new inode
+    const std::string tmpPath = indexPath_ + ".tmp";
+    const int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1)
+        return false;
+
+    const bool isOk =
+        pwriteAll(fd, &indexHeader, sizeof(indexHeader), 0) &&
+        pwriteAll(fd, merged.data(), merged.size() * sizeof(IndexEntry_), sizeof(indexHeader));
+    ::close(fd);
+
+    if (!isOk || rename(tmpPath.c_str(), indexPath_.c_str()) == -1)
+    {
+        unlink(tmpPath.c_str());
+        return false;
+    }
+
+    return refreshIndex_();
+}
+
+uint64_t History::getEnd_(void) const noexcept
+{
+    auto header = (Header_ const *)data_.addr;
+    return std::min<uint64_t>(__atomic_load_n(&header->end, __ATOMIC_ACQUIRE), data_.size);
+}
+
+uint64_t History::makeKey_(std::string_view cmdLine) noexcept
+{
+    uint64_t key = 0;
+    for (size_t idx = 0; idx < sizeof(key); idx++)
+    {
+        key <<= 8;
+        if (idx < cmdLine.size())
+            key |= (uint8_t)cmdLine[idx];
+    }
+
+    return key;
+}
+
+uint64_t History::makeSig_(std::string_view cmdLine) noexcept
+{
+    uint64_t sig = 0;
+    for (size_t idx = 1; idx < cmdLine.size(); idx++)
+    {
+        const uint32_t pair = (uint8_t)cmdLine[idx - 1] << 8 | (uint8_t)cmdLine[idx];
+        sig |= (uint64_t)1 << ((pair * 0x9e3779b1u) >> 26);
+    }
+
+    return sig;
+}
+
+bool History::remap_(int fd, Map_& map) noexcept
+{
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(Header_))
+        return false;
+
+    void * addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+        return false;
+
+    unmap_(map);
+    map.addr    = addr;
+    map.size    = st.st_size;
+    map.ino     = st.st_ino;
+    return true;
+}
+
+void History::unmap_(Map_& map) noexcept
+{
+    if (map.addr)
+        munmap(map.addr, map.size);
+    map = Map_{};
+}
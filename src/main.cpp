@@ -1,9 +1,59 @@
 #include <iostream>
 #include <sstream>
+#include <cstring>
+#include <unistd.h>
 #include "../inc/shell.hpp"
+#include "../inc/batch.hpp"
+#include "../inc/parallel.hpp"
 
-int main(void)
+namespace {
+
+const char * usageMessage =
+    "usage: nanoshell [-s] [-c <cmdLine> | <script>]\n"
+    "  -s  report the status of every command line on stderr\n"
+    "without arguments reads commands from stdin, interactive on a terminal\n";
+
+} // namespace
+
+int main(int argc, char ** argv)
 {
+    // fans out children of its own, never a shell thread
+    process::Process::addBuiltin(parallel::builtinName, parallel::run, false);
+
+    bool isReport = false;
+    const char * cmdLine = nullptr;
+    const char * script = nullptr;
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if (strcmp(argv[arg], "-s") == 0)
+            isReport = true;
+        else if (strcmp(argv[arg], "-c") == 0 && arg + 1 < argc && !script)
+            cmdLine = argv[++arg];
+        else if (argv[arg][0] != '-' && !cmdLine && !script)
+            script = argv[arg];
+        else
+        {
+            std::cerr << usageMessage;
+            return 2;
+        }
+    }
+
+    // no prompt, no termios, no job control
+    if (cmdLine || script || !isatty(0))
+    {
+        batch::Batch batch(isReport);
+
+        if (cmdLine)
+            batch.runString(cmdLine);
+        else if (script)
+            batch.runFile(script);
+        else
+            batch.runFd(0);
+
+        return batch.getStatus();
+    }
+
     shell::Shell myshell;
 
     while(1)
@@ -17,10 +67,57 @@ int main(void)
             continue;
         if (cmdLine == shell::Shell::exitCmd)
             break;
-        if (cmdLine == shell::Shell::jobsCmd)
+        if (myshell.isJobsCmd())
         {
             myshell.jobs();
-            delete &cmdLine;
+            continue;
+        }
+
+        if (myshell.isHistoryCmd())
+        {
+            myshell.history();
+            continue;
+        }
+
+        if (myshell.isHashCmd())
+        {
+            myshell.hash();
+            continue;
+        }
+
+        if (myshell.isStatsCmd())
+        {
+            myshell.stats();
+            continue;
+        }
+
+        if (myshell.isReloadCmd())
+        {
+            myshell.reload();
+            continue;
+        }
+
+        if (myshell.isLimitsCmd())
+        {
+            myshell.limits();
+            continue;
+        }
+
+        if (myshell.isQueueCmd())
+        {
+            myshell.queue();
+            continue;
+        }
+
+        if (myshell.isPlacementCmd())
+        {
+            myshell.placement();
+            continue;
+        }
+
+        if (myshell.isCaptureCmd())
+        {
+            myshell.capture();
             continue;
         }
 
@@ -37,14 +134,9 @@ int main(void)
         }
         else
         {
-            auto typeCmdLine = analyze::analyzeCmdLine(cmdLine);
-            auto taskWrapper = analyze::createTask(cmdLine, typeCmdLine);
-
-            if (!taskWrapper)
-                continue;
-
-            auto [task, isForeground] = *taskWrapper;
-            myshell.addTaskItem({task, isForeground, cmdLine, typeCmdLine});
+            parser::CmdTree cmdTree;
+            auto typeCmdLine = analyze::analyzeCmdLine(cmdLine, cmdTree);
+            myshell.runTask(cmdTree, typeCmdLine);
         }
     }
 
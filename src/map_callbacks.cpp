@@ -1,41 +1,300 @@
 #include "../inc/process.hpp"
+#include "../inc/plugin.hpp"
 
 #include <iostream>
-#include <assert.h>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <cstring>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <poll.h>
 
 using namespace process;
 
-extern "C"
+namespace {
+
+int noop(Process::argv_t const& argv, stream::Io& io)
 {
+    (void) argv;
+    (void) io;
+    return 0;
+}
 
-int notFound(Process::argv_t const& argv) noexcept
+// both run inside the shell itself, so no asserts on user input
+int cd(Process::argv_t const& argv, stream::Io& io) noexcept
 {
-    assert(argv.size());
-    std::cout << argv[0] << ": command not found" << std::endl;
-    return 1;
+    if (argv.size() != 2)
+    {
+        io.err.print("usage: cd <dir>\n");
+        return 2;
+    }
+
+    if (chdir(argv[1].c_str()) == -1)
+    {
+        io.err.print("cd: " + argv[1] + ": " + strerror(errno) + "\n");
+        return 1;
+    }
+
+    return 0;
 }
 
-int noop(Process::argv_t const& argv)
+int pwd(Process::argv_t const& argv, stream::Io& io) noexcept
 {
     (void) argv;
+    char buffer[BUFSIZ] = {0};
+
+    if (getcwd(buffer, BUFSIZ) == nullptr)
+    {
+        io.err.print(std::string("pwd: ") + strerror(errno) + "\n");
+        return 1;
+    }
+
+    io.out.print(std::string(buffer) + "\n");
     return 0;
 }
 
-int cd(Process::argv_t const& argv) noexcept
+const size_t moveChunk     = 1 << 30;        // = 1 GiB, per syscall, the kernel caps it anyway
+const size_t bufferSize    = 1024 * 1024;    // = 1 MiB, when nothing zero-copy fits
+const size_t bufferAlign   = 4096;
+
+struct Copied
 {
-    assert(argv.size() == 2);
-    return chdir(argv[1].c_str());
+    int64_t         bytes   = 0;
+    const char *    method  = "none";
+};
+
+// 1: all moved, 0: the fds don't support move, nothing moved, -1: errno
+template<typename Move, typename Wait>
+int moveAll(Copied& copied, const char * method, Move&& move, Wait&& wait) noexcept
+{
+    bool isMoved = false;
+
+    while (true)
+    {
+        const ssize_t moved = move();
+
+        if (moved > 0)
+        {
+            copied.bytes += moved;
+            copied.method = method;
+            isMoved = true;
+        }
+        else if (moved == 0)
+            return 1;
+        else if (errno == EINTR)
+            continue;
+        else if (errno == EAGAIN)
+            wait();     // a nonblocking end that is empty or full
+        else if (!isMoved && (errno == EINVAL || errno == ENOSYS ||
+                              errno == EXDEV || errno == EOPNOTSUPP || errno == EBADF))
+            return 0;
+        else
+            return -1;
+    }
 }
 
-int pwd(Process::argv_t const& argv) noexcept
+// Everything from inFd (from in when it's -1) to out. File to file goes
+// through copy_file_range, file to anything through sendfile and a pipe
+// on either end through splice; only the rest is copied by hand.
+bool copyAll(int inFd, stream::Stream& in, stream::Stream& out, Copied& copied) noexcept
 {
-    assert(argv.size() == 1);
-    char buffer[BUFSIZ] = {0};
-    assert(getcwd(buffer, BUFSIZ));
-    std::cout << buffer << std::endl;
-    return 0;
+    const int outFd = out.getFd();
+    struct stat inSt, outSt;
+
+    if (inFd != -1 && outFd != -1 && fstat(inFd, &inSt) == 0 && fstat(outFd, &outSt) == 0)
+    {
+        const bool isInFile = S_ISREG(inSt.st_mode);
+        const bool isOutFile = S_ISREG(outSt.st_mode);
+        const bool isPipe = S_ISFIFO(inSt.st_mode) || S_ISFIFO(outSt.st_mode);
+        int ret = 0;
+
+        // EAGAIN doesn't tell which end, so until both are ready: the
+        // nonblocking ones only, the others don't return it
+        auto wait = [inFd, outFd](void)
+        {
+            for (auto [fd, events] : {std::pair{outFd, POLLOUT}, std::pair{inFd, POLLIN}})
+            {
+                struct pollfd pfd = {fd, (short)events, 0};
+                if (fcntl(fd, F_GETFL) & O_NONBLOCK)
+                    while (poll(&pfd, 1, -1) == -1 && errno == EINTR);
+            }
+        };
+
+        if (ret == 0 && isInFile && isOutFile)
+            ret = moveAll(copied, "copy_file_range", [inFd, outFd](void)
+            {
+                return copy_file_range(inFd, nullptr, outFd, nullptr, moveChunk, 0);
+            }, wait);
+
+        if (ret == 0 && isInFile)
+            ret = moveAll(copied, "sendfile", [inFd, outFd](void)
+            {
+                return sendfile(outFd, inFd, nullptr, moveChunk);
+            }, wait);
+
+        if (ret == 0 && isPipe)
+            ret = moveAll(copied, "splice", [inFd, outFd](void)
+            {
+                return splice(inFd, nullptr, outFd, nullptr, moveChunk, SPLICE_F_MOVE | SPLICE_F_MORE);
+            }, wait);
+
+        if (ret != 0)
+            return ret == 1;
+    }
+
+    char * buffer = (char *)aligned_alloc(bufferAlign, bufferSize);
+    if (buffer == nullptr)
+        return false;
+
+    bool isSuccess = true;
+
+    while (true)
+    {
+        const ssize_t readed = inFd != -1 ? read(inFd, buffer, bufferSize)
+                                          : in.read(buffer, bufferSize);
+
+        if (readed == -1 && errno == EINTR)
+            continue;
+        if (readed <= 0)
+        {
+            isSuccess = readed == 0;
+            break;
+        }
+
+        if (!out.writeAll(buffer, readed))
+        {
+            isSuccess = false;
+            break;
+        }
+
+        copied.bytes += readed;
+        copied.method = "read/write";
+    }
+
+    free(buffer);
+    return isSuccess;
+}
+
+// the files of argv, or stdin when there are none; "-" is stdin too
+int copyFiles(const char * name, Process::argv_t const& argv, stream::Io& io,
+              Copied& copied) noexcept
+{
+    int status = 0;
+    const bool isStdin = argv.size() == 1;
+
+    for (size_t arg = 1; arg < argv.size() || (isStdin && arg == 1); arg++)
+    {
+        const bool isDash = isStdin || argv[arg] == "-";
+        const int fd = isDash ? io.in.getFd() : open(argv[arg].c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (!isDash && fd == -1)
+        {
+            io.err.print(std::string(name) + ": " + argv[arg] + ": " + strerror(errno) + "\n");
+            status = 1;
+            continue;
+        }
+
+        if (!copyAll(fd, io.in, io.out, copied))
+        {
+            io.err.print(std::string(name) + ": " + (isDash ? "-" : argv[arg]) + ": " +
+                         strerror(errno) + "\n");
+            status = 1;
+        }
+
+        if (!isDash)
+            close(fd);
+    }
+
+    return status;
 }
 
+// Runs in a child of its own (no IN_PROCESS): it may take long and has to
+// be killable, and for options it becomes the real cat.
+int cat(Process::argv_t const& argv, stream::Io& io) noexcept
+{
+    for (auto const& arg : argv)
+    {
+        if (arg.size() < 2 || arg[0] != '-')
+            continue;
+
+        std::vector<char *> execArgv;
+        for (auto const& word : argv)
+            execArgv.push_back(const_cast<char *>(word.c_str()));
+        execArgv.push_back(nullptr);
+
+        // skips this builtin: "cat" is only looked up on PATH
+        execvp(execArgv[0], execArgv.data());
+        io.err.print(std::string("cat: ") + strerror(errno) + "\n");
+        return 127;
+    }
+
+    Copied copied;
+    return copyFiles("cat", argv, io, copied);
 }
+
+// cat that reports bytes, time and throughput on stderr
+int pv(Process::argv_t const& argv, stream::Io& io) noexcept
+{
+    for (auto const& arg : argv)
+    {
+        if (arg.size() >= 2 && arg[0] == '-')
+        {
+            io.err.print("usage: pv [file]...\n");
+            return 2;
+        }
+    }
+
+    const auto begin = std::chrono::steady_clock::now();
+    Copied copied;
+    const int status = copyFiles("pv", argv, io, copied);
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - begin).count();
+
+    std::ostringstream report;
+    report  << "pv: " << copied.bytes << " bytes in " << std::fixed << std::setprecision(3)
+            << seconds << " s, " << std::setprecision(1)
+            << (seconds > 0 ? copied.bytes / seconds / (1024 * 1024) : 0.0)
+            << " MiB/s (" << copied.method << ")\n";
+
+    // inside a pipe stderr is the pipe too, the report would end up in the
+    // data: it goes to the terminal then, or nowhere without one
+    struct stat errSt, outSt;
+    const bool isErrOut = &io.err == &io.out ||
+        (io.err.getFd() != -1 && io.out.getFd() != -1 &&
+         fstat(io.err.getFd(), &errSt) == 0 && fstat(io.out.getFd(), &outSt) == 0 &&
+         errSt.st_dev == outSt.st_dev && errSt.st_ino == outSt.st_ino);
+
+    if (!isErrOut)
+        io.err.print(report.str());
+    else if (const int ttyFd = open("/dev/tty", O_WRONLY | O_NOCTTY | O_CLOEXEC); ttyFd != -1)
+    {
+        const std::string line = report.str();
+        (void)!write(ttyFd, line.data(), line.size());
+        close(ttyFd);
+    }
+
+    return status;
+}
+
+const plugin::Builtin builtins[] =
+{
+    {"noop",    noop,   plugin::EFlags::IN_PROCESS},
+    {"cd",      cd,     plugin::EFlags::IN_PROCESS},
+    {"pwd",     pwd,    plugin::EFlags::IN_PROCESS},
+    {"cat",     cat,    plugin::EFlags::NONE},
+    {"pv",      pv,     plugin::EFlags::NONE}
+};
+
+} // namespace
+
+extern "C" plugin::Descriptor const nanoshell_plugin =
+{
+    plugin::abiVersion,
+    sizeof(builtins) / sizeof(builtins[0]),
+    builtins
+};
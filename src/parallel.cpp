@@ -0,0 +1,388 @@
+#include "../inc/parallel.hpp"
+#include "../inc/stats.hpp"
+
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <algorithm>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+using namespace parallel;
+
+namespace {
+
+const char * usageMessage =
+    "usage: parallel [-j N] [-a file] <cmd> [arg]... [::: item...]\n";
+
+const std::string_view itemMark = "{}";
+const size_t chunkSize = 64 * 1024; // = 64 KiB
+
+// non-empty lines of the stream up to EOF
+bool readItems(stream::Stream& in, std::vector<std::string>& items)
+{
+    char chunk[chunkSize];
+    std::string line;
+
+    while (true)
+    {
+        const ssize_t readed = in.read(chunk, sizeof(chunk));
+
+        if (readed == -1 && errno == EINTR)
+            continue;
+        if (readed == -1)
+            return false;
+        if (readed == 0)
+            break;
+
+        for (ssize_t pos = 0; pos < readed; pos++)
+        {
+            if (chunk[pos] != '\n')
+                line += chunk[pos];
+            else if (!line.empty())
+            {
+                items.push_back(std::move(line));
+                line.clear();
+            }
+        }
+    }
+
+    if (!line.empty())
+        items.push_back(std::move(line));
+
+    return true;
+}
+
+} // namespace
+
+int parallel::run(::process::Process::argv_t const& argv, stream::Io& io) noexcept
+{
+    using Process = ::process::Process;
+
+    try
+    {
+        size_t jobs = 0;
+        std::string file;
+        size_t arg = 1;
+
+        for (; arg < argv.size() && argv[arg][0] == '-'; arg++)
+        {
+            if (argv[arg] == "-j")
+            {
+                // 1 to 99999, stoul can't throw then
+                const std::string value = arg + 1 < argv.size() ? argv[++arg] : "";
+                if (value.empty() || value.size() >= 6 ||
+                    value.find_first_not_of("0123456789") != std::string::npos ||
+                    (jobs = std::stoul(value)) == 0)
+                {
+                    io.err.print(usageMessage);
+                    return 2;
+                }
+            }
+            else if (argv[arg] == "-a" && arg + 1 < argv.size())
+                file = argv[++arg];
+            else
+                break;
+        }
+
+        Process::argv_t cmd;
+        for (; arg < argv.size() && argv[arg] != ":::"; arg++)
+            cmd.push_back(argv[arg]);
+
+        const bool isArgItems = arg < argv.size();
+        std::vector<std::string> items(argv.begin() + std::min(arg + 1, argv.size()), argv.end());
+
+        if (cmd.empty() || cmd.size() >= Process::maxArgc || (isArgItems && !file.empty()))
+        {
+            io.err.print(usageMessage);
+            return 2;
+        }
+
+        if (!file.empty())
+        {
+            const int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1)
+            {
+                io.err.print("parallel: " + file + ": " + strerror(errno) + "\n");
+                return 2;
+            }
+
+            stream::FdStream in(fd, true);
+            readItems(in, items);
+        }
+        else if (!isArgItems)
+            readItems(io.in, items);
+
+        if (jobs == 0)
+            jobs = std::max<long>(sysconf(_SC_NPROCESSORS_ONLN), 1);
+
+        Runner runner(cmd, items, jobs, io);
+        return runner.run();
+    }
+    catch (std::exception const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+Runner::Runner(argv_t const& cmd, std::vector<std::string> const& items,
+               size_t jobs, stream::Io& io) noexcept
+    : cmd_(cmd), items_(items), io_(io)
+{
+    nullFd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    assert(nullFd_ != -1);
+
+    try
+    {
+        slots_.resize(std::max<size_t>(std::min(jobs, items_.size()), 1));
+        results_.resize(items_.size());
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    // contiguous blocks: neighbour items stay on one slot unless stolen
+    for (size_t idx = 0; idx < slots_.size(); idx++)
+    {
+        Slot_& slot = slots_[idx];
+        const size_t begin  = idx * items_.size() / slots_.size();
+        const size_t end    = (idx + 1) * items_.size() / slots_.size();
+
+        for (size_t item = begin; item < end; item++)
+            slot.items.push_back(item);
+
+        slot.outFd = memfd_create("parallel.out", MFD_CLOEXEC);
+        slot.errFd = memfd_create("parallel.err", MFD_CLOEXEC);
+        assert(slot.outFd != -1 && slot.errFd != -1);
+    }
+}
+
+Runner::~Runner(void) noexcept
+{
+    for (auto& slot : slots_)
+    {
+        slot.process.reset();
+        close(slot.outFd);
+        close(slot.errFd);
+    }
+
+    close(nullFd_);
+}
+
+int Runner::run(void) noexcept
+{
+    const int64_t beginNs = ::stats::Stats::nowNs();
+    size_t running = 0;
+
+    for (size_t slot = 0; slot < slots_.size(); slot++)
+    {
+        if (!takeItem_(slot))
+            continue;
+        launch_(slot);
+        running++;
+    }
+
+    while (running)
+    {
+        Process::events_t events;
+        Process::reap(false, events);
+
+        for (size_t slot = 0; slot < slots_.size(); slot++)
+        {
+            auto& process = slots_[slot].process;
+            if (!process || !process->isDone())
+                continue;
+
+            finish_(slot);
+            running--;
+
+            if (!takeItem_(slot))
+                continue;
+            launch_(slot);
+            running++;
+        }
+    }
+
+    printSummary_(::stats::Stats::nowNs() - beginNs);
+
+    const auto failed = std::count_if(results_.begin(), results_.end(),
+        [](Result_ const& result) { return result.status != Process::successStatus; });
+
+    return std::min<int>(failed, maxStatus_);
+}
+
+
+/// Below private interface implementation
+
+bool Runner::takeItem_(size_t slot) noexcept
+{
+    auto& items = slots_[slot].items;
+
+    if (items.empty())
+    {
+        auto victim = std::max_element(slots_.begin(), slots_.end(),
+            [](Slot_ const& lhs, Slot_ const& rhs) { return lhs.items.size() < rhs.items.size(); });
+
+        if (victim->items.empty())
+            return false;
+
+        // the back half, the victim keeps working on its front
+        const size_t cnt = (victim->items.size() + 1) / 2;
+        try
+        {
+            items.insert(items.end(), victim->items.end() - cnt, victim->items.end());
+        }
+        catch (std::bad_alloc const& err)
+        {
+            process::PRINT_ERR(err.what());
+            exit(EXIT_FAILURE);
+        }
+
+        victim->items.erase(victim->items.end() - cnt, victim->items.end());
+        stolen_ += cnt;
+    }
+
+    slots_[slot].item = items.front();
+    items.pop_front();
+    return true;
+}
+
+void Runner::launch_(size_t slot) noexcept
+{
+    Slot_& current = slots_[slot];
+    const Process::stdfds_t stdFds = {nullFd_, current.outFd, current.errFd};
+
+    current.startNs = ::stats::Stats::nowNs();
+
+    try
+    {
+        current.process.reset(new Process(makeArgv_(items_[current.item]), stdFds));
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+void Runner::finish_(size_t slot) noexcept
+{
+    Slot_& current = slots_[slot];
+    Result_& result = results_[current.item];
+
+    result.durationNs = ::stats::Stats::nowNs() - current.startNs;
+    result.status = current.process->join();
+    if (current.process->isTermBySig())
+        result.status += 128;
+
+    current.process.reset();
+
+    flushFd_(current.outFd, io_.out);
+    flushFd_(current.errFd, io_.err);
+}
+
+void Runner::flushFd_(int fd, stream::Stream& stream) noexcept
+{
+    char chunk[chunkSize];
+    off_t offset = 0;
+    ssize_t readed;
+
+    while ((readed = pread(fd, chunk, sizeof(chunk), offset)) > 0)
+    {
+        stream.writeAll(chunk, readed);
+        offset += readed;
+    }
+
+    // the offset is shared with the commands through dup2
+    assert(ftruncate(fd, 0) == 0);
+    assert(lseek(fd, 0, SEEK_SET) == 0);
+}
+
+void Runner::printSummary_(int64_t wallNs) noexcept
+{
+    auto seconds = [](int64_t ns)
+    {
+        std::ostringstream sstream;
+        sstream << std::fixed << std::setprecision(3) << ns / 1e9 << "s";
+        return sstream.str();
+    };
+
+    try
+    {
+        std::ostringstream summary;
+        size_t failed = 0;
+        int64_t minNs = INT64_MAX, maxNs = 0, totalNs = 0;
+
+        for (size_t item = 0; item < results_.size(); item++)
+        {
+            Result_ const& result = results_[item];
+            minNs   = std::min(minNs, result.durationNs);
+            maxNs   = std::max(maxNs, result.durationNs);
+            totalNs += result.durationNs;
+
+            if (result.status == Process::successStatus)
+                continue;
+
+            failed++;
+            summary << "parallel: status " << result.status << " after "
+                    << seconds(result.durationNs) << ":";
+            for (auto const& word : makeArgv_(items_[item]))
+                summary << " " << word;
+            summary << "\n";
+        }
+
+        summary << "parallel: " << results_.size() << " jobs on " << slots_.size()
+                << " slots, " << failed << " failed, " << stolen_ << " stolen, wall "
+                << seconds(wallNs);
+
+        if (!results_.empty())
+            summary << ", job min " << seconds(minNs) << " mean "
+                    << seconds(totalNs / (int64_t)results_.size())
+                    << " max " << seconds(maxNs);
+
+        summary << "\n";
+        io_.err.print(summary.str());
+    }
+    catch (std::exception const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+Runner::argv_t Runner::makeArgv_(std::string const& item) const noexcept
+{
+    argv_t argv;
+    bool isMarked = false;
+
+    try
+    {
+        for (auto word : cmd_)
+        {
+            for (size_t pos = 0; (pos = word.find(itemMark, pos)) != std::string::npos;)
+            {
+                word.replace(pos, itemMark.size(), item);
+                pos += item.size();
+                isMarked = true;
+            }
+
+            argv.push_back(std::move(word));
+        }
+
+        if (!isMarked)
+            argv.push_back(item);
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    return argv;
+}
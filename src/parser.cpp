@@ -0,0 +1,446 @@
+#include "../inc/parser.hpp"
+#include "../inc/place.hpp"
+#include <cstdint>
+
+using namespace parser;
+
+namespace {
+
+class Parser
+{
+public:
+    Parser(std::string_view line, CmdTree& tree) noexcept;
+    bool parseList(void);
+
+private:
+    bool parsePipeline_ (Pipeline& pipeline);
+    bool parseCommand_  (Command& command);
+    bool parseRedirect_ (Command& command);
+    bool parsePriority_ (std::string_view value) noexcept;
+    bool fail_          (std::string const& message);
+    bool failNear_      (void);
+    void advance_       (void) noexcept;
+
+    static std::string unquote_(Token const& token);
+
+private:
+    Lexer       lexer_;
+    CmdTree&    tree_;
+    Token       token_;
+};
+
+Parser::Parser(std::string_view line, CmdTree& tree) noexcept
+    : lexer_(line), tree_(tree), token_{EToken::END, {}}
+{
+    advance_();
+}
+
+bool Parser::parseList(void)
+{
+    if (token_.type == EToken::END)
+        return fail_("empty command line");
+
+    if (token_.type == EToken::WORD && !token_.isQuoted && token_.text == "time")
+    {
+        tree_.isTimed = true;
+        advance_();
+
+        if (token_.type == EToken::END)
+            return fail_("time without a command");
+    }
+
+    if (token_.type == EToken::WORD && !token_.isQuoted && token_.text == "priority")
+    {
+        advance_();
+
+        if (token_.type != EToken::WORD || !parsePriority_(unquote_(token_)))
+            return fail_("priority: wrong value");
+        advance_();
+
+        if (token_.type == EToken::END)
+            return fail_("priority without a command");
+    }
+
+    if (token_.type == EToken::WORD && !token_.isQuoted && token_.text == "limit")
+    {
+        advance_();
+
+        while (token_.type == EToken::WORD && token_.text.size() > 1 && token_.text[0] == '-')
+        {
+            const std::string option(token_.text);
+            advance_();
+
+            if (token_.type != EToken::WORD ||
+                !parseLimit(option, unquote_(token_), tree_.limits))
+                return fail_("limit: wrong " + option + " value");
+            advance_();
+        }
+
+        if (token_.type == EToken::END)
+            return fail_("limit without a command");
+    }
+
+    tree_.pipelines.emplace_back();
+    if (!parsePipeline_(tree_.pipelines.back()))
+        return false;
+
+    while (token_.type == EToken::AND || token_.type == EToken::OR ||
+           token_.type == EToken::SEMI)
+    {
+        const EToken oper = token_.type;
+        advance_();
+
+        // a ';' may end the line
+        if (oper == EToken::SEMI && token_.type == EToken::END)
+            break;
+
+        tree_.opers.push_back(oper == EToken::AND ? EOper::AND :
+                              oper == EToken::OR  ? EOper::OR  : EOper::SEQ);
+
+        tree_.pipelines.emplace_back();
+        if (!parsePipeline_(tree_.pipelines.back()))
+            return false;
+    }
+
+    if (token_.type == EToken::AMP)
+    {
+        tree_.isForeground = false;
+        advance_();
+    }
+
+    if (token_.type != EToken::END)
+        return failNear_();
+
+    for (auto& pipeline : tree_.pipelines)
+        for (auto& command : pipeline.commands)
+            command.limits = tree_.limits;
+
+    return true;
+}
+
+bool Parser::parsePipeline_(Pipeline& pipeline)
+{
+    pipeline.commands.emplace_back();
+    if (!parseCommand_(pipeline.commands.back()))
+        return false;
+
+    while (token_.type == EToken::PIPE)
+    {
+        advance_();
+
+        pipeline.commands.emplace_back();
+        if (!parseCommand_(pipeline.commands.back()))
+            return false;
+    }
+
+    return true;
+}
+
+bool Parser::parseCommand_(Command& command)
+{
+    if (token_.type != EToken::WORD && token_.type != EToken::REDIR)
+        return failNear_();
+
+    while (token_.type == EToken::WORD || token_.type == EToken::REDIR)
+    {
+        if (token_.type == EToken::REDIR)
+        {
+            if (!parseRedirect_(command))
+                return false;
+            continue;
+        }
+
+        if (command.argv.size() == ::process::Process::maxArgc)
+            return fail_("too many arguments");
+
+        if (token_.isQuoted)
+            command.argv.push_back(unquote_(token_));
+        else
+            command.argv.emplace_back(token_.text);
+
+        advance_();
+    }
+
+    if (command.argv.empty())
+        return fail_("redirection without a command");
+    if (command.argv[0].empty())
+        return fail_("empty command name");
+
+    return true;
+}
+
+bool Parser::parseRedirect_(Command& command)
+{
+    using ERedir = ::process::Process::ERedir;
+
+    // the lexer only lets through well formed ones
+    std::string_view text = token_.text;
+    const bool isBoth = text[0] == '&';
+    int fd = -1;
+
+    if (isBoth)
+        text.remove_prefix(1);
+    else if (text[0] != '<' && text[0] != '>')
+    {
+        fd = text[0] - '0';
+        text.remove_prefix(1);
+    }
+
+    ::process::Process::Redirect redir{ERedir::IN, fd, {}, -1};
+
+    if (text == "<")
+        redir.type = ERedir::IN;
+    else if (text == ">>")
+        redir.type = ERedir::APPEND;
+    else if (text == ">")
+        redir.type = ERedir::OUT;
+    else
+    {
+        redir.type  = ERedir::DUP;
+        redir.dupFd = text.back() - '0';
+    }
+
+    if (redir.fd == -1)
+        redir.fd = redir.type == ERedir::IN ? 0 : 1;
+
+    advance_();
+
+    if (redir.type != ERedir::DUP)
+    {
+        if (token_.type != EToken::WORD)
+            return failNear_();
+
+        redir.path = token_.isQuoted ? unquote_(token_) : std::string(token_.text);
+        advance_();
+    }
+
+    command.redirs.push_back(std::move(redir));
+
+    // &> file is > file 2>&1
+    if (isBoth)
+        command.redirs.push_back({ERedir::DUP, 2, {}, 1});
+
+    return true;
+}
+
+bool Parser::parsePriority_(std::string_view value) noexcept
+{
+    const bool isNegative = !value.empty() && value[0] == '-';
+    if (isNegative)
+        value.remove_prefix(1);
+
+    if (value.empty() || value.size() > 3 ||
+        value.find_first_not_of("0123456789") != std::string_view::npos)
+        return false;
+
+    int priority = 0;
+    for (char ch : value)
+        priority = priority * 10 + (ch - '0');
+
+    tree_.priority = isNegative ? -priority : priority;
+    return true;
+}
+
+bool Parser::fail_(std::string const& message)
+{
+    tree_.error = message;
+    return false;
+}
+
+bool Parser::failNear_(void)
+{
+    if (token_.type == EToken::ERROR && token_.isQuoted)
+        return fail_("unterminated quote");
+    if (token_.type == EToken::END)
+        return fail_("unexpected end of line");
+
+    return fail_("syntax error near '" + std::string(token_.text) + "'");
+}
+
+void Parser::advance_(void) noexcept
+{
+    token_ = lexer_.next();
+}
+
+std::string Parser::unquote_(Token const& token)
+{
+    std::string word;
+    word.reserve(token.text.size());
+
+    for (char ch : token.text)
+        if (ch != '"')
+            word.push_back(ch);
+
+    return word;
+}
+
+} // namespace
+
+
+Lexer::Lexer(std::string_view line) noexcept
+    : line_(line)
+{}
+
+size_t Lexer::getPos(void) const noexcept
+{
+    return pos_;
+}
+
+Token Lexer::next(void) noexcept
+{
+    while (pos_ < line_.size() && isSpace_(line_[pos_]))
+        pos_++;
+
+    if (pos_ == line_.size())
+        return {EToken::END, line_.substr(pos_)};
+
+    const size_t begin = pos_;
+    const char ch = line_[pos_];
+    const bool isDouble = pos_ + 1 < line_.size() && line_[pos_ + 1] == ch;
+
+    const char next = pos_ + 1 < line_.size() ? line_[pos_ + 1] : '\0';
+
+    // [N]<  [N]>  [N]>>  [N]>&M  &>  &>>
+    if (ch == '<' || ch == '>' || (ch == '&' && next == '>') ||
+        (isFd_(ch) && (next == '<' || next == '>')))
+    {
+        if (ch != '<' && ch != '>')
+            pos_++;
+
+        const bool isOut = line_[pos_++] == '>';
+
+        if (isOut && pos_ < line_.size() && line_[pos_] == '>')
+            pos_++;
+        else if (isOut && ch != '&' && pos_ + 1 < line_.size() &&
+                 line_[pos_] == '&' && isFd_(line_[pos_ + 1]))
+            pos_ += 2;
+
+        return {EToken::REDIR, line_.substr(begin, pos_ - begin)};
+    }
+
+    if (ch == '|' || ch == '&')
+    {
+        pos_ += isDouble ? 2 : 1;
+        const auto text = line_.substr(begin, pos_ - begin);
+
+        if (ch == '|')
+            return {isDouble ? EToken::OR : EToken::PIPE, text};
+        else
+            return {isDouble ? EToken::AND : EToken::AMP, text};
+    }
+
+    if (ch == ';')
+        return {EToken::SEMI, line_.substr(pos_++, 1)};
+
+    if (isMeta_(ch))
+        return {EToken::ERROR, line_.substr(pos_++, 1)};
+
+    Token token{EToken::WORD, {}};
+
+    while (pos_ < line_.size() && !isSpace_(line_[pos_]) && !isMeta_(line_[pos_]))
+    {
+        if (line_[pos_] == '"')
+        {
+            const size_t close = line_.find('"', pos_ + 1);
+            token.isQuoted = true;
+
+            if (close == std::string_view::npos)
+            {
+                pos_ = line_.size();
+                token.type = EToken::ERROR;
+                break;
+            }
+
+            pos_ = close + 1;
+        }
+        else
+            pos_++;
+    }
+
+    token.text = line_.substr(begin, pos_ - begin);
+    return token;
+}
+
+bool Lexer::isSpace_(char ch) noexcept
+{
+    return ch == ' ' || ch == '\t';
+}
+
+bool Lexer::isFd_(char ch) noexcept
+{
+    return '0' <= ch && ch <= '2';
+}
+
+bool Lexer::isMeta_(char ch) noexcept
+{
+    return ch == '|' || ch == '&' || ch == ';' ||
+           ch == '<' || ch == '>' || ch == '(' || ch == ')';
+}
+
+bool parser::parse(std::string_view line, CmdTree& tree) noexcept
+{
+    tree = CmdTree{};
+
+    try
+    {
+        Parser parser(line, tree);
+        return parser.parseList();
+    }
+    catch (std::bad_alloc const& err)
+    {
+        ::process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+bool parser::parseLimit(std::string_view option, std::string_view value,
+                        limits_t& limits) noexcept
+{
+    if (option == "-c")
+        return place::parseCpus(value, limits.cpus) && CPU_COUNT(&limits.cpus);
+
+    uint64_t number = 0;
+    size_t pos = 0;
+
+    for (; pos < value.size() && '0' <= value[pos] && value[pos] <= '9'; pos++)
+    {
+        if (number > UINT64_MAX / 10 / 1024 / 1024 / 1024)
+            return false;
+        number = number * 10 + (value[pos] - '0');
+    }
+
+    if (pos == 0)
+        return false;
+
+    // only sizes take a suffix
+    if (option == "-v" && pos + 1 == value.size())
+    {
+        const char suffix = value[pos++] | 0x20;    // lower case
+        if (suffix == 'k')
+            number *= 1024;
+        else if (suffix == 'm')
+            number *= 1024 * 1024;
+        else if (suffix == 'g')
+            number *= 1024 * 1024 * 1024;
+        else
+            return false;
+    }
+
+    if (pos != value.size())
+        return false;
+
+    if (option == "-t")
+        limits.cpuSec = number;
+    else if (option == "-v")
+        limits.asBytes = number;
+    else if (option == "-n")
+        limits.files = number;
+    else if (option == "-u")
+        limits.procs = number;
+    else if (option == "-w")
+        limits.wallSec = number;
+    else
+        return false;
+
+    return true;
+}
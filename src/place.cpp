@@ -0,0 +1,364 @@
+#include "../inc/place.hpp"
+#include "../inc/process.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+using namespace place;
+
+namespace {
+
+const char * nodeDir = "/sys/devices/system/node";
+
+// sysfs and procfs files are small, one read is usually enough
+bool readFile(std::string const& path, std::string& content)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+
+    content.clear();
+    char buf[4096];
+    ssize_t readed;
+
+    while ((readed = read(fd, buf, sizeof(buf))) > 0 || (readed == -1 && errno == EINTR))
+        if (readed > 0)
+            content.append(buf, readed);
+
+    close(fd);
+    return readed == 0;
+}
+
+bool readCpus(std::string const& path, cpu_set_t& cpus)
+{
+    std::string content;
+    if (!readFile(path, content))
+        return false;
+
+    while (!content.empty() && (content.back() == '\n' || content.back() == ' '))
+        content.pop_back();
+
+    return parseCpus(content, cpus);
+}
+
+// "some avg10=1.23 avg60=..." of a /proc/pressure file
+bool readPsi(const char * path, double& value)
+{
+    std::string content;
+    return readFile(path, content) && sscanf(content.c_str(), "some avg10=%lf", &value) == 1;
+}
+
+} // namespace
+
+Pressure place::readPressure(void) noexcept
+{
+    Pressure pressure;
+
+    try
+    {
+        pressure.isPsi = readPsi("/proc/pressure/cpu", pressure.cpu) &&
+                         readPsi("/proc/pressure/memory", pressure.memory);
+        if (pressure.isPsi)
+            return pressure;
+
+        pressure.cpu = pressure.memory = 0;
+
+        std::string content;
+        cpu_set_t allowed;
+        double load;
+
+        if (readFile("/proc/loadavg", content) && sscanf(content.c_str(), "%lf", &load) == 1 &&
+            sched_getaffinity(0, sizeof(allowed), &allowed) == 0 && CPU_COUNT(&allowed))
+            pressure.cpu = load * 100 / CPU_COUNT(&allowed);
+    }
+    catch (std::bad_alloc const& err)
+    {
+        ::process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    return pressure;
+}
+
+bool place::parseCpus(std::string_view list, cpu_set_t& cpus) noexcept
+{
+    CPU_ZERO(&cpus);
+
+    auto number = [&list](size_t& value)
+    {
+        size_t pos = 0;
+        value = 0;
+
+        for (; pos < list.size() && '0' <= list[pos] && list[pos] <= '9'; pos++)
+            if ((value = value * 10 + (list[pos] - '0')) >= CPU_SETSIZE)
+                return false;
+
+        list.remove_prefix(pos);
+        return pos != 0;
+    };
+
+    // an empty list is an empty set, sysfs has them for nodes without cpus
+    while (!list.empty())
+    {
+        size_t first, last;
+        if (!number(first))
+            return false;
+
+        last = first;
+        if (!list.empty() && list[0] == '-')
+        {
+            list.remove_prefix(1);
+            if (!number(last) || last < first)
+                return false;
+        }
+
+        for (size_t cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, &cpus);
+
+        if (!list.empty() && (list[0] != ',' || list.size() == 1))
+            return false;
+        if (!list.empty())
+            list.remove_prefix(1);
+    }
+
+    return true;
+}
+
+std::string place::formatCpus(cpu_set_t const& cpus)
+{
+    std::string list;
+
+    for (size_t cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &cpus))
+            continue;
+
+        size_t last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &cpus))
+            last++;
+
+        list += (list.empty() ? "" : ",") + std::to_string(cpu);
+        if (last != cpu)
+            list += "-" + std::to_string(last);
+        cpu = last;
+    }
+
+    return list;
+}
+
+Placer::Placer(size_t width) noexcept
+    : width_(std::max<size_t>(width, 1))
+{
+    try
+    {
+        build_();
+    }
+    catch (std::bad_alloc const& err)
+    {
+        ::process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    sample_();
+}
+
+void Placer::setWidth(size_t width) noexcept
+{
+    width_ = std::max<size_t>(width, 1);
+
+    try
+    {
+        build_();
+    }
+    catch (std::bad_alloc const& err)
+    {
+        ::process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+size_t Placer::getWidth(void) const noexcept
+{
+    return width_;
+}
+
+int Placer::pick(void) noexcept
+{
+    if (sets_.size() < 2)
+        return -1;
+
+    sample_();
+
+    // jobs count in full, a set that is busy by itself is only a bit worse
+    size_t best = 0;
+    double bestLoad = 0;
+
+    for (size_t id = 0; id < sets_.size(); id++)
+    {
+        const double load = sets_[id].jobs + sets_[id].busy / sets_[id].cnt;
+        if (id == 0 || load < bestLoad)
+        {
+            best = id;
+            bestLoad = load;
+        }
+    }
+
+    sets_[best].jobs++;
+    return (int)best;
+}
+
+void Placer::release(int id) noexcept
+{
+    if (0 <= id && (size_t)id < sets_.size() && sets_[id].jobs)
+        sets_[id].jobs--;
+}
+
+cpu_set_t const& Placer::getCpus(int id) const noexcept
+{
+    return sets_.at(id).cpus;
+}
+
+void Placer::print(std::ostream& out) const
+{
+    for (size_t id = 0; id < sets_.size(); id++)
+        out << "[" << id << "] cpus " << formatCpus(sets_[id].cpus) << ", busy "
+            << (int)(sets_[id].busy * 100 / sets_[id].cnt + 0.5) << "%, jobs "
+            << sets_[id].jobs << "\n";
+}
+
+
+/// Below private interface implementation
+
+void Placer::build_(void)
+{
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+        CPU_ZERO(&allowed);
+
+    // nodes in their order, cpus the shell can't run on are left out
+    std::vector<std::pair<size_t, cpu_set_t>> nodes;
+
+    if (DIR * dir = opendir(nodeDir))
+    {
+        while (struct dirent * dirent = readdir(dir))
+        {
+            size_t node;
+            cpu_set_t cpus;
+
+            if (sscanf(dirent->d_name, "node%zu", &node) != 1 ||
+                !readCpus(std::string(nodeDir) + "/" + dirent->d_name + "/cpulist", cpus))
+                continue;
+
+            CPU_AND(&cpus, &cpus, &allowed);
+            if (CPU_COUNT(&cpus))
+                nodes.emplace_back(node, cpus);
+        }
+        closedir(dir);
+    }
+
+    // no NUMA in the kernel or none of its nodes is allowed
+    if (nodes.empty())
+        nodes.emplace_back(0, allowed);
+
+    std::sort(nodes.begin(), nodes.end(),
+              [](auto const& lhs, auto const& rhs) { return lhs.first < rhs.first; });
+
+    sets_.clear();
+
+    for (auto& [node, left] : nodes)
+    {
+        (void)node;
+        size_t cores = 0;
+
+        for (size_t cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (!CPU_ISSET(cpu, &left))
+                continue;
+
+            cpu_set_t core;
+            if (!readCpus("/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+                          "/topology/thread_siblings_list", core))
+                CPU_ZERO(&core);
+            CPU_SET(cpu, &core);
+            CPU_AND(&core, &core, &left);
+            CPU_XOR(&left, &left, &core);
+
+            if (cores++ % width_ == 0)
+            {
+                sets_.emplace_back();
+                CPU_ZERO(&sets_.back().cpus);
+            }
+
+            CPU_OR(&sets_.back().cpus, &sets_.back().cpus, &core);
+            sets_.back().cnt = CPU_COUNT(&sets_.back().cpus);
+        }
+    }
+}
+
+void Placer::sample_(void) noexcept
+{
+    std::string content;
+
+    try
+    {
+        if (!readFile("/proc/stat", content))
+            return;
+
+        std::istringstream sstream(content);
+        std::string line;
+        std::vector<double> busy;   // by cpu, since the previous sample
+
+        // cpuN user nice system idle iowait irq softirq steal ...
+        while (std::getline(sstream, line) && line.compare(0, 3, "cpu") == 0)
+        {
+            size_t cpu;
+            if (sscanf(line.c_str(), "cpu%zu", &cpu) != 1)
+                continue;   // the total one
+
+            std::istringstream fields(line);
+            std::string name;
+            uint64_t value, total = 0, idle = 0;
+            fields >> name;
+
+            // guest time is in user already
+            for (size_t field = 0; field < 8 && fields >> value; field++)
+            {
+                total += value;
+                if (field == 3 || field == 4)
+                    idle += value;
+            }
+
+            if (cpu >= ticks_.size())
+                ticks_.resize(cpu + 1);
+            if (cpu >= busy.size())
+                busy.resize(cpu + 1);
+
+            Tick_& tick = ticks_[cpu];
+            const uint64_t totalDelta = total - tick.total;
+            busy[cpu] = totalDelta ? (double)(total - idle - tick.busy) / totalDelta : 0;
+
+            tick.busy   = total - idle;
+            tick.total  = total;
+        }
+
+        for (auto& set : sets_)
+        {
+            set.busy = 0;
+            for (size_t cpu = 0; cpu < busy.size(); cpu++)
+                if (CPU_ISSET(cpu, &set.cpus))
+                    set.busy += busy[cpu];
+        }
+    }
+    catch (std::bad_alloc const& err)
+    {
+        ::process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
@@ -0,0 +1,87 @@
+#include "../inc/plan.hpp"
+
+#include <functional>
+
+using namespace plan;
+
+Cache& Cache::get(void) noexcept
+{
+    static Cache cache;
+    return cache;
+}
+
+bool Cache::find(std::string_view cmdLine, parser::CmdTree& cmdTree, uint8_t& type) noexcept
+{
+    const uint64_t hash = std::hash<std::string_view>{}(cmdLine);
+    const auto it = index_.find(hash);
+
+    // a colliding line is a miss, add() puts the new one in its place
+    if (it == index_.end() || it->second->cmdLine != cmdLine)
+    {
+        counters_.misses++;
+        return false;
+    }
+
+    entries_.splice(entries_.begin(), entries_, it->second);
+    counters_.hits++;
+
+    try
+    {
+        cmdTree = it->second->cmdTree;
+    }
+    catch (std::bad_alloc const& err)
+    {
+        ::process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    type = it->second->type;
+    return true;
+}
+
+void Cache::add(std::string_view cmdLine, parser::CmdTree const& cmdTree, uint8_t type) noexcept
+{
+    const uint64_t hash = std::hash<std::string_view>{}(cmdLine);
+
+    try
+    {
+        const auto it = index_.find(hash);
+        if (it != index_.end())
+        {
+            entries_.erase(it->second);
+            index_.erase(it);
+        }
+        else if (entries_.size() == maxEntries_)
+        {
+            index_.erase(entries_.back().hash);
+            entries_.pop_back();
+            counters_.evictions++;
+        }
+
+        entries_.push_front({hash, std::string(cmdLine), cmdTree, type});
+        index_[hash] = entries_.begin();
+    }
+    catch (std::bad_alloc const& err)
+    {
+        ::process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+void Cache::clear(void) noexcept
+{
+    entries_.clear();
+    index_.clear();
+}
+
+Cache::Counters Cache::getCounters(void) const noexcept
+{
+    Counters counters = counters_;
+    counters.size = entries_.size();
+    return counters;
+}
+
+void Cache::resetCounters(void) noexcept
+{
+    counters_ = {};
+}
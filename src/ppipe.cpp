@@ -3,34 +3,18 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <cassert>
-#include <sstream>
 #include <signal.h>
 
 using namespace ppipe;
 
-Ppipe::Ppipe(argv_t const& argv1, argv_t const& argv2, bool isForeground) noexcept
-    : isForeground_(isForeground), termPid_(getpid())
+Ppipe::Ppipe(commands_t const& commands, bool isForeground, stdfds_t const& stdFds) noexcept
+    : isForeground_(isForeground), stdFds_(stdFds), termPid_(getpid())
 {
-    if (pipe(pipe_) == -1)
-    {
-        perror("pipe");
-        exit(EXIT_FAILURE);
-    }
-
-    auto stdfds1 = Process::defStdFds;
-    stdfds1[1] = stdfds1[2] = pipe_[1]; // set stdout and stderr
-
-    auto stdfds2 = Process::defStdFds;
-    stdfds2[0] = pipe_[0]; // set stdin
-
-    auto clsfds = Process::defClsFds;
-    clsfds[0] = pipe_[0]; // set fd for close in new thread
-    clsfds[1] = pipe_[1];
+    assert(commands.size() >= 2);
 
     try
     {
-        process1_ = new Process(argv1, stdfds1, clsfds);
-        process2_ = new Process(argv2, stdfds2, clsfds);
+        processes_.reserve(commands.size());
     }
     catch (std::bad_alloc const& err)
     {
@@ -38,117 +22,252 @@ Ppipe::Ppipe(argv_t const& argv1, argv_t const& argv2, bool isForeground) noexce
         exit(EXIT_FAILURE);
     }
 
-    // create new thread group for term
-    setpgid(process1_->getPid(), process1_->getPid());
-    setpgid(process2_->getPid(), process1_->getPid());
+    // builtins on both ends of every '|' talk through rings in-process,
+    // redirections need real descriptors 0, 1 and 2, limits a child
+    isInThread_ = true;
+    for (auto const& command : commands)
+        isInThread_ = isInThread_ && command.redirs.empty() &&
+                      !Process::isLimited(command.limits) &&
+                      Process::isThreadSafeBuiltin(command.argv[0]);
 
-    // set foreground thread group for term
-    if (isForeground_)
-        tcsetpgrp(0, process1_->getPid());
+    if (isInThread_)
+        spawnThreads_(commands);
     else
-        tcsetpgrp(0, termPid_);
+        spawnProcesses_(commands);
 }
 
 Ppipe::~Ppipe(void) noexcept
 {
-    assert(process1_ && process2_);
     join();
 
-    delete process1_;
-    delete process2_;
+    for (auto process : processes_)
+        delete process;
 
-    if (isForeground_)
+    if (isForeground_ && !isInThread_ && Process::isJobControl())
         tcsetpgrp(0, termPid_);
 }
 
-std::pair<int,int> Ppipe::getPid(void) const noexcept
+void * Ppipe::operator new(size_t size)
 {
-    assert(process1_ && process2_);
-    return std::make_pair(process1_->getPid(), process2_->getPid());
+    return pool::Pool<Ppipe>::alloc(size);
 }
 
-std::pair<bool,bool> Ppipe::isTermBySig(void) noexcept
+void Ppipe::operator delete(void * ptr, size_t size) noexcept
 {
-    join(); // wait
-    return std::make_pair(process1_->isTermBySig(), process2_->isTermBySig());
+    pool::Pool<Ppipe>::free(ptr, size);
 }
 
-std::pair<int,int> Ppipe::join(void) noexcept
+size_t Ppipe::size(void) const noexcept
 {
-    int status1 = process1_->join();
+    return processes_.size();
+}
+
+std::vector<int> Ppipe::getPid(void) const noexcept
+{
+    std::vector<int> pids;
 
-    if (!isClosedPipe_)
+    try
+    {
+        for (auto process : processes_)
+            pids.push_back(process->getPid());
+    }
+    catch (std::bad_alloc const& err)
     {
-        assert(close(pipe_[1]) != -1);
-        assert(close(pipe_[0]) != -1);
-        isClosedPipe_ = true;
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
     }
 
-    int status2 = process2_->join();
-    return std::make_pair(status1, status2);
+    return pids;
+}
+
+int Ppipe::getPgid(void) const noexcept
+{
+    assert(processes_.size());
+    return processes_.front()->getPid();
+}
+
+::process::Process& Ppipe::getProcess(size_t stage) const noexcept
+{
+    assert(stage < processes_.size());
+    return *processes_[stage];
+}
+
+std::vector<bool> Ppipe::isTermBySig(void) noexcept
+{
+    join(); // wait
+
+    std::vector<bool> isTermBySig(processes_.size());
+    for (size_t stage = 0; stage < processes_.size(); stage++)
+        isTermBySig[stage] = processes_[stage]->isTermBySig();
+
+    return isTermBySig;
+}
+
+std::vector<int> Ppipe::join(void) noexcept
+{
+    std::vector<int> statuses(processes_.size());
+    for (size_t stage = 0; stage < processes_.size(); stage++)
+        statuses[stage] = processes_[stage]->join();
+
+    return statuses;
 }
 
 void Ppipe::KILL(EKill sig) const noexcept
 {
-    process1_->KILL(sig);
-    process2_->KILL(sig);
+    for (auto process : processes_)
+        process->KILL(sig);
 }
 
-bool Ppipe::isDone(bool isAsynk, std::pair<int*,int*> pwstatus) noexcept
+bool Ppipe::isDone(bool isAsynk, std::vector<int> * pwstatus) noexcept
 {
-    assert(process1_ && process2_);
-    return process1_->isDone(isAsynk, pwstatus.first) &&
-           process2_->isDone(isAsynk, pwstatus.second);
+    if (pwstatus)
+        pwstatus->assign(processes_.size(), 0);
+
+    bool isDone = true;
+
+    for (size_t stage = 0; stage < processes_.size(); stage++)
+    {
+        Process& process = *processes_[stage];
+
+        // once a stage is known to be running the rest are only polled
+        const bool isAsynkStage = isAsynk || !isDone || process.isStopped();
+        int * pwstatusStage = pwstatus ? &(*pwstatus)[stage] : nullptr;
+
+        isDone = process.isDone(isAsynkStage, pwstatusStage) && isDone;
+    }
+
+    return isDone;
 }
 
-bool Ppipe::isSuccess(void) noexcept
+bool Ppipe::isInThread(void) const noexcept
 {
-    assert(process1_ && process2_);
-    const auto [status1, status2] = join();
-    return (status1 == successStatus) && (status2 == successStatus);
+    return isInThread_;
 }
 
-std::pair<Ppipe *,bool> ppipe::make_ppipe(std::string const& cmdLine)
+bool Ppipe::isSuccess(void) noexcept
 {
-    assert(cmdLine.size() > 0);
+    for (int status : join())
+        if (status != successStatus)
+            return false;
 
-    std::stringstream sstream(cmdLine);
-    std::vector<std::string> argv1;
-    std::vector<std::string> argv2;
+    return true;
+}
 
-    bool isSecondPart   = false;
-    bool isForeground   = true;
+void Ppipe::spawnProcesses_(commands_t const& commands) noexcept
+{
+    // Pipes are created one stage ahead and the shell drops its ends as
+    // soon as both neighbours are running, so a child never inherits more
+    // than its own input pipe and both ends of its output pipe.
+    int prevRead = -1;
 
-    while (!sstream.eof())
+    for (size_t stage = 0; stage < commands.size(); stage++)
     {
-        std::string token; sstream >> token;
-        if (token == "")
-            continue;
-        if (token == "|")
+        const bool isLast = stage + 1 == commands.size();
+        pipe_t pipe_ = {-1, -1};
+
+        if (!isLast && pipe(pipe_.data()) == -1)
         {
-            isSecondPart = true;
-            continue;
+            perror("pipe");
+            exit(EXIT_FAILURE);
         }
-        if (token == "&")
+
+        auto stdfds = stdFds_;
+        if (stage != 0)
+            stdfds[0] = prevRead;                       // set stdin
+        if (!isLast)
+            stdfds[1] = stdfds[2] = pipe_[1];           // set stdout and stderr
+
+        auto clsfds = Process::defClsFds;               // set fd for close in child
+        clsfds[0] = prevRead;
+        clsfds[1] = pipe_[0];
+        clsfds[2] = pipe_[1];
+
+        const int pgid = !Process::isJobControl() ? Process::noPgid
+                       : stage == 0 ? Process::newPgid : getPgid();
+
+        try
         {
-            isForeground = false;
-            break;
+            processes_.push_back(new Process(commands[stage].argv, stdfds, clsfds, pgid,
+                                             false, commands[stage].redirs,
+                                             commands[stage].limits));
         }
-        if (token[0] == '"')
+        catch (std::bad_alloc const& err)
         {
-            token.pop_back();
-            token.erase(0, 1);
+            process::PRINT_ERR(err.what());
+            exit(EXIT_FAILURE);
         }
 
-        if (isSecondPart)
-            argv2.push_back(token);
-        else
-            argv1.push_back(token);
+        // create new thread group for term
+        if (Process::isJobControl())
+            setpgid(processes_.back()->getPid(), getPgid());
+
+        if (prevRead != -1)
+            assert(close(prevRead) != -1);
+        if (!isLast)
+            assert(close(pipe_[1]) != -1);
 
+        prevRead = pipe_[0];
     }
 
-    Ppipe * ppipeProcess = new Ppipe(argv1, argv2, isForeground);;
-    return std::make_pair(ppipeProcess, isForeground);
+    // set foreground thread group for term
+    if (!Process::isJobControl())
+        return;
+
+    if (isForeground_)
+        tcsetpgrp(0, getPgid());
+    else
+        tcsetpgrp(0, termPid_);
+}
+
+void Ppipe::spawnThreads_(commands_t const& commands) noexcept
+{
+    using namespace stream;
+
+    auto fdOf = [this](int fd) { return stdFds_[fd] != -1 ? stdFds_[fd] : fd; };
+
+    try
+    {
+        for (size_t stage = 0; stage + 1 < commands.size(); stage++)
+            rings_.emplace_back(new Ring());
+
+        for (size_t stage = 0; stage < commands.size(); stage++)
+        {
+            const bool isLast = stage + 1 == commands.size();
+
+            // same wiring as processes: stdout and stderr into the next stage
+            streams_.emplace_back(stage == 0
+                ? (Stream *)new FdStream(fdOf(0))
+                : (Stream *)new RingReader(*rings_[stage - 1]));
+            Stream& in = *streams_.back();
+
+            streams_.emplace_back(isLast
+                ? (Stream *)new FdStream(fdOf(1))
+                : (Stream *)new RingWriter(*rings_[stage]));
+            Stream& out = *streams_.back();
+
+            streams_.emplace_back(new FdStream(fdOf(2)));
+            Stream& err = isLast ? *streams_.back() : out;
+
+            processes_.push_back(new Process(commands[stage].argv, Io{in, out, err}));
+        }
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
 }
 
+std::pair<Ppipe *,bool> ppipe::make_ppipe(parser::CmdTree const& cmdTree,
+                                          process::Process::stdfds_t const& stdFds)
+{
+    assert(cmdTree.pipelines.size() == 1);
+    assert(cmdTree.pipelines[0].commands.size() >= 2);
+
+    const auto& commands    = cmdTree.pipelines[0].commands;
+    const bool isForeground = cmdTree.isForeground;
+
+    Ppipe * ppipeProcess = new Ppipe(commands, isForeground, stdFds);
+    return std::make_pair(ppipeProcess, isForeground);
+}
 
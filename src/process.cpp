@@ -1,46 +1,263 @@
 #include "../inc/process.hpp"
+#include "../inc/registry.hpp"
+#include "../inc/stats.hpp"
 
 #include <iostream>
-#include <fstream>
 #include <sstream>
 #include <vector>
 #include <string>
 #include <string_view>
 #include <unordered_map>
 #include <functional>
+#include <algorithm>
+#include <cstring>
 
 #include <sys/types.h>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <signal.h>
-#include <dlfcn.h>
+#include <spawn.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <assert.h>
 #include <stdlib.h>
 #include <errno.h>
 
 using namespace process;
 
+// build-time default backend: make SPAWN=FORK|VFORK|POSIX_SPAWN
+#ifndef NANOSHELL_SPAWN
+#define NANOSHELL_SPAWN POSIX_SPAWN
+#endif
+
+extern char ** environ;
+
+namespace {
+
+const char * envSpawnBackend = "NANOSHELL_SPAWN";
+bool isJobControl_ = true;
+Process::Limits defaultLimits_ = {};
+const char * defPathEnv      = "/bin:/usr/bin";   // execvp's one if PATH is unset
+const size_t stackSize       = 2 * 1024 * 1024;   // = 2 MiB, of a builtin child
+
+struct PathHash_
+{
+    std::string pathEnv;    // PATH the entries were found in
+    std::unordered_map<std::string, Process::HashEntry> entries;
+};
+
+// Stacks for clone children: mmap'd lazily with a PROT_NONE guard page
+// below, so an overflow faults instead of running into other memory.
+class StackPool_
+{
+    static constexpr const size_t maxFree_ = 8;
+
+public:
+    explicit StackPool_(size_t size) noexcept
+        : size_(size), guardSize_(sysconf(_SC_PAGESIZE))
+    {}
+
+    ~StackPool_(void) noexcept
+    {
+        for (char * stack : free_)
+            munmap(stack - guardSize_, guardSize_ + size_);
+    }
+
+    // the lowest address of size usable bytes
+    char * take(void) noexcept
+    {
+        if (!free_.empty())
+        {
+            char * stack = free_.back();
+            free_.pop_back();
+            return stack;
+        }
+
+        void * base = mmap(NULL, guardSize_ + size_, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED)
+        {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+
+        assert(mprotect(base, guardSize_, PROT_NONE) == 0);
+        return (char *)base + guardSize_;
+    }
+
+    void give(char * stack) noexcept
+    {
+        if (free_.size() < maxFree_)
+        {
+            try
+            {
+                free_.push_back(stack);
+                return;
+            }
+            catch (std::bad_alloc const&)
+            {
+                // just unmap it
+            }
+        }
+
+        munmap(stack - guardSize_, guardSize_ + size_);
+    }
+
+private:
+    const size_t        size_;
+    const size_t        guardSize_;
+    std::vector<char *> free_;
+};
+
+StackPool_& stackPool_(void) noexcept
+{
+    static StackPool_ stackPool(stackSize);
+    return stackPool;
+}
+
+PathHash_& pathHash_(void) noexcept
+{
+    static PathHash_ pathHash;
+    return pathHash;
+}
+
+int redirFlags(Process::ERedir type) noexcept
+{
+    switch (type)
+    {
+    case Process::ERedir::IN:       return O_RDONLY;
+    case Process::ERedir::OUT:      return O_WRONLY | O_CREAT | O_TRUNC;
+    case Process::ERedir::APPEND:   return O_WRONLY | O_CREAT | O_APPEND;
+    case Process::ERedir::DUP:      break;
+    }
+
+    return -1;
+}
+
+const mode_t redirMode = 0666;  // minus umask, like any shell
+
+int64_t toUs(struct timeval const& tv) noexcept
+{
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+Process::Usage toUsage(struct rusage const& rusage) noexcept
+{
+    Process::Usage usage;
+    usage.userUs    = toUs(rusage.ru_utime);
+    usage.sysUs     = toUs(rusage.ru_stime);
+    usage.maxRssKb  = rusage.ru_maxrss;
+    usage.minFlt    = rusage.ru_minflt;
+    usage.majFlt    = rusage.ru_majflt;
+    usage.volCsw    = rusage.ru_nvcsw;
+    usage.involCsw  = rusage.ru_nivcsw;
+    return usage;
+}
+
+// of the calling thread since it started, without maxrss
+Process::Usage threadUsage(void) noexcept
+{
+    struct rusage rusage;
+    assert(getrusage(RUSAGE_THREAD, &rusage) == 0);
+
+    auto usage = toUsage(rusage);
+    usage.maxRssKb = 0;
+    return usage;
+}
+
+bool isExecutable(std::string const& path) noexcept
+{
+    struct stat st;
+    return access(path.c_str(), X_OK) == 0 && stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+Process::ESpawn& spawnBackend_(void) noexcept
+{
+    static Process::ESpawn spawn_ = [](void)
+    {
+        auto spawn = Process::ESpawn::NANOSHELL_SPAWN;
+        const char * name = getenv(envSpawnBackend);
+
+        if (name != nullptr && !Process::parseSpawnBackend(name, spawn))
+            std::cerr << envSpawnBackend << ": unknown backend '" << name << "'\n";
+
+        return spawn;
+    }();
+
+    return spawn_;
+}
+
+} // namespace
+
 /// Below public interface implementation
 
-Process::Process(argv_t const& argv, stdfds_t const& stdFds, clsfds_t const& clsFds) noexcept
-    : argv_(argv), stdfds_(stdFds), clsfds_(clsFds)
+Process::Process(argv_t const& argv, stdfds_t const& stdFds, clsfds_t const& clsFds, int pgid,
+                 bool isInline, redirs_t const& redirs, Limits const& limits) noexcept
+    : argv_(argv), stdfds_(stdFds), clsfds_(clsFds), pgid_(pgid), redirs_(redirs),
+      limits_(applyDefaultLimits(limits))
 {
-    Process_();
-    while (pid_ == -1);
+    Process_(isInline);
+    while (pid_ == -1 && !isInline_);
 }
 
-Process::Process(argv_t && argv, stdfds_t const& stdFds, clsfds_t const& clsFds) noexcept
-    : argv_(std::move(argv)), stdfds_(stdFds), clsfds_(clsFds)
+Process::Process(argv_t && argv, stdfds_t const& stdFds, clsfds_t const& clsFds, int pgid,
+                 bool isInline, redirs_t const& redirs, Limits const& limits) noexcept
+    : argv_(std::move(argv)), stdfds_(stdFds), clsfds_(clsFds), pgid_(pgid), redirs_(redirs),
+      limits_(applyDefaultLimits(limits))
 {
-    Process_();
+    Process_(isInline);
+}
+
+Process::Process(argv_t const& argv, stream::Io const& io) noexcept
+    : argv_(argv), startNs_(::stats::Stats::nowNs()), isInThread_(true)
+{
+    assert(0 < argv_.size() && argv_.size() <= maxArgc);
+    const auto builtin = plugin::Registry::get().find(argv_[0]);
+    assert(builtin);
+
+    auto routine = [this, builtin, io = io](void) mutable
+    {
+        threadStatus_ = (*builtin)(argv_, io);
+
+        // published by the store to isThreadDone_ below
+        usage_          = threadUsage();
+        usage_.wallNs   = ::stats::Stats::nowNs() - startNs_;
+
+        // EOF downstream and EPIPE upstream, like exit() closing pipe fds
+        io.out.close();
+        io.err.close();
+        io.in.close();
+
+        isThreadDone_.store(true, std::memory_order_release);
+
+        const uint64_t one = 1;
+        assert(write(Process::getThreadEventFd(), &one, sizeof(one)) == sizeof(one));
+    };
+
+    try
+    {
+        thread_ = std::thread(routine);
+    }
+    catch (std::exception const& err)
+    {
+        PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
 }
 
 Process::~Process() noexcept
 {
     if (!isDone_)
         join();
-    if (STACK_ != nullptr)
-        delete STACK_;
+    if (!isInThread_)
+    {
+        // the pid may already be reused by a younger Process
+        const auto it = registry_().find(pid_);
+        if (it != registry_().end() && it->second == this)
+            registry_().erase(it);
+    }
 }
 
 int Process::getPid(void) const noexcept
@@ -50,11 +267,29 @@ int Process::getPid(void) const noexcept
 
 bool Process::isDone(bool isAsynk, int * pwstatus) noexcept
 {
+    if (isEvent_)
+    {
+        isEvent_ = false;
+        if (pwstatus)
+            *pwstatus = eventWstatus_;
+        return isDone_;
+    }
+
     if (isDone_)
         return true;
 
+    if (isInThread_)
+    {
+        if (isAsynk && !isThreadDone_.load(std::memory_order_acquire))
+            return false;
+
+        joinThread_();
+        return true;
+    }
+
     int wstatus = 0;
-    int wret = waitpid(pid_, &wstatus, (isAsynk ? WNOHANG : 0) | WUNTRACED | WCONTINUED);
+    struct rusage rusage;
+    int wret = wait4(pid_, &wstatus, (isAsynk ? WNOHANG : 0) | WUNTRACED | WCONTINUED, &rusage);
 
     if (pwstatus)
         *pwstatus = wstatus;
@@ -64,26 +299,36 @@ bool Process::isDone(bool isAsynk, int * pwstatus) noexcept
         if (errno == EINTR)
             return false;
 
-        perror("waitpid");
+        perror("wait4");
         exit(EXIT_FAILURE);
     }
 
-    if (wret == pid_ && (WIFEXITED(wstatus) || WIFSIGNALED(wstatus)))
-    {
-        isDone_ = true;
+    if (wret == pid_)
+        update_(wstatus, rusage);
 
-        if (WIFEXITED(wstatus))
-            status_     = WEXITSTATUS(wstatus);
-        else if (WIFSIGNALED(wstatus))
-        {
-            status_     = WTERMSIG(wstatus);
-            isTermBySig_= true;
-        }
-    }
+    return isDone_;
+}
+
+bool Process::isStopped(void) const noexcept
+{
+    return isStopped_;
+}
 
+bool Process::isReaped(void) const noexcept
+{
     return isDone_;
 }
 
+bool Process::isInThread(void) const noexcept
+{
+    return isInThread_;
+}
+
+bool Process::isInline(void) const noexcept
+{
+    return isInline_;
+}
+
 bool Process::isSuccess(void) noexcept
 {
     join(); // wait
@@ -101,29 +346,45 @@ int Process::join(void) noexcept
     if (isDone_)
         return status_;
 
+    if (isInThread_)
+    {
+        joinThread_();
+        return status_;
+    }
+
     int wstatus = 0;
+    struct rusage rusage;
 
     do
     {
-        if (waitpid(pid_, &wstatus, 0) == -1)
+        if (wait4(pid_, &wstatus, 0, &rusage) == -1)
         {
-            perror("waitpid");
+            if (errno == EINTR)
+                continue;
+
+            perror("wait4");
             exit(EXIT_FAILURE);
         }
     }
     while (!WIFEXITED(wstatus) && !WIFSIGNALED(wstatus));
 
-    isDone_ = true;
+    update_(wstatus, rusage);
+    return status_;
+}
 
-    if (WIFEXITED(wstatus))
-        status_     = WEXITSTATUS(wstatus);
-    else
-    {
-        status_     = WTERMSIG(wstatus);
-        isTermBySig_= true;
-    }
+Process::Usage const& Process::getUsage(void) const noexcept
+{
+    return usage_;
+}
 
-    return status_;
+int Process::getTermSig(void) const noexcept
+{
+    return isDone_ && isTermBySig_ ? status_ : 0;
+}
+
+Process::Limits const& Process::getLimits(void) const noexcept
+{
+    return limits_;
 }
 
 void Process::KILL(EKill sig) const noexcept
@@ -140,8 +401,14 @@ void Process::KILL(EKill sig) const noexcept
     case Process::EKill::TTOU:  signal = SIGTTOU;   break;
     case Process::EKill::TERM:  signal = SIGTERM;   break;
     case Process::EKill::CONT:  signal = SIGCONT;   break;
+    case Process::EKill::KILL:  signal = SIGKILL;   break;
     }
 
+    // already reaped, the pid may belong to someone else by now;
+    // threads can't be signalled at all, inline builtins are always done
+    if (isDone_ || isInThread_)
+        return;
+
     if (kill(pid_, signal) == -1)
     {
         perror("kill");
@@ -154,48 +421,372 @@ Process::argv_t const& Process::getArgv(void) const noexcept
     return argv_;
 }
 
-bool Process::checkSymMapCallbacks_(std::string const& sym) noexcept
+Process::ESpawn Process::getSpawnBackend(void) noexcept
+{
+    return spawnBackend_();
+}
+
+void Process::setSpawnBackend(ESpawn spawn) noexcept
+{
+    spawnBackend_() = spawn;
+}
+
+bool Process::parseSpawnBackend(std::string const& name, ESpawn& spawn) noexcept
+{
+    if (name == "fork")
+        spawn = ESpawn::FORK;
+    else if (name == "vfork")
+        spawn = ESpawn::VFORK;
+    else if (name == "posix_spawn")
+        spawn = ESpawn::POSIX_SPAWN;
+    else
+        return false;
+
+    return true;
+}
+
+char const* Process::spawnBackendName(ESpawn spawn) noexcept
+{
+    switch (spawn)
+    {
+    case ESpawn::FORK:          return "fork";
+    case ESpawn::VFORK:         return "vfork";
+    case ESpawn::POSIX_SPAWN:   return "posix_spawn";
+    }
+
+    return "unknown";
+}
+
+bool Process::isJobControl(void) noexcept
+{
+    return isJobControl_;
+}
+
+void Process::setJobControl(bool isJobControl) noexcept
+{
+    isJobControl_ = isJobControl;
+}
+
+Process::Limits Process::getDefaultLimits(void) noexcept
+{
+    return defaultLimits_;
+}
+
+void Process::setDefaultLimits(Limits const& limits) noexcept
+{
+    defaultLimits_ = limits;
+}
+
+Process::Limits Process::applyDefaultLimits(Limits const& limits) noexcept
+{
+    Limits applied = limits;
+    applied.cpuSec  = applied.cpuSec  ? applied.cpuSec  : defaultLimits_.cpuSec;
+    applied.asBytes = applied.asBytes ? applied.asBytes : defaultLimits_.asBytes;
+    applied.files   = applied.files   ? applied.files   : defaultLimits_.files;
+    applied.procs   = applied.procs   ? applied.procs   : defaultLimits_.procs;
+    applied.wallSec = applied.wallSec ? applied.wallSec : defaultLimits_.wallSec;
+    if (CPU_COUNT(&applied.cpus) == 0)
+        applied.cpus = defaultLimits_.cpus;
+    return applied;
+}
+
+bool Process::isLimited(Limits const& limits) noexcept
+{
+    const Limits applied = applyDefaultLimits(limits);
+    return applied.cpuSec || applied.asBytes || applied.files ||
+           applied.procs  || applied.wallSec || CPU_COUNT(&applied.cpus);
+}
+
+size_t Process::reap(bool isAsynk, events_t& events) noexcept
+{
+    const size_t cntBefore = events.size();
+    auto& registry = registry_();
+
+    while (true)
+    {
+        // block for the first event only, then drain what's queued
+        const bool isBlock = !isAsynk && events.size() == cntBefore;
+        const int options = (isBlock ? 0 : WNOHANG) | WUNTRACED | WCONTINUED;
+
+        int wstatus = 0;
+        struct rusage rusage;
+        const int pid = wait4(-1, &wstatus, options, &rusage);
+
+        if (pid == -1 && errno == EINTR)
+            continue;
+        if (pid == -1 && errno == ECHILD)
+            break;
+        if (pid == -1)
+        {
+            perror("wait4");
+            exit(EXIT_FAILURE);
+        }
+        if (pid == 0)
+            break;
+
+        const auto it = registry.find(pid);
+        if (it != registry.end())
+        {
+            Process& process = *it->second;
+            process.update_(wstatus, rusage);
+            process.isEvent_        = true;
+            process.eventWstatus_   = wstatus;
+        }
+
+        try
+        {
+            events.emplace_back(pid, wstatus);
+        }
+        catch (std::bad_alloc const& err)
+        {
+            PRINT_ERR(err.what());
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return events.size() - cntBefore;
+}
+
+int Process::getThreadEventFd(void) noexcept
+{
+    static const int eventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    assert(eventFd != -1);
+    return eventFd;
+}
+
+bool Process::isBuiltin(std::string const& name) noexcept
+{
+    return plugin::Registry::get().find(name) != nullptr;
+}
+
+std::vector<std::string> Process::getBuiltinNames(void) noexcept
+{
+    return plugin::Registry::get().getNames();
+}
+
+void Process::addBuiltin(std::string const& name, builtin_t const& builtin,
+                         bool isThreadSafe) noexcept
+{
+    const uint32_t flags = isThreadSafe ? plugin::EFlags::IN_PROCESS : plugin::EFlags::NONE;
+    plugin::Registry::get().add(name, builtin, flags);
+}
+
+bool Process::isThreadSafeBuiltin(std::string const& name) noexcept
 {
-    if (Process::mapCallbacks_() == nullptr)
-        Process::initMapCallbacks_();
+    return plugin::Registry::get().isInProcess(name);
+}
+
+bool Process::hashPath(std::string const& name, std::string& path, bool isHit) noexcept
+{
+    // execvp doesn't search names with a slash either
+    if (name.empty() || name.find('/') != std::string::npos)
+        return false;
+
+    const char * pathEnv = getenv("PATH");
+    if (pathEnv == nullptr)
+        pathEnv = defPathEnv;
+
+    auto& pathHash = pathHash_();
+
+    try
+    {
+        if (pathHash.pathEnv != pathEnv)
+        {
+            pathHash.entries.clear();
+            pathHash.pathEnv = pathEnv;
+        }
+
+        const auto it = pathHash.entries.find(name);
+        if (it != pathHash.entries.end())
+        {
+            if (isExecutable(it->second.path))
+            {
+                path = it->second.path;
+                it->second.hits += isHit;
+                return true;
+            }
+
+            // removed or replaced, walk PATH again
+            pathHash.entries.erase(it);
+        }
+
+        std::string_view rest = pathHash.pathEnv;
+
+        while (true)
+        {
+            const size_t colon = rest.find(':');
+            const auto dir = rest.substr(0, colon);
+
+            // an empty entry means the cwd
+            std::string file = dir.empty() ? "." : std::string(dir);
+            file += "/";
+            file += name;
+
+            if (isExecutable(file))
+            {
+                path = file;
+                if (file[0] == '/')
+                    pathHash.entries[name] = {name, file, (size_t)isHit};
+                return true;
+            }
+
+            if (colon == std::string_view::npos)
+                return false;
+            rest = rest.substr(colon + 1);
+        }
+    }
+    catch (std::bad_alloc const& err)
+    {
+        PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+void Process::clearPathHash(void) noexcept
+{
+    pathHash_().entries.clear();
+}
+
+std::vector<Process::HashEntry> Process::getPathHash(void) noexcept
+{
+    std::vector<HashEntry> entries;
+
+    try
+    {
+        for (auto const& [name, entry] : pathHash_().entries)
+            entries.push_back(entry);
+    }
+    catch (std::bad_alloc const& err)
+    {
+        PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
 
-    const auto& mapCallbacks = *Process::mapCallbacks_();
-    return mapCallbacks.find(sym) != mapCallbacks.end();
+    std::sort(entries.begin(), entries.end(), [](HashEntry const& lhs, HashEntry const& rhs)
+    {
+        return lhs.name < rhs.name;
+    });
+
+    return entries;
 }
 
 
 /// Below private interface implementation
 
-void Process::Process_(void) noexcept
+void Process::Process_(bool isInline) noexcept
 {
     assert(0 < argv_.size() && argv_.size() <= maxArgc);
     assert(0 < argv_[0].size());
 
-    if (Process::mapCallbacks_() == nullptr)
-        Process::initMapCallbacks_();
+    startNs_ = ::stats::Stats::nowNs();
+
+    if (isInline && Process::isThreadSafeBuiltin(argv_[0]) && !isPipeFd_() &&
+        !isLimited(limits_))
+    {
+        ProcessInline_();
+        return;
+    }
+
+    {
+        stats::Stats::Timer timer(stats::EMetric::SPAWN);
 
-    const auto& name = argv_[0];
+        if (Process::isBuiltin(argv_[0]))
+            ProcessClone_();
+        else
+            ProcessExec_();
+    }
 
-    if (Process::checkSymMapCallbacks_(name))
-        ProcessClone_();
+    try
+    {
+        registry_()[pid_] = this;
+    }
+    catch (std::bad_alloc const& err)
+    {
+        PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+void Process::ProcessInline_(void) noexcept
+{
+    const auto builtin = plugin::Registry::get().find(argv_[0]);
+
+    // -1 means the shell's own descriptor, like in setStdFds_
+    stdfds_t fds = {0, 1, 2};
+    for (size_t i = 0; i < fds.size(); i++)
+        if (stdfds_[i] != -1)
+            fds[i] = stdfds_[i];
+
+    // redirections only swap the descriptors handed to the builtin,
+    // the shell's own 0, 1 and 2 stay as they are
+    std::vector<int> opened;
+    bool isOpened = true;
+
+    for (auto const& redir : redirs_)
+    {
+        if (redir.type == ERedir::DUP)
+        {
+            fds[redir.fd] = fds[redir.dupFd];
+            continue;
+        }
+
+        const int fd = open(redir.path.c_str(), redirFlags(redir.type) | O_CLOEXEC, redirMode);
+        if (fd == -1)
+        {
+            stream::FdStream(fds[2]).print(redir.path + ": " + strerror(errno) + "\n");
+            isOpened = false;
+            break;
+        }
+
+        try
+        {
+            opened.push_back(fd);
+        }
+        catch (std::bad_alloc const& err)
+        {
+            PRINT_ERR(err.what());
+            exit(EXIT_FAILURE);
+        }
+
+        fds[redir.fd] = fd;
+    }
+
+    isInline_ = true;
+
+    if (isOpened)
+    {
+        stream::FdStream in(fds[0]), out(fds[1]), err(fds[2]);
+        stream::Io io{in, out, err};
+        const auto before = threadUsage();
+
+        status_ = (*builtin)(argv_, io);
+
+        usage_          = threadUsage();
+        usage_.userUs   -= before.userUs;
+        usage_.sysUs    -= before.sysUs;
+        usage_.minFlt   -= before.minFlt;
+        usage_.majFlt   -= before.majFlt;
+        usage_.volCsw   -= before.volCsw;
+        usage_.involCsw -= before.involCsw;
+    }
     else
-        ProcessExec_();
+        status_ = failureStatus;
+
+    for (int fd : opened)
+        close(fd);
+
+    usage_.wallNs = ::stats::Stats::nowNs() - startNs_;
+    isDone_ = true;
 }
 
 void Process::ProcessClone_(void) noexcept
 {
-    auto& mapCallbacks  = *Process::mapCallbacks_();
-    const auto& name    = argv_[0];
-    const auto callback = Process::checkSymMapCallbacks_(name)
-        ? &mapCallbacks[name]
-        : &mapCallbacks[Process::notFoundSym];
-
+    const auto builtin = plugin::Registry::get().find(argv_[0]);
     routineArg_ * arg = nullptr;
 
     try
     {
-        STACK_  = new char [STACK_SIZE_];
-        arg     = new routineArg_(this, callback);
+        arg = new routineArg_(this, builtin);
     }
     catch (std::bad_alloc const& err)
     {
@@ -203,16 +794,51 @@ void Process::ProcessClone_(void) noexcept
         exit(EXIT_FAILURE);
     }
 
+    char * stack = stackPool_().take();
+
     const int FLAFS = CLONE_FS | SIGCHLD;
-    if ((pid_ = clone(&routine_, STACK_ + STACK_SIZE_, FLAFS, arg)) == -1)
+    if ((pid_ = clone(&routine_, stack + stackSize, FLAFS, arg)) == -1)
     {
         perror("clone");
         exit(EXIT_FAILURE);
     }
+
+    // no CLONE_VM: the child got its own copies of arg and of the stack,
+    // the parent never touched the stack pages and can hand them out again
+    stackPool_().give(stack);
+    delete arg;
 }
 
 void Process::ProcessExec_(void) noexcept
 {
+    switch (spawnBackend_())
+    {
+    case ESpawn::FORK:
+        ProcessFork_();
+        break;
+    case ESpawn::VFORK:
+        ProcessVfork_();
+        break;
+    case ESpawn::POSIX_SPAWN:
+        // posix_spawn has no attribute for rlimits and affinity, vfork
+        // is what it does inside anyway
+        if (isLimited(limits_))
+            ProcessVfork_();
+        // on failure fall back to fork: the child reports the error
+        // and exits, so the caller still gets a regular job
+        else if (!ProcessSpawn_())
+            ProcessFork_();
+        break;
+    }
+}
+
+void Process::ProcessFork_(void) noexcept
+{
+    execArgv_t execArgv;
+    const auto exec_argv = makeExecArgv_(argv_, execArgv);
+    std::string file;
+    const bool isHashed = hashExec_(file);
+
     if ((pid_ = fork()) == -1)
     {
         perror("fork");
@@ -221,15 +847,154 @@ void Process::ProcessExec_(void) noexcept
 
     if (pid_ == 0)  // child
     {
+        setPgid_();
+        setLimits_();
+        resetSigMask_();
+        setStdFds_();
+        setRedirs_();
+
+        // a script without #! or a file gone since the check, execvp sorts it out
+        if (isHashed)
+            execv(file.c_str(), exec_argv);
+
+        if (isPathExec_())
+            exec_(exec_argv, execv);
+        else
+            exec_(exec_argv, execvp);
+    }
+}
+
+void Process::ProcessVfork_(void) noexcept
+{
+    execArgv_t execArgv;
+    const auto exec_argv = makeExecArgv_(argv_, execArgv);
+    std::string file;
+    const bool isHashed = hashExec_(file);
+
+    if ((pid_ = vfork()) == -1)
+    {
+        perror("vfork");
+        exit(EXIT_FAILURE);
+    }
+
+    if (pid_ == 0)  // child, shares memory with the suspended parent
+    {
+        setPgid_();
+        setLimits_();
+        resetSigMask_();
         setStdFds_();
+        setRedirs_();
+
+        // a script without #! or a file gone since the check, execvp sorts it out
+        if (isHashed)
+            execv(file.c_str(), exec_argv);
+
+        if (isPathExec_())
+            exec_(exec_argv, execv);
+        else
+            exec_(exec_argv, execvp);
+    }
+}
+
+bool Process::ProcessSpawn_(void) noexcept
+{
+    execArgv_t execArgv;
+    const auto exec_argv = makeExecArgv_(argv_, execArgv);
+    std::string file;
+    const bool isHashed = hashExec_(file);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    assert(posix_spawn_file_actions_init(&actions) == 0);
+    assert(posix_spawnattr_init(&attr) == 0);
+
+    // same order as setStdFds_: dup std i/o, then close the rest
+    for (int i = 0; i < (int)stdfds_.size(); i++)
+        if (stdfds_[i] != -1)
+            assert(posix_spawn_file_actions_adddup2(&actions, stdfds_[i], i) == 0);
+
+    for (int i = 0; i < (int)clsfds_.size(); i++)
+        if (clsfds_[i] != -1)
+            assert(posix_spawn_file_actions_addclose(&actions, clsfds_[i]) == 0);
+
+    // a file that can't be opened fails the spawn, then the fork child
+    // of the fallback reports it
+    for (auto const& redir : redirs_)
+    {
+        if (redir.type == ERedir::DUP)
+            assert(posix_spawn_file_actions_adddup2(&actions, redir.dupFd, redir.fd) == 0);
+        else
+            assert(posix_spawn_file_actions_addopen(&actions, redir.fd, redir.path.c_str(),
+                                                    redirFlags(redir.type), redirMode) == 0);
+    }
 
-        if (argv_[0][0] == '/' || argv_[0][0] == '.')
-            exec_(argv_, execv);
+    sigset_t sigset;
+    sigemptyset(&sigset);
+    assert(posix_spawnattr_setsigmask(&attr, &sigset) == 0);
+    short flags = POSIX_SPAWN_SETSIGMASK;
+
+    if (pgid_ != noPgid)
+    {
+        assert(posix_spawnattr_setpgroup(&attr, pgid_) == 0);
+        flags |= POSIX_SPAWN_SETPGROUP;
+    }
+
+    assert(posix_spawnattr_setflags(&attr, flags) == 0);
+
+    const int ret = isHashed
+        ? posix_spawn (&pid_, file.c_str(), &actions, &attr, exec_argv, environ)
+        : isPathExec_()
+        ? posix_spawn (&pid_, exec_argv[0], &actions, &attr, exec_argv, environ)
+        : posix_spawnp(&pid_, exec_argv[0], &actions, &attr, exec_argv, environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    if (ret != 0)
+        pid_ = -1;
+
+    return ret == 0;
+}
+
+void Process::joinThread_(void) noexcept
+{
+    thread_.join();
+
+    isDone_ = true;
+    status_ = threadStatus_;
+}
+
+void Process::update_(int wstatus, struct rusage const& rusage) noexcept
+{
+    if (WIFSTOPPED(wstatus))
+        isStopped_ = true;
+    else if (WIFCONTINUED(wstatus))
+        isStopped_ = false;
+    else if (WIFEXITED(wstatus) || WIFSIGNALED(wstatus))
+    {
+        isDone_     = true;
+        isStopped_  = false;
+        usage_      = toUsage(rusage);
+        usage_.wallNs = ::stats::Stats::nowNs() - startNs_;
+
+        if (WIFEXITED(wstatus))
+            status_     = WEXITSTATUS(wstatus);
         else
-            exec_(argv_, execvp);
+        {
+            status_     = WTERMSIG(wstatus);
+            isTermBySig_= true;
+        }
     }
 }
 
+void Process::resetSigMask_(void) noexcept
+{
+    // the shell keeps SIGCHLD blocked for its signalfd
+    sigset_t sigset;
+    sigemptyset(&sigset);
+    sigprocmask(SIG_SETMASK, &sigset, NULL);
+}
+
 void Process::setStdFds_(void) noexcept
 {
     // descriptors for std i/o
@@ -252,97 +1017,143 @@ void Process::setStdFds_(void) noexcept
     }
 }
 
-Process::map_callbacks_t * Process::mapCallbacks_(Process::map_callbacks_t * mapCallback) noexcept
+void Process::setRedirs_(void) noexcept
 {
-    static Process::map_callbacks_t * mapCallback_ = nullptr;
+    // may run in a vfork child: only syscalls, perror and _exit
+    for (auto const& redir : redirs_)
+    {
+        if (redir.type == ERedir::DUP)
+        {
+            if (dup2(redir.dupFd, redir.fd) == -1)
+            {
+                perror("dup2");
+                _exit(failureStatus);
+            }
+            continue;
+        }
 
-    if (mapCallback != nullptr)
-        mapCallback_ = mapCallback;
+        const int fd = open(redir.path.c_str(), redirFlags(redir.type) | O_CLOEXEC, redirMode);
+        if (fd == -1)
+        {
+            perror(redir.path.c_str());
+            _exit(failureStatus);
+        }
 
-    return mapCallback_;
+        // dup2 clears FD_CLOEXEC on the copy, the original goes away
+        if (fd == redir.fd)
+            assert(fcntl(fd, F_SETFD, 0) == 0);
+        else
+        {
+            assert(dup2(fd, redir.fd) != -1);
+            assert(close(fd) != -1);
+        }
+    }
 }
 
-void Process::initMapCallbacks_(void) noexcept
+void Process::setPgid_(void) noexcept
 {
-    map_callbacks_t * mapCallbacks = nullptr;
+    if (pgid_ != noPgid)
+        setpgid(0, pgid_);
+}
 
-    try
-    {
-        mapCallbacks = new map_callbacks_t();
-    }
-    catch (std::bad_alloc const& err)
+void Process::setLimits_(void) noexcept
+{
+    // may run in a vfork child: only syscalls, perror and _exit
+    const std::pair<int, uint64_t> limits[] =
     {
-        PRINT_ERR(err.what());
-        exit(EXIT_FAILURE);
-    }
-
-    std::ifstream input(Process::fileSymSharedLib);
-    assert(input.good());
+        {RLIMIT_CPU,    limits_.cpuSec},
+        {RLIMIT_AS,     limits_.asBytes},
+        {RLIMIT_NOFILE, limits_.files},
+        {RLIMIT_NPROC,  limits_.procs}
+    };
 
-    auto dlCancellationPoint = [](bool condition)
+    for (auto [resource, value] : limits)
     {
-        if (condition)
+        struct rlimit rlimit;
+        if (value == 0 || getrlimit(resource, &rlimit) == -1)
+            continue;
+
+        // never above the hard limit, only root could raise it;
+        // the hard one of cpu is a second later, SIGKILL after SIGXCPU
+        rlimit.rlim_cur = std::min<rlim_t>(value, rlimit.rlim_max);
+        if (resource == RLIMIT_CPU)
+            rlimit.rlim_max = std::min<rlim_t>(value + 1, rlimit.rlim_max);
+        else
+            rlimit.rlim_max = rlimit.rlim_cur;
+
+        if (setrlimit(resource, &rlimit) == -1)
         {
-            std::cerr << dlerror() << std::endl;
-            exit(EXIT_FAILURE);
+            perror("setrlimit");
+            _exit(failureStatus);
         }
-    };
-
-    dlerror();
-    void * handle = dlopen(Process::fileSharedLib, RTLD_LAZY);
-    dlCancellationPoint(handle == NULL);
+    }
 
-    std::string name;
-    while (getline(input, name))
+    if (CPU_COUNT(&limits_.cpus) &&
+        sched_setaffinity(0, sizeof(limits_.cpus), &limits_.cpus) == -1)
     {
-        dlerror();
-        void * callback = dlsym(handle, name.c_str());
-        dlCancellationPoint(callback == NULL);
-
-        const auto callbackItem = std::make_pair(name, (signature_t *)callback);
-        const auto [_, isSuccess] = mapCallbacks->insert(callbackItem);
-        assert(isSuccess);
+        perror("sched_setaffinity");
+        _exit(failureStatus);
     }
+}
 
-    Process::mapCallbacks_(mapCallbacks);
+bool Process::isPathExec_(void) const noexcept
+{
+    return argv_[0][0] == '/' || argv_[0][0] == '.';
 }
 
-char* const* Process::makeExecArgv_(argv_t const& argv) const noexcept
+bool Process::isPipeFd_(void) const noexcept
 {
-    char const ** argv_ = nullptr;
+    struct stat st;
 
-    try
-    {
-        argv_ = new char const * [maxArgc + 1];
-    }
-    catch (std::bad_alloc const& err)
-    {
-        PRINT_ERR(err.what());
-        exit(EXIT_FAILURE);
-    }
+    for (int fd : stdfds_)
+        if (fd != -1 && fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode))
+            return true;
+
+    return false;
+}
+
+bool Process::hashExec_(std::string& file) const noexcept
+{
+    return !isPathExec_() && Process::hashPath(argv_[0], file, true);
+}
+
+std::unordered_map<int, Process*>& Process::registry_(void) noexcept
+{
+    static std::unordered_map<int, Process*> registry;
+    return registry;
+}
 
+char* const* Process::makeExecArgv_(argv_t const& argv, execArgv_t& execArgv) const noexcept
+{
     for (size_t arg = 0; arg < argv.size(); arg++)
-        argv_[arg] = argv[arg].c_str();
-    argv_[argv.size()] = NULL;
+        execArgv[arg] = argv[arg].c_str();
+    execArgv[argv.size()] = NULL;
 
-    return const_cast<char* const*>(argv_);
+    return const_cast<char* const*>(execArgv.data());
 }
 
 int Process::routine_(void * arg) noexcept
 {
-    auto [process, callback] = *(routineArg_ *)arg;
+    auto [process, builtin] = *(routineArg_ *)arg;
 
+    process->setPgid_();
+    process->setLimits_();
+    process->resetSigMask_();
     process->setStdFds_();
-    int status = (*callback)(process->argv_);
+    process->setRedirs_();
+
+    stream::FdStream in(0), out(1), err(2);
+    stream::Io io{in, out, err};
+    int status = (*builtin)(process->argv_, io);
 
     delete (routineArg_ *)arg;
     return status;
 }
 
-Process::routineArg_::routineArg_(Process * process, callback_t * callback) noexcept
-    : process(process), callback(callback)
+Process::routineArg_::routineArg_(Process * process, builtin_t const * builtin) noexcept
+    : process(process), builtin(builtin)
 {
     assert(process);
-    assert(callback);
+    assert(builtin);
 }
 
@@ -0,0 +1,308 @@
+#include "../inc/registry.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <climits>
+
+#include <unistd.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+
+using namespace plugin;
+
+namespace {
+
+const char * envPluginPath = "NANOSHELL_PLUGIN_PATH";
+const std::string_view libSuffix = ".so";
+
+bool isLibrary(std::string_view name) noexcept
+{
+    return name.size() > libSuffix.size() &&
+           name.substr(name.size() - libSuffix.size()) == libSuffix;
+}
+
+} // namespace
+
+Registry& Registry::get(void) noexcept
+{
+    static Registry registry;
+    return registry;
+}
+
+Registry::~Registry(void) noexcept
+{
+    // builtin threads may still run code of the libraries at exit
+}
+
+Registry::builtin_t const * Registry::find(std::string const& name) noexcept
+{
+    auto it = builtins_.find(name);
+    if (it != builtins_.end())
+        return &it->second.builtin;
+
+    scan_();
+
+    for (size_t library = 0; library < libraries_.size(); library++)
+    {
+        if (libraries_[library].isTried)
+            continue;
+
+        std::string error;
+        if (!load_(library, error))
+            std::cerr << error << std::endl;
+
+        it = builtins_.find(name);
+        if (it != builtins_.end())
+            return &it->second.builtin;
+    }
+
+    return nullptr;
+}
+
+bool Registry::isInProcess(std::string const& name) noexcept
+{
+    if (find(name) == nullptr)
+        return false;
+
+    return builtins_.at(name).flags & EFlags::IN_PROCESS;
+}
+
+void Registry::add(std::string const& name, builtin_t const& builtin, uint32_t flags) noexcept
+{
+    try
+    {
+        builtins_[name] = {builtin, flags, noLibrary_};
+    }
+    catch (std::bad_alloc const& err)
+    {
+        ::process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+std::vector<std::string> Registry::getNames(void) noexcept
+{
+    std::vector<std::string> names;
+
+    // an empty name is never a builtin, so every library gets opened
+    find("");
+
+    try
+    {
+        for (auto const& [name, builtin] : builtins_)
+            names.push_back(name);
+    }
+    catch (std::bad_alloc const& err)
+    {
+        ::process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+bool Registry::reload(std::string const& name, std::string& report) noexcept
+{
+    try
+    {
+        // everything, new files on the search path included
+        if (name.empty())
+        {
+            for (size_t library = 0; library < libraries_.size(); library++)
+                unload_(library);
+
+            libraries_.clear();
+            isScanned_ = false;
+            scan_();
+
+            bool isSuccess = true;
+            for (size_t library = 0; library < libraries_.size(); library++)
+            {
+                std::string error;
+                if (!load_(library, error))
+                {
+                    report += error + "\n";
+                    isSuccess = false;
+                }
+            }
+
+            report += "reload: " + std::to_string(libraries_.size()) + " libraries, " +
+                      std::to_string(builtins_.size()) + " builtins\n";
+            return isSuccess;
+        }
+
+        scan_();
+
+        for (size_t library = 0; library < libraries_.size(); library++)
+        {
+            std::string const& path = libraries_[library].path;
+            const size_t slash = path.rfind('/');
+            if (path != name && path.substr(slash + 1) != name)
+                continue;
+
+            unload_(library);
+
+            // dlopen would hand out the old code again
+            if (void * handle = dlopen(path.c_str(), RTLD_NOW | RTLD_NOLOAD))
+            {
+                dlclose(handle);
+                report += "reload: " + path + ": can't be unloaded, build it with -fno-gnu-unique\n";
+            }
+
+            std::string error;
+            if (!load_(library, error))
+            {
+                report += error + "\n";
+                return false;
+            }
+
+            const auto cnt = std::count_if(builtins_.begin(), builtins_.end(),
+                [library](auto const& item) { return item.second.library == library; });
+            report += "reload: " + path + ": " + std::to_string(cnt) + " builtins\n";
+            return true;
+        }
+
+        report += "reload: " + name + ": no such library on the plugin path\n";
+        return false;
+    }
+    catch (std::bad_alloc const& err)
+    {
+        ::process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+/// Below private interface implementation
+
+void Registry::scan_(void) noexcept
+{
+    if (isScanned_)
+        return;
+    isScanned_ = true;
+
+    const char * pathEnv = getenv(envPluginPath);
+    const std::string searchPath = pathEnv ? pathEnv : defaultPath_();
+
+    try
+    {
+        std::string_view rest = searchPath;
+
+        while (!rest.empty())
+        {
+            const size_t colon = rest.find(':');
+            const std::string entry(rest.substr(0, colon));
+            rest = colon == std::string_view::npos ? "" : rest.substr(colon + 1);
+
+            struct stat st;
+            if (entry.empty() || stat(entry.c_str(), &st) == -1)
+                continue;
+
+            std::vector<std::string> paths;
+
+            if (S_ISREG(st.st_mode) && isLibrary(entry))
+                paths.push_back(entry);
+            else if (DIR * dir = S_ISDIR(st.st_mode) ? opendir(entry.c_str()) : nullptr)
+            {
+                while (struct dirent * dirent = readdir(dir))
+                    if (isLibrary(dirent->d_name))
+                        paths.push_back(entry + "/" + dirent->d_name);
+                closedir(dir);
+                std::sort(paths.begin(), paths.end());
+            }
+
+            for (auto& path : paths)
+            {
+                auto isSame = [&path](Library_ const& library) { return library.path == path; };
+                if (std::none_of(libraries_.begin(), libraries_.end(), isSame))
+                    libraries_.push_back({std::move(path)});
+            }
+        }
+    }
+    catch (std::bad_alloc const& err)
+    {
+        ::process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+bool Registry::load_(size_t library, std::string& error) noexcept
+{
+    Library_& current = libraries_[library];
+    current.isTried = true;
+
+    try
+    {
+        dlerror();
+        current.handle = dlopen(current.path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (current.handle == nullptr)
+        {
+            error = dlerror();
+            return false;
+        }
+
+        auto descriptor = (Descriptor const *)dlsym(current.handle, descriptorSym);
+
+        if (descriptor == nullptr || descriptor->version != abiVersion)
+        {
+            error = current.path + ": " + (descriptor ? "wrong plugin version"
+                                                      : "no plugin descriptor");
+            dlclose(current.handle);
+            current.handle = nullptr;
+            return false;
+        }
+
+        for (uint32_t idx = 0; idx < descriptor->count; idx++)
+        {
+            Builtin const& builtin = descriptor->builtins[idx];
+            builtins_.insert({builtin.name, {builtin.entry, builtin.flags, library}});
+        }
+    }
+    catch (std::bad_alloc const& err)
+    {
+        ::process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    return true;
+}
+
+void Registry::unload_(size_t library) noexcept
+{
+    Library_& current = libraries_[library];
+
+    for (auto it = builtins_.begin(); it != builtins_.end();)
+    {
+        if (it->second.library == library)
+            it = builtins_.erase(it);
+        else
+            it++;
+    }
+
+    if (current.handle != nullptr)
+        dlclose(current.handle);
+
+    current.handle  = nullptr;
+    current.isTried = false;
+}
+
+std::string Registry::defaultPath_(void) noexcept
+{
+    char exe[PATH_MAX];
+    const ssize_t size = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (size <= 0)
+        return ".";
+
+    try
+    {
+        std::string path(exe, size);
+        return path.substr(0, path.rfind('/'));
+    }
+    catch (std::bad_alloc const& err)
+    {
+        ::process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
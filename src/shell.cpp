@@ -1,34 +1,45 @@
 #include "../inc/shell.hpp"
+#include "../inc/registry.hpp"
+#include "../inc/stats.hpp"
+#include "../inc/plan.hpp"
 #include <iostream>
 #include <variant>
 #include <sstream>
+#include <chrono>
+#include <iomanip>
+#include <unordered_map>
+#include <algorithm>
 #include <unistd.h>
 #include <assert.h>
 #include <termios.h>
 #include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <poll.h>
 
 using namespace shell;
 
 namespace {
 
-bool IS_SIGCHILD_EVENT = false;
-void sigChildHandler(int sig) { (void)sig; IS_SIGCHILD_EVENT = true; }
-
 const char * helloMessage =
     "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n"
     "                   How to use                                      \n"
     "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n"
     "Step one. Type one of the next commands in format:                 \n"
     "1. <cmd> [argv]... [&]                                             \n"
-    "2. <cmd> [argv]... | <cmd> [argv]... [&]                           \n"
-    "3. <cmd> [argv]... && <cmd> [argv]... [&]                          \n"
-    "4. <cmd> [argv]... || <cmd> [argv]... [&]                          \n"
-    "- NOTE: key 'ARR_LEFT' and 'ARR_RIGHT' don't work, sorry ;)        \n"
+    "2. <cmd> [argv]... | <cmd> [argv]... [| <cmd> [argv]...]... [&]    \n"
+    "3. <pipe> && <pipe> [&& | || | ; <pipe>]... [&]                    \n"
+    "4. <pipe> || <pipe> [&& | || | ; <pipe>]... [&]                    \n"
+    "5. <pipe> ; <pipe> [&& | || | ; <pipe>]... [&]                     \n"
+    "- ARR_LEFT, ARR_RIGHT, HOME and END move the cursor                \n"
     "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n"
     "- [&] means launch in background                                   \n"
     "- | means create pipe                                              \n"
     "- && means launch processes with logical \"and\" operation         \n"
     "- || means launch processes with logical \"or\" operation          \n"
+    "- ; means launch processes one after another                       \n"
+    "- <, >, >>, 2>, 2>&1 and &> redirect i/o of a command to files     \n"
     "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n"
     "Step two. Just press \"enter\"                                     \n"
     "- wait until task is done or press CTRL + C to terminate them      \n"
@@ -39,12 +50,40 @@ const char * helloMessage =
     "1. type cmd 'jobs' to look all tasks (see 'N' in first column)     \n"
     "2. type cmd 'fg <N>' or 'bg <N>' to run (previously stopped) task  \n"
     "   in foreground or background respectively                        \n"
+    "3. type cmd 'history [N]' to look last commands, 'history -s [N]'  \n"
+    "   for the slowest ones, 'history -p <prefix>' to look up a prefix  \n"
+    "4. press CTRL + R to search history, again for an older match      \n"
+    "5. press TAB to complete a command or file name                    \n"
+    "6. type cmd 'hash' to look cached program paths, 'hash -r' to      \n"
+    "   forget them, 'hash <cmd>...' to look them up in advance         \n"
+    "7. type cmd 'parallel [-j N] <cmd> [arg]... ::: <item>...' to run  \n"
+    "   <cmd> per item ({} in args is the item) on all CPUs             \n"
+    "8. type cmd 'reload [lib]' to load builtin plugins again after     \n"
+    "   rebuilding them                                                 \n"
+    "9. prefix a command with 'time' to get wall, cpu and memory usage  \n"
+    "   of every process when it's done                                 \n"
+    "10. type cmd 'stats' to look latencies of the shell itself,        \n"
+    "    'stats -r' to reset them                                       \n"
+    "11. type cmd 'capture on [SIZE]' to keep the output of background  \n"
+    "    tasks in memory, 'jobs -o <N>' to look it, 'capture off'       \n"
+    "12. prefix a command with 'limit [-t SEC] [-v SIZE] [-n N] [-u N]  \n"
+    "    [-w SEC] [-c CPUS]' to limit cpu, memory, files, processes and \n"
+    "    wall time or run it on CPUS only ('0-3,6'), type cmd           \n"
+    "    'limits [...]' to look or set the default ones                 \n"
+    "13. type cmd 'placement auto [N]' to spread background tasks over  \n"
+    "    the least loaded N cores, 'placement off' to stop              \n"
+    "14. type cmd 'queue -j N' to run at most N background tasks at     \n"
+    "    once, the rest wait as QUEUED; 'queue -a on' to hold them      \n"
+    "    while the system is busy; prefix a command with 'priority N'   \n"
+    "    to start it before the ones with a lower N                     \n"
     "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n"
     "Step four. Enter \"exit\" command or press CTRL + D combination    \n"
     "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n"
     "                   Goog luck (^-^)                                 \n"
     "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n";
 
+const char * typeNames[] = {"SINGLE", "PPIPE", "BOOLEAN", "UNKNOWN"};
+
 const char * goodbuyMessage =
     "[See you, space cowboy ...]\n";
 
@@ -64,38 +103,93 @@ Shell::Shell(void) noexcept
 
     sigemptyset(&sigset2_);
     sigaddset(&sigset2_, SIGCHLD);
-    assert(sigprocmask(SIG_UNBLOCK, &sigset2_, NULL) == 0);
+    assert(sigprocmask(SIG_BLOCK, &sigset2_, NULL) == 0);
+
+    // terminal input and child state changes share one epoll set
+    sigFd_ = signalfd(-1, &sigset2_, SFD_NONBLOCK | SFD_CLOEXEC);
+    assert(sigFd_ != -1);
+    timerFd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    assert(timerFd_ != -1);
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    assert(epollFd_ != -1);
+
+    for (int fd : {0, sigFd_, timerFd_, ::process::Process::getThreadEventFd(),
+                   completer_.getFd()})
+    {
+        struct epoll_event event = {};
+        event.events    = EPOLLIN;
+        event.data.fd   = fd;
+        assert(epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) == 0);
+    }
+
+    editor_.setCompleter([this](std::string_view line, size_t wordBegin,
+                                std::vector<std::string>& candidates)
+    {
+        completer_.complete(line, wordBegin, candidates);
+    });
+
+    // no history file is not an error, ctrl + r just rings the bell
+    const std::string historyPath = history::History::defaultPath();
+    if (!historyPath.empty() && history_.open(historyPath))
+        editor_.setSearcher([this](std::string_view query, bool isOlder, std::string& match)
+        {
+            return searchHistory_(query, isOlder, match);
+        });
+
+    // monitors are optional, the histograms work without the file
+    ::stats::Stats::get().publish(::stats::Stats::defaultPath());
+
+    if (const char * size = getenv("NANOSHELL_CAPTURE"))
+    {
+        captureLimit_ = ::capture::Capture::parseSize(size);
+        if (captureLimit_)
+            captureLimit_ = std::max(captureLimit_, ::capture::Capture::minLimit);
+        else
+            std::cerr << "nanoshell: NANOSHELL_CAPTURE=" << size
+                      << " is not a size up to 1024M, capture is off" << std::endl;
+    }
 
-    struct sigaction ssigact;
-    ssigact.sa_handler = &sigChildHandler;
-    ssigact.sa_flags = 0;
-    assert(sigaction(SIGCHLD, &ssigact, NULL) == 0);
+    if (const char * jobs = getenv("NANOSHELL_JOBS"))
+    {
+        const std::string_view value(jobs);
+        if (!value.empty() && value.size() < 6 &&
+            value.find_first_not_of("0123456789") == std::string_view::npos)
+            maxJobs_ = strtoul(jobs, NULL, 10);
+        else
+            std::cerr << "nanoshell: NANOSHELL_JOBS=" << value
+                      << " is not a number of jobs, no limit" << std::endl;
+    }
 }
 
 Shell::~Shell(void) noexcept
 {
-    for (size_t idx = 0; idx < tasks_.size(); idx++)
-    if (tasks_[idx].state != EStateTask::DONE)
+    for (auto const& taskItem : tasks_)
+    if (taskItem && taskItem->state != EStateTask::DONE &&
+        taskItem->state != EStateTask::QUEUED)
     {
-        if (tasks_[idx].type == ::analyze::ETypeCmdLine::SINGLE)
+        if (taskItem->type == ::analyze::ETypeCmdLine::SINGLE)
         {
-            auto singleProcess = std::get<single::Single*>(tasks_[idx].task);
+            auto singleProcess = std::get<single::Single*>(taskItem->task);
             singleProcess->KILL(::process::Process::EKill::HUP);
         }
-        else if (tasks_[idx].type == ::analyze::ETypeCmdLine::PPIPE)
+        else if (taskItem->type == ::analyze::ETypeCmdLine::PPIPE)
         {
-            auto ppipeProcess = std::get<ppipe::Ppipe*>(tasks_[idx].task);
+            auto ppipeProcess = std::get<ppipe::Ppipe*>(taskItem->task);
             ppipeProcess->KILL(::process::Process::EKill::HUP);
         }
-        else if (tasks_[idx].type == ::analyze::ETypeCmdLine::BOOLEAN)
+        else if (taskItem->type == ::analyze::ETypeCmdLine::BOOLEAN)
         {
-            auto booleanProcess = std::get<boolean::Boolean*>(tasks_[idx].task);
+            auto booleanProcess = std::get<boolean::Boolean*>(taskItem->task);
             booleanProcess->KILL(::process::Process::EKill::HUP);
         }
     }
 
     printMessage_(goodbuyMessage, EColors::BLUE);
     assert(sigprocmask(SIG_UNBLOCK, &sigset1_, NULL) == 0);
+
+    close(epollFd_);
+    close(sigFd_);
+    close(timerFd_);
 }
 
 Shell::SmartCmdLine::SmartCmdLine(Shell * shell) noexcept
@@ -115,157 +209,198 @@ Shell::SmartCmdLine::~SmartCmdLine(void) noexcept
 
 std::string const& Shell::SmartCmdLine::getCmdLine(void) const noexcept
 {
-    std::string * copyBuffer = nullptr;
+    // valid until the SmartCmdLine is gone, tasks keep their own copy
+    return shell_->cmdLine_;
+}
+
+void Shell::printPreviewMessage(void) const noexcept
+{
+    ::stats::Stats::Timer timer(::stats::EMetric::PROMPT);
 
     try
     {
-        copyBuffer = new std::string(shell_->cmdLine_);
+        std::cout << getPreviewMessage_();
+        std::cout.flush();
     }
-    catch (std::bad_alloc const& err)
+    catch (std::exception const& err)
     {
         process::PRINT_ERR(err.what());
         exit(EXIT_FAILURE);
     }
-
-    return *copyBuffer;
 }
 
-void Shell::printPreviewMessage(void) const noexcept
+Shell::SmartCmdLine Shell::getSmartCmdLine(void) noexcept
 {
-    char bufLogin[256] = {0};
-    assert(getlogin_r(bufLogin, sizeof(bufLogin)) == 0);
+    using EAction = editor::LineEditor::EAction;
 
-    char bufCwd[BUFSIZ] = {0};
-    assert(getcwd(bufCwd, BUFSIZ));
+    // raw mode once for the whole prompt, not per keystroke
+    struct termios old;
+    assert(tcgetattr(0, &old) == 0);
 
-    std::string const& message = std::string(bufLogin) + "@" + bufCwd + "$ ";
-    printMessage_(message, EColors::YELLOW);
-}
+    struct termios raw = old;
+    raw.c_lflag &= ~ICANON;
+    raw.c_lflag &= ~ECHO;
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    assert(tcsetattr(0, TCSANOW, &raw) == 0);
 
-Shell::SmartCmdLine Shell::getSmartCmdLine(void) noexcept
-{
-    auto isAsciiChar = [this](char mychar)
+    try
     {
-        return  (ASCII_BEGIN_ <= mychar && mychar <= ASCII_END_) ||
-                (mychar == (uint8_t)ESpecialAscii::SPACE);
-    };
+        editor_.begin(getPreviewMessage_());
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
 
-    while ((char_ = getChar_()) != (uint8_t)ESpecialAscii::ENTER)
+    auto action = EAction::NONE;
+
+    while (action == EAction::NONE)
     {
-        if (isAsciiChar(char_))
-        {
-            std::cout << char_;
-            cmdLine_.push_back(char_);
-        }
-        else if (char_ == (uint8_t)ESpecialAscii::BACKSPACE)
-        {
-            if (cmdLine_.size())
-            {
-                std::cout << delEscapeSeq_;
-                cmdLine_.pop_back();
-            }
-            else
-                std::cout << bellEscapeSeq_;
-        }
-        else if (char_ == (uint8_t)ESpecialAscii::CTRL_D)
+        if (inPos_ == inBuf_.size() && !readInput_())
         {
-            cmdLine_ = exitCmd;
+            action = EAction::EOF_;
             break;
         }
 
-        std::cout.flush();
+        const int64_t beginNs = ::stats::Stats::nowNs();
+        size_t used = 0;
+
+        action = editor_.feed(inBuf_.data() + inPos_, inBuf_.size() - inPos_, used);
+        inPos_ += used;
+        editor_.flush();
+
+        editor_.addEchoSample(::stats::Stats::nowNs() - beginNs, used);
+    }
+
+    enterNs_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    enterSteadyNs_ = ::stats::Stats::nowNs();
+
+    try
+    {
+        cmdLine_ = action == EAction::EOF_ ? exitCmd : editor_.getLine();
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
     }
 
     std::cout << std::endl;
+    assert(tcsetattr(0, TCSADRAIN, &old) == 0);
+
     return SmartCmdLine(this);
 }
 
-void Shell::addTaskItem(TaskItem item) noexcept
+void Shell::runTask(parser::CmdTree& cmdTree, analyze::ETypeCmdLine type) noexcept
 {
-    if (item.isForeground)
-        fgTaskIdx_ = tasks_.size();
+    // a wrong line goes on for its message, the queue keeps its order
+    const bool isQueued = !cmdTree.isForeground && type != ::analyze::ETypeCmdLine::UNKNOWN &&
+        (maxJobs_ || pressureLimit_) && (!queued_.empty() || !canAdmit_());
+
+    // the lowest free job id, like the pids of a fresh system
+    size_t idx = 0;
+    while (idx < tasks_.size() && tasks_[idx])
+        idx++;
 
     try
     {
-        tasks_.push_back(item);
+        if (idx == tasks_.size())
+            tasks_.emplace_back();
+        tasks_[idx] = TaskItem{{}, cmdTree.isForeground, cmdLine_, type};
     }
     catch (std::bad_alloc const& err)
     {
         process::PRINT_ERR(err.what());
         exit(EXIT_FAILURE);
     }
-}
-
-void Shell::jobs(void) const noexcept
-{
-    auto printTaskInfo = [](size_t idx, TaskItem const& item)
-    {
-        std::cout << "[" << idx << "]";
 
-        std::cout << " pid: ";
-        if (item.type == ::analyze::ETypeCmdLine::SINGLE)
-        {
-            auto singleProcess = std::get<single::Single*>(item.task);
-            std::cout << "[" << singleProcess->getPid() << "]";
+    TaskItem& item      = *tasks_[idx];
+    item.startNs        = enterNs_;
+    item.startSteadyNs  = enterSteadyNs_;
 
-            if (item.state == EStateTask::DONE)
-                std::cout << ", isTermBySig " << (singleProcess->isTermBySig() ? "+" : "-");
-        }
-        else if (item.type == ::analyze::ETypeCmdLine::PPIPE)
+    if (isQueued)
+    {
+        try
         {
-            auto ppipeProcess = std::get<ppipe::Ppipe*>(item.task);
-            auto [pid1, pid2] = ppipeProcess->getPid();
-            std::cout << "[" << pid1 << ", " << pid2 << "], ";
-
-            if (item.state == EStateTask::DONE)
-            {
-                auto [isTermSig1, isTermSig2] = ppipeProcess->isTermBySig();
-                std::cout   << "isTermBySig: "
-                            << "["
-                            << (isTermSig1 ? "+" : "-") << ", "
-                            << (isTermSig2 ? "+" : "-")
-                            << "]";
-            }
+            item.state      = EStateTask::QUEUED;
+            item.priority   = cmdTree.priority;
+            item.queueSeq   = queueSeq_++;
+            item.cmdTree    = std::make_shared<parser::CmdTree>(std::move(cmdTree));
+            queued_.emplace(-item.priority, item.queueSeq, idx);
         }
-        else if (item.type == ::analyze::ETypeCmdLine::BOOLEAN)
+        catch (std::bad_alloc const& err)
         {
-            auto booleanProcess = std::get<boolean::Boolean*>(item.task);
-            auto [pid1, pid2] = booleanProcess->getPairPid();
-            std::cout << "[" << pid1 << ", " << pid2 << "], ";
-            if (item.state == EStateTask::DONE)
-                std::cout << ", isSuccess: " << (booleanProcess->isSuccess() ? "+" : "-");
+            process::PRINT_ERR(err.what());
+            exit(EXIT_FAILURE);
         }
 
-        std::cout << ", isForeground: " << (item.isForeground ? "+" : "-");
-        std::cout << ", type: ";
+        std::cout << "[" << idx << "] is queued" << std::endl;
+        return;
+    }
 
-        if (item.type == analyze::ETypeCmdLine::SINGLE)
-            std::cout << "SINGLE";
-        else if (item.type == analyze::ETypeCmdLine::PPIPE)
-            std::cout << "PPIPE";
-        else if (item.type == analyze::ETypeCmdLine::BOOLEAN)
-            std::cout << "BOOLEAN";
+    if (!startTask_(idx, cmdTree, false))
+    {
+        tasks_[idx].reset();
+        trimTasks_();
+        return;
+    }
 
-        std::cout << ", state: ";
+    if (!item.isForeground && pressureLimit_)
+        admitNs_ = ::stats::Stats::nowNs();
 
-        if (item.state == EStateTask::RUN)
-            std::cout << "RUN";
-        else if (item.state == EStateTask::STOPPED)
-            std::cout << "STOPPED";
-        else if (item.state == EStateTask::RUN_STOPPED)
-            std::cout << "RUN_STOPPED";
-        else if (item.state == EStateTask::DONE)
-            std::cout << "DONE";
-        else if (item.state == EStateTask::UNKNOWN)
-            std::cout << "UNKNOWN";
+    ::stats::Stats::get().record(::stats::EMetric::START, ::stats::Stats::nowNs() - enterSteadyNs_);
+}
 
-        std::cout << ", cmdLine: " << item.cmdLine << "\n";
-    };
+bool Shell::isJobsCmd(void) const
+{
+    std::stringstream sstream(cmdLine_);
+    std::string cmd; sstream >> cmd;
+    return cmd == jobsCmd;
+}
 
+void Shell::jobs(void) noexcept
+{
     try
     {
+        std::stringstream sstream(cmdLine_);
+        std::string cmd, option;
+        size_t N;
+        sstream >> cmd >> option;
+
+        if (option == "-o" && sstream >> N)
+        {
+            if (N >= captures_.size() || !captures_[N])
+            {
+                std::cout << "jobs: no output of [" << N << "] is kept" << std::endl;
+                return;
+            }
+
+            auto& capture = *captures_[N];
+            capture.drain();
+
+            if (capture.getDropped())
+                std::cout << "[" << N << "] " << capture.getDropped()
+                          << " bytes dropped, the last " << capture.getLimit() << " kept\n";
+            capture.print(std::cout);
+            std::cout.flush();
+            return;
+        }
+        else if (!option.empty())
+        {
+            std::cout << "usage: jobs [-o N]" << std::endl;
+            return;
+        }
+
+        // retired ones first, their ids may be taken by now
+        for (size_t cnt = 0; cnt < finishedTasks_.size(); cnt++)
+            std::cout << finishedTasks_[(finishedHead_ + cnt) % finishedTasks_.size()];
+
         for (size_t idx = 0; idx < tasks_.size(); idx++)
-            printTaskInfo(idx, tasks_[idx]);
+            if (tasks_[idx])
+                describeTask_(idx, *tasks_[idx], std::cout);
         std::cout.flush();
     }
     catch (std::exception const& err)
@@ -275,6 +410,152 @@ void Shell::jobs(void) const noexcept
     }
 }
 
+void Shell::describeTask_(size_t idx, TaskItem const& item, std::ostream& out) const
+{
+    out << "[" << idx << "]";
+
+    if (item.state == EStateTask::QUEUED)
+        out << " priority: " << item.priority;
+    else
+        out << " pid: ";
+
+    if (item.state == EStateTask::QUEUED)
+        ;   // nothing runs yet
+    else if (item.type == ::analyze::ETypeCmdLine::SINGLE)
+    {
+        auto singleProcess = std::get<single::Single*>(item.task);
+        if (singleProcess->isInline())
+            out << "[shell]";
+        else
+            out << "[" << singleProcess->getPid() << "]";
+
+        if (item.state == EStateTask::DONE)
+            out << ", isTermBySig " << (singleProcess->isTermBySig() ? "+" : "-");
+    }
+    else if (item.type == ::analyze::ETypeCmdLine::PPIPE)
+    {
+        auto ppipeProcess = std::get<ppipe::Ppipe*>(item.task);
+        const auto pids = ppipeProcess->getPid();
+
+        out << "[";
+        for (size_t stage = 0; stage < pids.size(); stage++)
+        {
+            out << (stage ? ", " : "");
+            if (ppipeProcess->getProcess(stage).isInThread())
+                out << "thread";
+            else
+                out << pids[stage];
+        }
+        out << "], ";
+
+        if (item.state == EStateTask::DONE)
+        {
+            const auto isTermSig = ppipeProcess->isTermBySig();
+            out << "isTermBySig: [";
+            for (size_t stage = 0; stage < isTermSig.size(); stage++)
+                out << (stage ? ", " : "") << (isTermSig[stage] ? "+" : "-");
+            out << "]";
+        }
+        else
+        {
+            out << "stages: [";
+            for (size_t stage = 0; stage < ppipeProcess->size(); stage++)
+            {
+                auto& process = ppipeProcess->getProcess(stage);
+                out << (stage ? ", " : "");
+
+                // a wait here could reap a pid reap() never reports
+                if (process.isReaped())
+                    out << "DONE";
+                else if (process.isStopped())
+                    out << "STOPPED";
+                else
+                    out << "RUN";
+            }
+            out << "]";
+        }
+    }
+    else if (item.type == ::analyze::ETypeCmdLine::BOOLEAN)
+    {
+        auto booleanProcess = std::get<boolean::Boolean*>(item.task);
+        const auto processes = booleanProcess->getProcesses();
+        out << "[";
+        for (size_t pos = 0; pos < processes.size(); pos++)
+        {
+            out << (pos ? ", " : "");
+            if (processes[pos]->isInline())
+                out << "shell";
+            else if (processes[pos]->isInThread())
+                out << "thread";
+            else
+                out << processes[pos]->getPid();
+        }
+        out << "]";
+        if (item.state == EStateTask::DONE)
+            out << ", status: " << booleanProcess->join();
+    }
+
+    if (item.state == EStateTask::DONE)
+    {
+        const auto processes = ::analyze::getProcesses(item.task, item.type);
+
+        out << ", usage: [";
+        for (size_t idx = 0; idx < processes.size(); idx++)
+            out << (idx ? ", " : "") << ::analyze::formatUsage(processes[idx]->getUsage());
+        out << "]";
+    }
+
+    if (item.capture)
+        out << ", output: " << item.capture->getTotal() << " bytes";
+    if (!item.breach.empty())
+        out << ", breach: " << item.breach;
+
+    const auto processes = item.state == EStateTask::QUEUED ?
+        std::vector<::process::Process const*>{} : ::analyze::getProcesses(item.task, item.type);
+    if (!processes.empty() && CPU_COUNT(&processes[0]->getLimits().cpus))
+        out << ", cpus: " << place::formatCpus(processes[0]->getLimits().cpus);
+
+    out << ", isForeground: " << (item.isForeground ? "+" : "-");
+    out << ", type: ";
+
+    if (item.type == analyze::ETypeCmdLine::SINGLE)
+        out << "SINGLE";
+    else if (item.type == analyze::ETypeCmdLine::PPIPE)
+        out << "PPIPE";
+    else if (item.type == analyze::ETypeCmdLine::BOOLEAN)
+        out << "BOOLEAN";
+
+    out << ", state: ";
+
+    if (item.state == EStateTask::RUN)
+        out << "RUN";
+    else if (item.state == EStateTask::STOPPED)
+        out << "STOPPED";
+    else if (item.state == EStateTask::RUN_STOPPED)
+        out << "RUN_STOPPED";
+    else if (item.state == EStateTask::DONE)
+        out << "DONE";
+    else if (item.state == EStateTask::QUEUED)
+        out << "QUEUED";
+    else if (item.state == EStateTask::UNKNOWN)
+        out << "UNKNOWN";
+
+    out << ", cmdLine: " << item.cmdLine << "\n";
+}
+
+std::string Shell::getPreviewMessage_(void) const
+{
+    char bufLogin[256] = {0};
+    assert(getlogin_r(bufLogin, sizeof(bufLogin)) == 0);
+
+    char bufCwd[BUFSIZ] = {0};
+    assert(getcwd(bufCwd, BUFSIZ));
+
+    return std::string(colorsEscapeSeq_[(uint8_t)EColors::YELLOW]) +
+           bufLogin + "@" + bufCwd + "$ " +
+           std::string(colorsEscapeSeq_[(uint8_t)EColors::DEFAULT]);
+}
+
 void Shell::applyColor_(EColors color, bool isFlush) const noexcept
 {
     std::cout << colorsEscapeSeq_[(uint8_t)color];
@@ -297,49 +578,84 @@ void Shell::printMessage_(std::string const& message, EColors color) const noexc
     }
 }
 
-char Shell::getChar_(void) noexcept
+bool Shell::readInput_(void) noexcept
 {
-    char buf = 0;
-
-    struct termios old;
-    assert(tcgetattr(0, &old) == 0);
+    inBuf_.resize(0);
+    inPos_ = 0;
 
-    old.c_lflag &= ~ICANON;
-    old.c_lflag &= ~ECHO;
-    old.c_cc[VMIN] = 1;
-    old.c_cc[VTIME] = 0;
-    assert(tcsetattr(0, TCSANOW, &old) == 0);
+    while (true)
+    {
+        struct epoll_event events[4];
+        const int cnt = epoll_wait(epollFd_, events, 4, -1);
 
-    ssize_t readed = 0;
+        if (cnt == -1)
+        {
+            if (errno == EINTR)
+                continue;
 
-    while (readed != 1)
-    {
-        errno = 0;
+            perror("epoll_wait");
+            exit(EXIT_FAILURE);
+        }
 
-        assert(sigprocmask(SIG_UNBLOCK, &sigset2_, NULL) == 0);
-        readed = read(0, &buf, 1);
-        assert(sigprocmask(SIG_BLOCK, &sigset2_, NULL) == 0);
+        bool isInput = false, isTaskEvent = false;
+        for (int idx = 0; idx < cnt; idx++)
+        {
+            if (events[idx].data.fd == 0)
+                isInput = true;
+            else if (events[idx].data.fd == completer_.getFd())
+                completer_.handleEvents();
+            else if (events[idx].data.fd == timerFd_ && !isTimerDue_())
+            {
+                // only the queue looked, nothing to tell
+                uint64_t cnt = 0;
+                while (read(timerFd_, &cnt, sizeof(cnt)) == sizeof(cnt));
+                expireTasks_();
+            }
+            else if (!drainCapture_(events[idx].data.fd))
+                isTaskEvent = true;
+        }
 
-        if (IS_SIGCHILD_EVENT)
+        // the typed part of the line survives job notifications
+        if (isTaskEvent)
         {
-            IS_SIGCHILD_EVENT = false;
+            wakeNs_ = ::stats::Stats::nowNs();
             std::cout << std::endl;
-            cmdLine_.resize(0);
             waitTasks_();
             printPreviewMessage();
+            editor_.redraw();
+            editor_.flush();
         }
+
+        if (!isInput)
+            continue;
+
+        // whatever is pending, a paste usually arrives in one read
+        char buf[BUFSIZ];
+        const ssize_t readed = read(0, buf, sizeof(buf));
+
+        if (readed == 0)    // EOF behaves like CTRL + D
+            return false;
         else if (readed == -1)
         {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+
             perror("read");
             exit(EXIT_FAILURE);
         }
-    }
 
-    old.c_lflag |= ICANON;
-    old.c_lflag |= ECHO;
-    assert(tcsetattr(0, TCSADRAIN, &old) == 0);
+        try
+        {
+            inBuf_.append(buf, readed);
+        }
+        catch (std::bad_alloc const& err)
+        {
+            process::PRINT_ERR(err.what());
+            exit(EXIT_FAILURE);
+        }
 
-    return buf;
+        return true;
+    }
 }
 
 void Shell::waitTasks_(void) noexcept
@@ -351,8 +667,6 @@ void Shell::waitTasks_(void) noexcept
         bool isDone = process->isDone(isAsynk, &wstatus);
         int pid = process->getPid();
 
-        assert(sigprocmask(SIG_BLOCK, &sigset2_, NULL) == 0);
-
         if (isDone)
             taskItem.state = EStateTask::DONE;
         else if (WIFSTOPPED(wstatus))
@@ -369,80 +683,67 @@ void Shell::waitTasks_(void) noexcept
             isChanged = false;
 
         std::cout.flush();
-        assert(sigprocmask(SIG_UNBLOCK, &sigset2_, NULL) == 0);
     };
 
-    auto checkBinary = [this](TaskItem& taskItem, bool isAsynk,
-                          bool& isChanged, auto process)
+    auto checkMulti = [this](TaskItem& taskItem, bool isAsynk,
+                         bool& isChanged, auto process)
     {
-        int wstatus1 = 0, wstatus2 = 0;
-        bool isDone = process->isDone(isAsynk, {&wstatus1, &wstatus2});
-        auto [pid1, pid2] = process->getPid();
+        std::vector<int> wstatuses;
+        bool isDone = process->isDone(isAsynk, &wstatuses);
+        const auto pids = process->getPid();
 
-        assert(sigprocmask(SIG_BLOCK, &sigset2_, NULL) == 0);
-
-        if (isDone)
-            taskItem.state = EStateTask::DONE;
-        // from RUN to other state
-        else if (WIFSTOPPED(wstatus1) && WIFSTOPPED(wstatus2))
-        {
-            taskItem.state = EStateTask::STOPPED;
-            std::cout << "[" << pid1 << ", " << pid2 << "] is stopped\n";
-        }
-        else if (taskItem.state == EStateTask::RUN &&
-                 (WIFSTOPPED(wstatus1) || WIFSTOPPED(wstatus2)))
-        {
-            taskItem.state = EStateTask::RUN_STOPPED;
-            if (WIFSTOPPED(wstatus1))
-                std::cout << "[" << pid1 << "] is stopped\n";
-            else
-                std::cout << "[" << pid2 << "] is stopped\n";
-        }
-        // from RUN_STOPPED to other state
-        else if (taskItem.state == EStateTask::RUN_STOPPED &&
-                 (WIFSTOPPED(wstatus1) || WIFSTOPPED(wstatus2)))
+        auto printPids = [&pids, &wstatuses](auto isEvent, const char * event)
         {
-            taskItem.state = EStateTask::STOPPED;
-            if (WIFSTOPPED(wstatus1))
-                std::cout << "[" << pid1 << "] is stopped\n";
-            else
-                std::cout << "[" << pid2 << "] is stopped\n";
-        }
-        else if (taskItem.state == EStateTask::RUN_STOPPED &&
-                 (WIFCONTINUED(wstatus1) || WIFCONTINUED(wstatus2)))
+            bool isFirst = true;
+            for (size_t stage = 0; stage < pids.size(); stage++)
+            {
+                if (!isEvent(wstatuses[stage]))
+                    continue;
+                std::cout << (isFirst ? "[" : ", ") << pids[stage];
+                isFirst = false;
+            }
+            if (!isFirst)
+                std::cout << "] is " << event << "\n";
+            return !isFirst;
+        };
+
+        const bool isStopEvent = printPids(
+            [](int wstatus) { return WIFSTOPPED(wstatus); }, "stopped");
+        const bool isContEvent = printPids(
+            [](int wstatus) { return WIFCONTINUED(wstatus); }, "continued");
+
+        // stopped stages out of those still alive decide the state
+        size_t cntAlive = 0, cntStopped = 0;
+        for (size_t stage = 0; stage < process->size(); stage++)
         {
-            taskItem.state = EStateTask::RUN;
-            if (WIFCONTINUED(wstatus1))
-                std::cout << "[" << pid1 << "] is continued\n";
-            else
-                std::cout << "[" << pid2 << "] is continued\n";
+            auto& stageProcess = process->getProcess(stage);
+            if (stageProcess.isReaped())
+                continue;
+            cntAlive++;
+            cntStopped += stageProcess.isStopped();
         }
-        // from STOPPED to other state
-        else if (WIFCONTINUED(wstatus1) && WIFCONTINUED(wstatus2))
-        {
+
+        if (isDone)
+            taskItem.state = EStateTask::DONE;
+        else if (cntStopped == 0)
             taskItem.state = EStateTask::RUN;
-            std::cout << "[" << pid1 << ", " << pid2 << "] is continued\n";
-        }
-        else if (taskItem.state == EStateTask::STOPPED &&
-                 (WIFCONTINUED(wstatus1) || WIFCONTINUED(wstatus2)))
-        {
+        else if (cntStopped == cntAlive)
+            taskItem.state = EStateTask::STOPPED;
+        else
             taskItem.state = EStateTask::RUN_STOPPED;
-            if (WIFCONTINUED(wstatus1))
-                std::cout << "[" << pid1 << "] is continued\n";
-            else
-                std::cout << "[" << pid2 << "] is continued\n";
-        }
+
         // is't changed state
-        else
+        if (!isDone && !isStopEvent && !isContEvent)
             isChanged = false;
 
         std::cout.flush();
-        assert(sigprocmask(SIG_UNBLOCK, &sigset2_, NULL) == 0);
     };
 
-    auto checkState = [this, &checkUnary, &checkBinary](TaskItem& taskItem,
+    auto checkState = [this, &checkUnary, &checkMulti](size_t idx,
                                                         bool isAsynk = true) {
+        TaskItem& taskItem = *tasks_[idx];
         bool isChanged = true;
+        const bool isDone = taskItem.state == EStateTask::DONE;
 
         if (taskItem.type == ::analyze::ETypeCmdLine::SINGLE)
         {
@@ -452,7 +753,7 @@ void Shell::waitTasks_(void) noexcept
         else if (taskItem.type == ::analyze::ETypeCmdLine::PPIPE)
         {
             auto ppipeProcess = std::get<ppipe::Ppipe*>(taskItem.task);
-            checkBinary(taskItem, isAsynk, isChanged, ppipeProcess);
+            checkMulti(taskItem, isAsynk, isChanged, ppipeProcess);
         }
         else if (taskItem.type == ::analyze::ETypeCmdLine::BOOLEAN)
         {
@@ -460,63 +761,410 @@ void Shell::waitTasks_(void) noexcept
             checkUnary(taskItem, isAsynk, isChanged, booleanProcess);
         }
 
+        if (!isDone && taskItem.state == EStateTask::DONE)
+        {
+            recordTask_(taskItem);
+
+            try
+            {
+                doneTasks_.push_back(idx);
+            }
+            catch (std::bad_alloc const& err)
+            {
+                process::PRINT_ERR(err.what());
+                exit(EXIT_FAILURE);
+            }
+        }
+
         return isChanged;
     };
 
-    auto asynkWaitTasks = [this, &checkState](void)
+    // only tasks owning a reaped pid are looked at
+    auto dispatchEvents = [this, &checkState](::process::Process::events_t const& events)
     {
-        bool isStateChanged = true;
-        while (isStateChanged || IS_SIGCHILD_EVENT)
+        for (auto [pid, wstatus] : events)
         {
-            isStateChanged = false;
-            IS_SIGCHILD_EVENT = false;
-
-            for (size_t idx = 0; idx < tasks_.size(); idx++)
-                if (tasks_[idx].state != EStateTask::DONE)
-                    isStateChanged = checkState(tasks_[idx], true) || isStateChanged;
+            (void)wstatus;
+            const auto it = pidToTask_.find(pid);
+            if (it == pidToTask_.end())
+                continue;
+
+            const size_t idx = it->second;
+            if (tasks_[idx]->state != EStateTask::DONE)
+                checkState(idx, true);
+            indexTask_(idx);
         }
     };
 
-    assert(sigprocmask(SIG_UNBLOCK, &sigset2_, NULL) == 0);
+    auto recordReap = [this](::process::Process::events_t const& events, int64_t beginNs)
+    {
+        if (events.empty())
+            return;
+
+        ::stats::Stats::get().record(::stats::EMetric::REAP,
+            ::stats::Stats::nowNs() - (wakeNs_ ? wakeNs_ : beginNs));
+        wakeNs_ = 0;
+    };
+
+    auto asynkWaitTasks = [this, &checkState, &dispatchEvents, &recordReap](void)
+    {
+        ::process::Process::events_t events;
+        const int64_t beginNs = ::stats::Stats::nowNs();
+
+        drainEventFds_();
+        ::process::Process::reap(true, events);
+        dispatchEvents(events);
+        recordReap(events, beginNs);
+
+        for (size_t pos = 0; pos < threadTasks_.size();)
+        {
+            checkState(threadTasks_[pos], true);
+
+            if (tasks_[threadTasks_[pos]]->state == EStateTask::DONE)
+            {
+                threadTasks_[pos] = threadTasks_.back();
+                threadTasks_.pop_back();
+            }
+            else
+                pos++;
+        }
+
+        admitTasks_();
+        expireTasks_();
+    };
 
     asynkWaitTasks();
     if (fgTaskIdx_ != -1)
     {
         assert(fgTaskIdx_ < tasks_.size());
-        TaskItem& taskItem = tasks_[fgTaskIdx_];
+        TaskItem& taskItem = *tasks_[fgTaskIdx_];
 
-        while (taskItem.state == EStateTask::RUN)
+        // a partly stopped pipeline still owns the terminal
+        while (taskItem.state == EStateTask::RUN ||
+               taskItem.state == EStateTask::RUN_STOPPED)
         {
-            checkState(taskItem, false);
+            ::process::Process::events_t events;
+
+            // threads don't raise SIGCHLD, and without children left
+            // there is nothing to block on in waitpid(-1); it can't time
+            // out either, a job may have to be killed or drained meanwhile
+            if (isInThreadTask_(taskItem))
+                checkState(fgTaskIdx_, false);
+            else if (isTimerArmed_ || isCapturing_())
+                pollEventFds_();
+            else if (::process::Process::reap(false, events) == 0)
+                checkState(fgTaskIdx_, false);
+
+            const int64_t beginNs = ::stats::Stats::nowNs();
+            dispatchEvents(events);
+            recordReap(events, beginNs);
             asynkWaitTasks();
         }
 
         fgTaskIdx_ = -1;
     }
 
-    assert(sigprocmask(SIG_BLOCK, &sigset2_, NULL) == 0);
+    retireTasks_();
 }
 
-bool Shell::isControlFlowCmd(void) const
+void Shell::indexTask_(size_t idx) noexcept
 {
-    std::stringstream sstream(cmdLine_);
-    std::vector<std::string> tokens;
+    assert(idx < tasks_.size() && tasks_[idx]);
+    TaskItem const& taskItem = *tasks_[idx];
+    std::vector<int> pids;
 
-    while (!sstream.eof())
+    try
     {
-        std::string token; sstream >> token;
-        if (token == "")
-            continue;
-        tokens.push_back(token);
+        if (taskItem.type == ::analyze::ETypeCmdLine::SINGLE)
+            pids.push_back(std::get<single::Single*>(taskItem.task)->getPid());
+        else if (taskItem.type == ::analyze::ETypeCmdLine::PPIPE)
+            pids = std::get<ppipe::Ppipe*>(taskItem.task)->getPid();
+        else if (taskItem.type == ::analyze::ETypeCmdLine::BOOLEAN)
+            pids = std::get<boolean::Boolean*>(taskItem.task)->getPids();
+
+        for (int pid : pids)
+        {
+            if (pid == -1)
+                continue;
+
+            const auto it = pidToTask_.find(pid);
+            if (taskItem.state != EStateTask::DONE)
+                pidToTask_[pid] = idx;
+            else if (it != pidToTask_.end() && it->second == idx)
+                pidToTask_.erase(it);
+        }
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
     }
+}
 
-    if (tokens.size() != 2)
-        return false;
-    if (tokens[0] != shell::Shell::fgCmd &&
-        tokens[0] != shell::Shell::bgCmd)
-        return false;
+bool Shell::startTask_(size_t idx, parser::CmdTree& cmdTree, bool isQuiet) noexcept
+{
+    TaskItem& item = *tasks_[idx];
+    auto capture = makeCapture(cmdTree.isForeground);
+    const int cpuSet = placeTask(cmdTree);
+    auto taskWrapper = ::analyze::createTask(cmdTree, item.type, isQuiet,
+        capture ? capture->getStdFds() : ::process::Process::defStdFds);
 
-    auto isNumber = [](std::string const& s)
+    if (!taskWrapper)
+    {
+        unplaceTask(cpuSet);
+        return false;
+    }
+
+    std::tie(item.task, item.isForeground) = *taskWrapper;
+    item.state      = EStateTask::RUN;
+    item.isTimed    = cmdTree.isTimed;
+    item.capture    = std::move(capture);
+    item.wallSec    = ::process::Process::applyDefaultLimits(cmdTree.limits).wallSec;
+    item.cpuSet     = cpuSet;
+    item.cmdTree    = nullptr;
+
+    if (item.isForeground)
+        fgTaskIdx_ = idx;
+    if (item.wallSec)
+        item.deadline.atNs = item.startSteadyNs + (int64_t)item.wallSec * 1000 * 1000 * 1000;
+
+    try
+    {
+        if (idx >= captures_.size())
+            captures_.resize(idx + 1);
+
+        // output of the last background job that had the id is gone now,
+        // a foreground one is over before anybody looks
+        if (!item.isForeground)
+            captures_[idx] = item.capture;
+        if (item.capture)
+        {
+            struct epoll_event event = {};
+            event.events    = EPOLLIN;
+            event.data.fd   = item.capture->getFd();
+            assert(epoll_ctl(epollFd_, EPOLL_CTL_ADD, event.data.fd, &event) == 0);
+        }
+
+        if (isInThreadTask_(item))
+            threadTasks_.push_back(idx);
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    indexTask_(idx);
+    return true;
+}
+
+void Shell::trimTasks_(void) noexcept
+{
+    // empty slots at the end, ids in the middle stay free for reuse
+    while (!tasks_.empty() && !tasks_.back())
+        tasks_.pop_back();
+}
+
+bool Shell::startQueued_(size_t idx, bool isForeground) noexcept
+{
+    TaskItem& item = *tasks_[idx];
+    assert(item.state == EStateTask::QUEUED && item.cmdTree);
+
+    queued_.erase({-item.priority, item.queueSeq, idx});
+
+    // its time and its wall clock limit count from now, not from enter
+    item.startNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    item.startSteadyNs = ::stats::Stats::nowNs();
+
+    auto cmdTree = item.cmdTree;
+    cmdTree->isForeground = isForeground;
+
+    if (!startTask_(idx, *cmdTree, true))
+    {
+        std::cout << "[" << idx << "] failed to start: " << item.cmdLine << std::endl;
+        tasks_[idx].reset();
+        trimTasks_();
+        return false;
+    }
+
+    if (!isForeground)
+        std::cout << "[" << idx << "] is started: " << item.cmdLine << std::endl;
+    return true;
+}
+
+void Shell::admitTasks_(void) noexcept
+{
+    while (!queued_.empty() && canAdmit_())
+    {
+        startQueued_(std::get<2>(*queued_.begin()), false);
+
+        // pressure of a new job shows seconds later, one at a time
+        if (pressureLimit_)
+        {
+            admitNs_ = ::stats::Stats::nowNs();
+            break;
+        }
+    }
+}
+
+bool Shell::canAdmit_(void) const noexcept
+{
+    if (maxJobs_ && runningJobs_() >= maxJobs_)
+        return false;
+
+    if (!pressureLimit_)
+        return true;
+
+    if (::stats::Stats::nowNs() - admitNs_ < admitIntervalNs_)
+        return false;
+
+    // the load average is per cpu, a full machine is 100
+    const auto pressure = place::readPressure();
+    return pressure.isPsi ? pressure.cpu < pressureLimit_ && pressure.memory < pressureLimit_
+                          : pressure.cpu < 100;
+}
+
+size_t Shell::runningJobs_(void) const noexcept
+{
+    // a stopped one keeps its slot, it goes on after 'bg' anyway
+    size_t cnt = 0;
+    for (auto const& taskItem : tasks_)
+        cnt += taskItem && !taskItem->isForeground &&
+               taskItem->state != EStateTask::QUEUED &&
+               taskItem->state != EStateTask::DONE;
+
+    return cnt;
+}
+
+bool Shell::isTimerDue_(void) const noexcept
+{
+    const int64_t nowNs = ::stats::Stats::nowNs();
+
+    for (auto const& taskItem : tasks_)
+        if (taskItem && taskItem->state != EStateTask::DONE &&
+            taskItem->deadline.atNs && taskItem->deadline.atNs <= nowNs)
+            return true;
+
+    return !queued_.empty() && canAdmit_();
+}
+
+bool Shell::isInThreadTask_(TaskItem const& item) const noexcept
+{
+    if (item.type == ::analyze::ETypeCmdLine::SINGLE)
+        return std::get<single::Single*>(item.task)->isInline();
+
+    if (item.type == ::analyze::ETypeCmdLine::BOOLEAN)
+        return std::get<boolean::Boolean*>(item.task)->isInThread();
+
+    return item.type == ::analyze::ETypeCmdLine::PPIPE &&
+           std::get<ppipe::Ppipe*>(item.task)->isInThread();
+}
+
+void Shell::drainEventFds_(void) noexcept
+{
+    struct signalfd_siginfo siginfo;
+    while (read(sigFd_, &siginfo, sizeof(siginfo)) == sizeof(siginfo));
+
+    uint64_t cnt = 0;
+    while (read(::process::Process::getThreadEventFd(), &cnt, sizeof(cnt)) == sizeof(cnt));
+    while (read(timerFd_, &cnt, sizeof(cnt)) == sizeof(cnt));
+}
+
+void Shell::pollEventFds_(void) noexcept
+{
+    // captured background jobs write on while a foreground one runs, the
+    // shell keeps the write ends open, so no POLLHUP until they are retired
+    std::vector<struct pollfd> fds = {{sigFd_, POLLIN, 0}, {timerFd_, POLLIN, 0}};
+
+    try
+    {
+        for (auto const& taskItem : tasks_)
+            if (taskItem && taskItem->capture && taskItem->state != EStateTask::DONE)
+                fds.push_back({taskItem->capture->getFd(), POLLIN, 0});
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    if (poll(fds.data(), fds.size(), -1) == -1 && errno != EINTR)
+    {
+        perror("poll");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t pos = 2; pos < fds.size(); pos++)
+        if (fds[pos].revents)
+            drainCapture_(fds[pos].fd);
+}
+
+bool Shell::isCapturing_(void) const noexcept
+{
+    for (auto const& taskItem : tasks_)
+        if (taskItem && taskItem->capture && taskItem->state != EStateTask::DONE)
+            return true;
+
+    return false;
+}
+
+void Shell::expireTasks_(void) noexcept
+{
+    const int64_t nowNs = ::stats::Stats::nowNs();
+    int64_t nextNs = 0;
+
+    for (size_t idx = 0; idx < tasks_.size(); idx++)
+    {
+        if (!tasks_[idx] || tasks_[idx]->state == EStateTask::DONE ||
+            tasks_[idx]->state == EStateTask::QUEUED)
+            continue;
+
+        auto& deadline = tasks_[idx]->deadline;
+        if (::analyze::expireTask(tasks_[idx]->task, nowNs, deadline))
+            std::cout << "[" << idx << "] is out of time, "
+                      << (deadline.atNs ? "terminated" : "killed") << std::endl;
+
+        if (deadline.atNs && (!nextNs || deadline.atNs < nextNs))
+            nextNs = deadline.atNs;
+    }
+
+    // the adaptive queue looks at the pressure again a bit later
+    if (pressureLimit_ && !queued_.empty())
+    {
+        const int64_t admitNs = std::max(admitNs_, nowNs) + admitIntervalNs_;
+        if (!nextNs || admitNs < nextNs)
+            nextNs = admitNs;
+    }
+
+    // steady_clock is CLOCK_MONOTONIC, zero disarms
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec    = nextNs / (1000 * 1000 * 1000);
+    spec.it_value.tv_nsec   = nextNs % (1000 * 1000 * 1000);
+    assert(timerfd_settime(timerFd_, TFD_TIMER_ABSTIME, &spec, NULL) == 0);
+    isTimerArmed_ = nextNs != 0;
+}
+
+bool Shell::isControlFlowCmd(void) const
+{
+    std::stringstream sstream(cmdLine_);
+    std::vector<std::string> tokens;
+
+    while (!sstream.eof())
+    {
+        std::string token; sstream >> token;
+        if (token == "")
+            continue;
+        tokens.push_back(token);
+    }
+
+    if (tokens.size() != 2)
+        return false;
+    if (tokens[0] != shell::Shell::fgCmd &&
+        tokens[0] != shell::Shell::bgCmd)
+        return false;
+
+    auto isNumber = [](std::string const& s)
     {
         for (char ch : s)
             if (std::isdigit(ch) == 0)
@@ -529,31 +1177,38 @@ bool Shell::isControlFlowCmd(void) const
 
 void Shell::fg(size_t idx) noexcept
 {
-    if (idx >= tasks_.size()) return;
+    if (idx >= tasks_.size() || !tasks_[idx]) return;
 
-    if (tasks_[idx].state != EStateTask::DONE)
+    // a queued one skips the queue
+    if (tasks_[idx]->state == EStateTask::QUEUED)
+    {
+        startQueued_(idx, true);
+        return;
+    }
+
+    if (tasks_[idx]->state != EStateTask::DONE)
     {
         fgTaskIdx_ = idx;
-        tasks_[idx].isForeground = true;
+        tasks_[idx]->isForeground = true;
 
-        if (tasks_[idx].type == ::analyze::ETypeCmdLine::SINGLE)
+        if (tasks_[idx]->type == ::analyze::ETypeCmdLine::SINGLE)
         {
-            auto singleProcess = std::get<single::Single*>(tasks_[idx].task);
+            auto singleProcess = std::get<single::Single*>(tasks_[idx]->task);
             int pid = singleProcess->getPid();
             tcsetpgrp(0, pid);
             singleProcess->KILL(::process::Process::EKill::CONT);
         }
-        else if (tasks_[idx].type == ::analyze::ETypeCmdLine::PPIPE)
+        else if (tasks_[idx]->type == ::analyze::ETypeCmdLine::PPIPE)
         {
-            auto ppipeProcess = std::get<ppipe::Ppipe*>(tasks_[idx].task);
-            auto [pid, _] = ppipeProcess->getPid();
-            tcsetpgrp(0, pid);
+            auto ppipeProcess = std::get<ppipe::Ppipe*>(tasks_[idx]->task);
+            tcsetpgrp(0, ppipeProcess->getPgid());
             ppipeProcess->KILL(::process::Process::EKill::CONT);
         }
-        else if (tasks_[idx].type == ::analyze::ETypeCmdLine::BOOLEAN)
+        else if (tasks_[idx]->type == ::analyze::ETypeCmdLine::BOOLEAN)
         {
-            auto booleanProcess = std::get<boolean::Boolean*>(tasks_[idx].task);
+            auto booleanProcess = std::get<boolean::Boolean*>(tasks_[idx]->task);
             int pid = booleanProcess->getPid();
+            booleanProcess->setForeground(true);
             tcsetpgrp(0, pid);
             booleanProcess->KILL(::process::Process::EKill::CONT);
         }
@@ -562,28 +1217,695 @@ void Shell::fg(size_t idx) noexcept
 
 void Shell::bg(size_t idx) noexcept
 {
-    if (idx >= tasks_.size()) return;
+    if (idx >= tasks_.size() || !tasks_[idx]) return;
+
+    if (tasks_[idx]->state == EStateTask::QUEUED)
+    {
+        startQueued_(idx, false);
+        return;
+    }
 
-    if (tasks_[idx].state != EStateTask::DONE)
+    if (tasks_[idx]->state != EStateTask::DONE)
     {
-        tasks_[idx].isForeground = false;
+        tasks_[idx]->isForeground = false;
 
-        if (tasks_[idx].type == ::analyze::ETypeCmdLine::SINGLE)
+        if (tasks_[idx]->type == ::analyze::ETypeCmdLine::SINGLE)
         {
-            auto singleProcess = std::get<single::Single*>(tasks_[idx].task);
+            auto singleProcess = std::get<single::Single*>(tasks_[idx]->task);
             singleProcess->KILL(::process::Process::EKill::CONT);
         }
-        else if (tasks_[idx].type == ::analyze::ETypeCmdLine::PPIPE)
+        else if (tasks_[idx]->type == ::analyze::ETypeCmdLine::PPIPE)
         {
-            auto ppipeProcess = std::get<ppipe::Ppipe*>(tasks_[idx].task);
+            auto ppipeProcess = std::get<ppipe::Ppipe*>(tasks_[idx]->task);
             ppipeProcess->KILL(::process::Process::EKill::CONT);
         }
-        else if (tasks_[idx].type == ::analyze::ETypeCmdLine::BOOLEAN)
+        else if (tasks_[idx]->type == ::analyze::ETypeCmdLine::BOOLEAN)
         {
-            auto booleanProcess = std::get<boolean::Boolean*>(tasks_[idx].task);
+            auto booleanProcess = std::get<boolean::Boolean*>(tasks_[idx]->task);
+            booleanProcess->setForeground(false);
             booleanProcess->KILL(::process::Process::EKill::CONT);
         }
     }
 }
 
 
+
+bool Shell::isHistoryCmd(void) const
+{
+    std::stringstream sstream(cmdLine_);
+    std::string cmd; sstream >> cmd;
+    return cmd == historyCmd;
+}
+
+void Shell::history(void) noexcept
+{
+    const size_t defCnt = 16;
+
+    // formatted aside, std::cout keeps its own flags
+    auto printDuration = [](int64_t ns)
+    {
+        std::ostringstream duration;
+        duration << std::fixed << std::setprecision(3) << ns / 1e9 << "s";
+        std::cout << std::setw(10) << duration.str();
+    };
+
+    // history [N]: last N commands, oldest first
+    auto printLast = [this, &printDuration](size_t cnt)
+    {
+        std::vector<history::Entry> entries;
+        history::Entry entry;
+
+        for (uint64_t pos = 0; entries.size() < cnt && history_.prev(pos, entry);
+             pos = entry.offset)
+            entries.push_back(entry);
+
+        const size_t total = history_.size();
+        for (size_t idx = entries.size(); idx-- > 0;)
+        {
+            auto const& item = entries[idx];
+            const time_t sec = item.startNs / 1000000000;
+            struct tm tm = {};
+            localtime_r(&sec, &tm);
+
+            std::cout << std::setw(6) << total - idx << "  "
+                      << std::put_time(&tm, "%F %T") << " ";
+            printDuration(item.durationNs);
+            std::cout << "  status " << std::setw(3) << item.status << "  "
+                      << std::left << std::setw(8)
+                      << typeNames[std::min<size_t>(item.type, 3)] << std::right
+                      << item.cmdLine << "\n";
+        }
+    };
+
+    // history -s [N]: commands with the biggest mean duration
+    auto printSlowest = [this, &printDuration](size_t cnt)
+    {
+        struct Stat { int64_t totalNs = 0; int64_t maxNs = 0; size_t runs = 0; };
+        std::unordered_map<std::string_view, Stat> stats;
+        history::Entry entry;
+
+        for (uint64_t pos = 0; history_.prev(pos, entry); pos = entry.offset)
+        {
+            Stat& stat = stats[entry.cmdLine];
+            stat.totalNs += entry.durationNs;
+            stat.maxNs = std::max(stat.maxNs, entry.durationNs);
+            stat.runs++;
+        }
+
+        std::vector<std::pair<std::string_view, Stat>> slowest(stats.begin(), stats.end());
+        auto isSlower = [](auto const& lhs, auto const& rhs)
+        {
+            return lhs.second.totalNs / (int64_t)lhs.second.runs >
+                   rhs.second.totalNs / (int64_t)rhs.second.runs;
+        };
+
+        cnt = std::min(cnt, slowest.size());
+        std::partial_sort(slowest.begin(), slowest.begin() + cnt, slowest.end(), isSlower);
+
+        for (size_t idx = 0; idx < cnt; idx++)
+        {
+            auto const& [cmdLine, stat] = slowest[idx];
+            std::cout << "mean ";
+            printDuration(stat.totalNs / (int64_t)stat.runs);
+            std::cout << "  max ";
+            printDuration(stat.maxNs);
+            std::cout << "  runs " << std::setw(6) << stat.runs << "  " << cmdLine << "\n";
+        }
+    };
+
+    // history -p <prefix>: distinct commands starting with prefix
+    auto printPrefix = [this](std::string const& prefix)
+    {
+        std::vector<history::Entry> entries;
+        history_.findPrefix(prefix, defCnt, entries);
+
+        for (auto const& item : entries)
+            std::cout << item.cmdLine << "\n";
+    };
+
+    try
+    {
+        std::stringstream sstream(cmdLine_);
+        std::string cmd, arg, value;
+        sstream >> cmd >> arg;
+
+        if (!history_.isOpen())
+            std::cout << "history: no history file (set HOME or NANOSHELL_HISTORY)\n";
+        else if (arg == "-s")
+        {
+            size_t cnt = defCnt;
+            if (!(sstream >> cnt))
+                cnt = defCnt;
+            printSlowest(cnt);
+        }
+        else if (arg == "-p")
+        {
+            std::getline(sstream >> std::ws, value);
+            printPrefix(value);
+        }
+        else if (arg.empty())
+            printLast(defCnt);
+        else if (arg.size() < 6 && arg.find_first_not_of("0123456789") == std::string::npos)
+            printLast(std::stoul(arg));
+        else
+            std::cout << "usage: history [N] | history -s [N] | history -p <prefix>\n";
+
+        std::cout.flush();
+    }
+    catch (std::exception const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+bool Shell::isHashCmd(void) const
+{
+    std::stringstream sstream(cmdLine_);
+    std::string cmd; sstream >> cmd;
+    return cmd == hashCmd;
+}
+
+void Shell::hash(void) noexcept
+{
+    using ::process::Process;
+
+    try
+    {
+        std::stringstream sstream(cmdLine_);
+        std::string cmd, name;
+        sstream >> cmd;
+
+        std::vector<std::string> names;
+        while (sstream >> name)
+            names.push_back(name);
+
+        if (names.empty())
+        {
+            const auto entries = Process::getPathHash();
+            if (entries.empty())
+                std::cout << "hash: hash table empty\n";
+            else
+                std::cout << "hits\tcommand\n";
+
+            for (auto const& entry : entries)
+                std::cout << std::setw(4) << entry.hits << "\t" << entry.path << "\n";
+        }
+        else if (names.size() == 1 && names[0] == "-r")
+            Process::clearPathHash();
+        else
+        {
+            std::string path;
+            for (auto const& item : names)
+                if (!Process::isBuiltin(item) && !Process::hashPath(item, path))
+                    std::cout << "hash: " << item << ": not found\n";
+        }
+
+        std::cout.flush();
+    }
+    catch (std::exception const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+bool Shell::isStatsCmd(void) const
+{
+    std::stringstream sstream(cmdLine_);
+    std::string cmd; sstream >> cmd;
+    return cmd == statsCmd;
+}
+
+void Shell::stats(void) noexcept
+{
+    try
+    {
+        std::stringstream sstream(cmdLine_);
+        std::string cmd, option;
+        sstream >> cmd >> option;
+
+        if (option == "-r")
+        {
+            ::stats::Stats::get().reset();
+            plan::Cache::get().resetCounters();
+        }
+        else if (!option.empty())
+            std::cout << "usage: stats [-r]\n";
+        else
+        {
+            const auto counters = plan::Cache::get().getCounters();
+
+            ::stats::Stats::get().print(std::cout);
+            std::cout << "plan cache: " << counters.size << " lines, " << counters.hits
+                      << " hits, " << counters.misses << " misses, "
+                      << counters.evictions << " evicted\n";
+        }
+
+        std::cout.flush();
+    }
+    catch (std::exception const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+bool Shell::isReloadCmd(void) const
+{
+    std::stringstream sstream(cmdLine_);
+    std::string cmd; sstream >> cmd;
+    return cmd == reloadCmd;
+}
+
+void Shell::reload(void) noexcept
+{
+    try
+    {
+        std::stringstream sstream(cmdLine_);
+        std::string cmd, name, report;
+        sstream >> cmd >> name;
+
+        // their threads run the code of the libraries
+        if (!threadTasks_.empty())
+        {
+            std::cout << "reload: builtin jobs are running" << std::endl;
+            return;
+        }
+
+        plugin::Registry::get().reload(name, report);
+        std::cout << report;
+        std::cout.flush();
+    }
+    catch (std::exception const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+bool Shell::isLimitsCmd(void) const
+{
+    std::stringstream sstream(cmdLine_);
+    std::string cmd; sstream >> cmd;
+    return cmd == limitsCmd;
+}
+
+void Shell::limits(void) noexcept
+{
+    try
+    {
+        std::stringstream sstream(cmdLine_);
+        std::string cmd, option, value;
+        sstream >> cmd;
+
+        // all or nothing, a wrong option leaves them as they were
+        auto limits = ::process::Process::getDefaultLimits();
+        while (sstream >> option)
+        {
+            if (option == "-r")
+                limits = {};
+            else if (!(sstream >> value) || !parser::parseLimit(option, value, limits))
+            {
+                std::cout << "usage: limits [-r] [-t SEC] [-v SIZE[K|M|G]] [-n N] [-u N] [-w SEC]"
+                             " [-c CPUS]" << std::endl;
+                return;
+            }
+        }
+
+        // jobs already running keep the ones they got
+        ::process::Process::setDefaultLimits(limits);
+
+        auto print = [](uint64_t value, const char * unit)
+        {
+            return value ? std::to_string(value) + unit : std::string("-");
+        };
+
+        std::cout << "limits: cpu " << print(limits.cpuSec, "s")
+                  << ", memory " << print(limits.asBytes, " bytes")
+                  << ", files " << print(limits.files, "")
+                  << ", processes " << print(limits.procs, "")
+                  << ", wall " << print(limits.wallSec, "s") << ", cpus "
+                  << (CPU_COUNT(&limits.cpus) ? place::formatCpus(limits.cpus) : "-") << std::endl;
+    }
+    catch (std::exception const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+bool Shell::isQueueCmd(void) const
+{
+    std::stringstream sstream(cmdLine_);
+    std::string cmd; sstream >> cmd;
+    return cmd == queueCmd;
+}
+
+void Shell::queue(void) noexcept
+{
+    try
+    {
+        std::stringstream sstream(cmdLine_);
+        std::string cmd, option, value;
+        sstream >> cmd;
+
+        auto isNumber = [](std::string const& str)
+        {
+            return !str.empty() && str.size() < 6 &&
+                   str.find_first_not_of("0123456789") == std::string::npos;
+        };
+
+        // all or nothing, a wrong option leaves them as they were
+        size_t maxJobs = maxJobs_;
+        double pressureLimit = pressureLimit_;
+
+        while (sstream >> option)
+        {
+            const bool isValue = (bool)(sstream >> value);
+
+            if (option == "-j" && isValue && isNumber(value))
+                maxJobs = std::stoul(value);
+            else if (option == "-a" && isValue && (value == "on" || value == "off"))
+                pressureLimit = value == "on" ? defPressureLimit_ : 0;
+            else if (option == "-a" && isValue && isNumber(value) &&
+                     std::stoul(value) > 0 && std::stoul(value) <= 100)
+                pressureLimit = std::stoul(value);
+            else
+            {
+                std::cout << "usage: queue [-j N] [-a on | off | PCT]" << std::endl;
+                return;
+            }
+        }
+
+        // queued ones start on the way back to the prompt if they may now
+        maxJobs_ = maxJobs;
+        pressureLimit_ = pressureLimit;
+
+        const auto pressure = place::readPressure();
+
+        std::cout << "queue: " << runningJobs_() << " running, " << queued_.size()
+                  << " queued, at most " << (maxJobs_ ? std::to_string(maxJobs_) : "-")
+                  << ", adaptive "
+                  << (pressureLimit_ ? std::to_string((int)pressureLimit_) + "%" : "off")
+                  << "\npressure: cpu " << (int)(pressure.cpu + 0.5) << "%, memory "
+                  << (int)(pressure.memory + 0.5) << "% ("
+                  << (pressure.isPsi ? "psi, last 10s" : "load average, last 1m") << ")"
+                  << std::endl;
+    }
+    catch (std::exception const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+bool Shell::isPlacementCmd(void) const
+{
+    std::stringstream sstream(cmdLine_);
+    std::string cmd; sstream >> cmd;
+    return cmd == placementCmd;
+}
+
+void Shell::placement(void) noexcept
+{
+    try
+    {
+        std::stringstream sstream(cmdLine_);
+        std::string cmd, mode, cores, extra;
+        sstream >> cmd >> mode >> cores >> extra;
+
+        size_t width = placer_.getWidth();
+        const bool isCores = !cores.empty() &&
+            cores.find_first_not_of("0123456789") == std::string::npos &&
+            cores.size() < 6 && (width = std::stoul(cores)) > 0;
+
+        if (((mode == "auto" && (cores.empty() || isCores)) ||
+             (mode == "off" && cores.empty())) && extra.empty())
+        {
+            isPlaceAuto_ = mode == "auto";
+
+            // ids of the old sets mean nothing to the new ones
+            if (width != placer_.getWidth())
+            {
+                placer_.setWidth(width);
+                for (auto& taskItem : tasks_)
+                    if (taskItem)
+                        taskItem->cpuSet = -1;
+            }
+        }
+        else if (!mode.empty())
+        {
+            std::cout << "usage: placement [auto [N] | off]" << std::endl;
+            return;
+        }
+
+        std::cout << "placement: " << (isPlaceAuto_ ? "auto" : "off") << ", "
+                  << placer_.getWidth() << " cores per background task\n";
+        placer_.print(std::cout);
+        std::cout.flush();
+    }
+    catch (std::exception const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+int Shell::placeTask(parser::CmdTree& cmdTree) noexcept
+{
+    // an explicit cpu set wins, the default one too
+    const auto limits = ::process::Process::applyDefaultLimits(cmdTree.limits);
+    if (!isPlaceAuto_ || cmdTree.isForeground || !cmdTree.error.empty() ||
+        CPU_COUNT(&limits.cpus))
+        return -1;
+
+    const int id = placer_.pick();
+    if (id == -1)
+        return -1;
+
+    cmdTree.limits.cpus = placer_.getCpus(id);
+    for (auto& pipeline : cmdTree.pipelines)
+        for (auto& command : pipeline.commands)
+            command.limits.cpus = cmdTree.limits.cpus;
+
+    return id;
+}
+
+void Shell::unplaceTask(int cpuSet) noexcept
+{
+    placer_.release(cpuSet);
+}
+
+bool Shell::isCaptureCmd(void) const
+{
+    std::stringstream sstream(cmdLine_);
+    std::string cmd; sstream >> cmd;
+    return cmd == captureCmd;
+}
+
+void Shell::capture(void) noexcept
+{
+    try
+    {
+        std::stringstream sstream(cmdLine_);
+        std::string cmd, option, size, extra;
+        sstream >> cmd >> option >> size >> extra;
+
+        const size_t limit = size.empty() ? ::capture::Capture::defLimit
+                                          : ::capture::Capture::parseSize(size);
+
+        // jobs already running keep writing where they did
+        if (option == "on" && limit && extra.empty())
+            captureLimit_ = std::max(limit, ::capture::Capture::minLimit);
+        else if (option == "off" && size.empty())
+            captureLimit_ = 0;
+        else if (!option.empty())
+        {
+            std::cout << "usage: capture [on [SIZE[K|M]] | off], SIZE up to 1024M" << std::endl;
+            return;
+        }
+
+        size_t cnt = 0;
+        uint64_t kept = 0;
+        for (auto const& capture : captures_)
+            if (capture)
+            {
+                cnt++;
+                kept += std::min<uint64_t>(capture->getTotal(), capture->getLimit());
+            }
+
+        if (captureLimit_)
+            std::cout << "capture: on, " << captureLimit_ << " bytes per background job";
+        else
+            std::cout << "capture: off";
+        std::cout << ", " << kept << " bytes of " << cnt << " jobs kept" << std::endl;
+    }
+    catch (std::exception const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+std::shared_ptr<::capture::Capture> Shell::makeCapture(bool isForeground) const noexcept
+{
+    if (isForeground || !captureLimit_)
+        return nullptr;
+
+    try
+    {
+        auto capture = std::make_shared<::capture::Capture>(captureLimit_);
+        if (capture->isValid())
+            return capture;
+
+        std::cerr << "capture: no memory for " << captureLimit_
+                  << " bytes, the job writes to the terminal" << std::endl;
+        return nullptr;
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+void Shell::retireTasks_(void) noexcept
+{
+    try
+    {
+        for (size_t idx : doneTasks_)
+        {
+            TaskItem& taskItem = *tasks_[idx];
+            indexTask_(idx);
+
+            placer_.release(taskItem.cpuSet);
+
+            if (taskItem.capture)
+            {
+                assert(epoll_ctl(epollFd_, EPOLL_CTL_DEL, taskItem.capture->getFd(), NULL) == 0);
+                taskItem.capture->finish();
+            }
+
+            if (!taskItem.isForeground)
+            {
+                std::cout << "[" << idx << "] is done: " << taskItem.cmdLine;
+                if (taskItem.capture && taskItem.capture->getTotal())
+                    std::cout << " (" << taskItem.capture->getTotal()
+                              << " bytes of output, 'jobs -o " << idx << "')";
+                if (!taskItem.breach.empty())
+                    std::cout << " (" << taskItem.breach << " limit)";
+                std::cout << "\n";
+            }
+
+            if (taskItem.isTimed)
+            {
+                std::cout.flush();
+                ::analyze::reportUsage(taskItem.task, taskItem.type,
+                                       ::stats::Stats::nowNs() - taskItem.startSteadyNs, std::cerr);
+            }
+
+            // only the jobs line outlives the task
+            std::ostringstream info;
+            describeTask_(idx, taskItem, info);
+
+            if (finishedTasks_.size() < maxFinishedTasks_)
+                finishedTasks_.push_back(info.str());
+            else
+            {
+                finishedTasks_[finishedHead_] = info.str();
+                finishedHead_ = (finishedHead_ + 1) % maxFinishedTasks_;
+            }
+
+            std::visit([](auto task) { delete task; }, taskItem.task);
+            tasks_[idx].reset();
+        }
+
+        doneTasks_.clear();
+        trimTasks_();
+
+        std::cout.flush();
+    }
+    catch (std::exception const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+void Shell::recordTask_(TaskItem& item) noexcept
+{
+    int status = ::analyze::joinTask(item.task, item.type);
+    if (item.deadline.isExpired)
+        status = ::analyze::timeoutStatus;
+
+    try
+    {
+        item.breach = ::analyze::getBreach(item.task, item.type, item.deadline);
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    history::Entry entry;
+    entry.cmdLine   = item.cmdLine;
+    entry.startNs   = item.startNs;
+    entry.durationNs= ::stats::Stats::nowNs() - item.startSteadyNs;
+    entry.status    = status;
+    entry.type      = (uint8_t)item.type;
+
+    history_.append(entry);
+}
+
+bool Shell::searchHistory_(std::string_view query, bool isOlder, std::string& match) noexcept
+{
+    if (query.empty())
+    {
+        searchBegin_ = searchEnd_ = 0;
+        return false;
+    }
+
+    // a longer query may still match the current line, older skips it
+    history::Entry entry;
+    uint64_t pos = isOlder ? searchBegin_ : searchEnd_;
+
+    while (history_.searchBack(query, pos, entry))
+    {
+        if (isOlder && entry.cmdLine == match)
+        {
+            pos = entry.offset;
+            continue;
+        }
+
+        searchBegin_    = entry.offset;
+        searchEnd_      = entry.offset + entry.size;
+
+        try
+        {
+            match.assign(entry.cmdLine);
+        }
+        catch (std::bad_alloc const& err)
+        {
+            process::PRINT_ERR(err.what());
+            exit(EXIT_FAILURE);
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+bool Shell::drainCapture_(int fd) noexcept
+{
+    for (auto const& taskItem : tasks_)
+        if (taskItem && taskItem->capture && taskItem->capture->getFd() == fd)
+        {
+            taskItem->capture->drain();
+            return true;
+        }
+
+    return false;
+}
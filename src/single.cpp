@@ -2,13 +2,17 @@
 
 #include <unistd.h>
 #include <cassert>
-#include <sstream>
 
 using namespace single;
 
-Single::Single(argv_t const& argv, bool isForeground) noexcept
-    : Process(argv), isForeground_(isForeground), termPid_(getpid())
+Single::Single(argv_t const& argv, bool isForeground, redirs_t const& redirs,
+               stdfds_t const& stdFds, Limits const& limits) noexcept
+    : Process(argv, stdFds, defClsFds, isJobControl() ? newPgid : noPgid, true, redirs, limits),
+      isForeground_(isForeground), termPid_(getpid())
 {
+    if (!isJobControl() || isInline())
+        return;
+
     setpgid(getPid(), getPid());
 
     if (isForeground_)
@@ -21,37 +25,30 @@ Single::~Single(void) noexcept
 {
     join();
 
-    if (isForeground_)
+    if (isForeground_ && isJobControl())
         tcsetpgrp(0, termPid_);
 }
 
-std::pair<Single *,bool> single::make_single(std::string const& cmdLine)
+void * Single::operator new(size_t size)
+{
+    return pool::Pool<Single>::alloc(size);
+}
+
+void Single::operator delete(void * ptr, size_t size) noexcept
 {
-    assert(cmdLine.size() > 0);
-
-    std::stringstream sstream(cmdLine);
-    std::vector<std::string> argv;
-    bool isForeground = true;
-
-    while (!sstream.eof())
-    {
-        std::string token; sstream >> token;
-        if (token == "")
-            continue;
-        if (token == "&")
-        {
-            isForeground = false;
-            break;
-        }
-        if (token[0] == '"')
-        {
-            token.pop_back();
-            token.erase(0, 1);
-        }
-
-        argv.push_back(token);
-    }
-
-    Single * singleProcess = new Single(argv, isForeground);
+    pool::Pool<Single>::free(ptr, size);
+}
+
+std::pair<Single *,bool> single::make_single(parser::CmdTree const& cmdTree,
+                                             process::Process::stdfds_t const& stdFds)
+{
+    assert(cmdTree.pipelines.size() == 1);
+    assert(cmdTree.pipelines[0].commands.size() == 1);
+
+    const auto& command     = cmdTree.pipelines[0].commands[0];
+    const bool isForeground = cmdTree.isForeground;
+
+    Single * singleProcess = new Single(command.argv, isForeground, command.redirs, stdFds,
+                                         command.limits);
     return std::make_pair(singleProcess, isForeground);
 }
@@ -0,0 +1,300 @@
+#include "../inc/stats.hpp"
+#include "../inc/process.hpp"
+
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <climits>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace stats;
+
+namespace {
+
+const char * envStatsPath = "NANOSHELL_STATS";
+const char * metricNames[] = {"parse", "spawn", "start", "reap", "prompt"};
+const uint32_t percentiles[] = {500, 900, 990};     // permille
+
+static_assert(sizeof(metricNames) / sizeof(*metricNames) == Stats::metricCount);
+
+std::string duration(uint64_t ns)
+{
+    std::ostringstream sstream;
+    sstream << std::fixed << std::setprecision(1);
+
+    if (ns < 1000)
+        sstream << ns << "ns";
+    else if (ns < 1000 * 1000)
+        sstream << ns / 1e3 << "us";
+    else if (ns < 1000 * 1000 * 1000)
+        sstream << ns / 1e6 << "ms";
+    else
+        sstream << std::setprecision(2) << ns / 1e9 << "s";
+
+    return sstream.str();
+}
+
+} // namespace
+
+Stats::Timer::Timer(EMetric metric) noexcept
+    : metric_(metric), beginNs_(nowNs())
+{
+}
+
+Stats::Timer::~Timer(void) noexcept
+{
+    Stats::get().record(metric_, nowNs() - beginNs_);
+}
+
+Stats& Stats::get(void) noexcept
+{
+    static Stats stats;
+    return stats;
+}
+
+int64_t Stats::nowNs(void) noexcept
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
+
+std::string Stats::defaultPath(void) noexcept
+{
+    try
+    {
+        if (const char * path = getenv(envStatsPath))
+            return path;
+
+        const char * dir = getenv("XDG_RUNTIME_DIR");
+        return std::string(dir && *dir ? dir : "/tmp") +
+               "/nanoshell." + std::to_string(getpid()) + ".stats";
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+uint32_t Stats::toBucket(uint64_t ns) noexcept
+{
+    constexpr const uint64_t maxNs = (1ull << maxBits) - 1;
+    constexpr const uint64_t subMask = (1u << subBits) - 1;
+
+    if (ns < (1u << subBits))
+        return ns;
+
+    ns = std::min(ns, maxNs);
+    const uint32_t msb = 63 - __builtin_clzll(ns);
+    return ((msb - subBits + 1) << subBits) + ((ns >> (msb - subBits)) & subMask);
+}
+
+uint64_t Stats::fromBucket(uint32_t bucket) noexcept
+{
+    if (bucket < (1u << subBits))
+        return bucket;
+
+    const uint32_t shift = (bucket >> subBits) - 1;
+    const uint64_t sub = bucket & ((1u << subBits) - 1);
+    return (((1ull << subBits) + sub + 1) << shift) - 1;
+}
+
+void Stats::record(EMetric metric, int64_t ns) noexcept
+{
+    Histogram& histogram = table_->metrics[(uint32_t)metric];
+    const uint64_t value = ns < 0 ? 0 : ns;
+
+    histogram.buckets[toBucket(value)].fetch_add(1, std::memory_order_relaxed);
+    histogram.sumNs.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t current = histogram.minNs.load(std::memory_order_relaxed);
+    while (value < current &&
+           !histogram.minNs.compare_exchange_weak(current, value, std::memory_order_relaxed));
+
+    current = histogram.maxNs.load(std::memory_order_relaxed);
+    while (value > current &&
+           !histogram.maxNs.compare_exchange_weak(current, value, std::memory_order_relaxed));
+
+    // last, a reader that sees the count sees the bucket too
+    histogram.count.fetch_add(1, std::memory_order_release);
+}
+
+void Stats::reset(void) noexcept
+{
+    for (auto& histogram : table_->metrics)
+    {
+        histogram.count.store(0, std::memory_order_relaxed);
+        histogram.sumNs.store(0, std::memory_order_relaxed);
+        histogram.minNs.store(UINT64_MAX, std::memory_order_relaxed);
+        histogram.maxNs.store(0, std::memory_order_relaxed);
+
+        for (auto& bucket : histogram.buckets)
+            bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+bool Stats::publish(std::string const& path) noexcept
+{
+    // /tmp is shared: a file left by an old shell of the user goes, anything
+    // else there (a symlink, somebody else's file) makes open() fail
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) && st.st_uid == geteuid())
+        unlink(path.c_str());
+
+    const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd == -1)
+        return false;
+
+    Table * table = nullptr;
+    if (ftruncate(fd, sizeof(Table)) == 0)
+        table = map_(fd);
+    close(fd);
+
+    if (table == nullptr)
+    {
+        unlink(path.c_str());
+        return false;
+    }
+
+    memcpy((void *)table, (void const *)table_, sizeof(Table));
+    assert(munmap(table_, sizeof(Table)) == 0);
+    table_ = table;
+
+    try
+    {
+        path_ = path;
+    }
+    catch (std::bad_alloc const& err)
+    {
+        process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+
+    return true;
+}
+
+std::string const& Stats::getPath(void) const noexcept
+{
+    return path_;
+}
+
+uint64_t Stats::getPercentile(EMetric metric, uint32_t permille) const noexcept
+{
+    Histogram const& histogram = table_->metrics[(uint32_t)metric];
+    uint64_t total = 0;
+
+    for (auto const& bucket : histogram.buckets)
+        total += bucket.load(std::memory_order_relaxed);
+
+    if (total == 0)
+        return 0;
+
+    const uint64_t target = std::max<uint64_t>((total * permille + 999) / 1000, 1);
+    uint64_t seen = 0;
+
+    for (uint32_t bucket = 0; bucket < bucketCount; bucket++)
+    {
+        seen += histogram.buckets[bucket].load(std::memory_order_relaxed);
+        if (seen >= target)
+            return std::min(fromBucket(bucket), histogram.maxNs.load(std::memory_order_relaxed));
+    }
+
+    return histogram.maxNs.load(std::memory_order_relaxed);
+}
+
+Stats::Histogram const& Stats::getHistogram(EMetric metric) const noexcept
+{
+    return table_->metrics[(uint32_t)metric];
+}
+
+void Stats::print(std::ostream& out) const
+{
+    const int width = 10;
+
+    out << std::left << std::setw(8) << "metric" << std::right
+        << std::setw(width) << "count" << std::setw(width) << "min"
+        << std::setw(width) << "p50" << std::setw(width) << "p90"
+        << std::setw(width) << "p99" << std::setw(width) << "max"
+        << std::setw(width) << "mean" << "\n";
+
+    for (uint32_t idx = 0; idx < metricCount; idx++)
+    {
+        const auto metric = (EMetric)idx;
+        Histogram const& histogram = table_->metrics[idx];
+        const uint64_t count = histogram.count.load(std::memory_order_acquire);
+
+        out << std::left << std::setw(8) << histogram.name << std::right
+            << std::setw(width) << count;
+
+        if (count == 0)
+        {
+            out << "\n";
+            continue;
+        }
+
+        out << std::setw(width) << duration(histogram.minNs.load(std::memory_order_relaxed));
+        for (uint32_t permille : percentiles)
+            out << std::setw(width) << duration(getPercentile(metric, permille));
+        out << std::setw(width) << duration(histogram.maxNs.load(std::memory_order_relaxed))
+            << std::setw(width) << duration(histogram.sumNs.load(std::memory_order_relaxed) / count)
+            << "\n";
+    }
+
+    if (!path_.empty())
+        out << "published in " << path_ << "\n";
+}
+
+
+/// Below private interface implementation
+
+Stats::Stats(void) noexcept
+{
+    // shared, so children of a clone record into the same table
+    void * addr = mmap(NULL, sizeof(Table), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    assert(addr != MAP_FAILED);
+
+    table_ = (Table *)addr;
+    init_(*table_);
+}
+
+Stats::~Stats(void) noexcept
+{
+    // forked children exit through here too, the file is the shell's
+    if (!path_.empty() && table_->pid == getpid())
+        unlink(path_.c_str());
+}
+
+Stats::Table * Stats::map_(int fd) noexcept
+{
+    void * addr = mmap(NULL, sizeof(Table), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    return addr == MAP_FAILED ? nullptr : (Table *)addr;
+}
+
+void Stats::init_(Table& table) noexcept
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    memcpy(table.magic, magic, sizeof(magic));
+    table.version       = version;
+    table.subBits       = subBits;
+    table.metricCount   = metricCount;
+    table.bucketCount   = bucketCount;
+    table.pid           = getpid();
+    table.startNs       = (int64_t)ts.tv_sec * 1000 * 1000 * 1000 + ts.tv_nsec;
+
+    for (uint32_t idx = 0; idx < metricCount; idx++)
+        strncpy(table.metrics[idx].name, metricNames[idx], sizeof(table.metrics[idx].name) - 1);
+
+    // the mapping is zeroed, only the minimums need a start value
+    for (auto& histogram : table.metrics)
+        histogram.minNs.store(UINT64_MAX, std::memory_order_relaxed);
+}
@@ -0,0 +1,240 @@
+#include "../inc/stream.hpp"
+#include "../inc/process.hpp"
+
+#include <cstring>
+#include <climits>
+
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+using namespace stream;
+
+/// Below Stream implementation
+
+int Stream::getFd(void) const noexcept
+{
+    return -1;
+}
+
+void Stream::close(void) noexcept
+{}
+
+/// Below FdStream implementation
+
+FdStream::FdStream(int fd, bool isOwner) noexcept
+    : fd_(fd), isOwner_(isOwner)
+{}
+
+FdStream::~FdStream(void) noexcept
+{
+    close();
+}
+
+ssize_t FdStream::read(void * buf, size_t size) noexcept
+{
+    return ::read(fd_, buf, size);
+}
+
+ssize_t FdStream::write(void const * buf, size_t size) noexcept
+{
+    return ::write(fd_, buf, size);
+}
+
+int FdStream::getFd(void) const noexcept
+{
+    return fd_;
+}
+
+void FdStream::close(void) noexcept
+{
+    // std i/o of the shell itself is borrowed, never closed
+    if (isOwner_ && fd_ != -1)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+/// Below Ring implementation
+
+Ring::Ring(size_t capacity) noexcept
+    : mask_(capacity - 1)
+{
+    assert(capacity && (capacity & mask_) == 0); // power of two
+
+    try
+    {
+        buf_ = new char [capacity];
+    }
+    catch (std::bad_alloc const& err)
+    {
+        ::process::PRINT_ERR(err.what());
+        exit(EXIT_FAILURE);
+    }
+}
+
+Ring::~Ring(void) noexcept
+{
+    delete[] buf_;
+}
+
+ssize_t Ring::read(void * buf, size_t size) noexcept
+{
+    const size_t head = head_.load(std::memory_order_relaxed);
+
+    while (true)
+    {
+        const uint32_t seq  = seq_.load(std::memory_order_acquire);
+        const size_t tail   = tail_.load(std::memory_order_acquire);
+        const size_t avail  = tail - head;
+
+        if (avail == 0)
+        {
+            if (isWriteClosed_.load(std::memory_order_acquire))
+                return 0;
+            wait_(seq);
+            continue;
+        }
+
+        const size_t cnt    = std::min(size, avail);
+        const size_t pos    = head & mask_;
+        const size_t first  = std::min(cnt, mask_ + 1 - pos);
+
+        memcpy(buf, buf_ + pos, first);
+        memcpy((char *)buf + first, buf_, cnt - first);
+
+        head_.store(head + cnt, std::memory_order_release);
+        wake_();
+        return cnt;
+    }
+}
+
+ssize_t Ring::write(void const * buf, size_t size) noexcept
+{
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+
+    while (true)
+    {
+        if (isReadClosed_.load(std::memory_order_acquire))
+        {
+            errno = EPIPE;
+            return -1;
+        }
+
+        const uint32_t seq  = seq_.load(std::memory_order_acquire);
+        const size_t head   = head_.load(std::memory_order_acquire);
+        const size_t space  = mask_ + 1 - (tail - head);
+
+        if (space == 0)
+        {
+            wait_(seq);
+            continue;
+        }
+
+        const size_t cnt    = std::min(size, space);
+        const size_t pos    = tail & mask_;
+        const size_t first  = std::min(cnt, mask_ + 1 - pos);
+
+        memcpy(buf_ + pos, buf, first);
+        memcpy(buf_, (char const *)buf + first, cnt - first);
+
+        tail_.store(tail + cnt, std::memory_order_release);
+        wake_();
+        return cnt;
+    }
+}
+
+void Ring::closeRead(void) noexcept
+{
+    isReadClosed_.store(true, std::memory_order_release);
+    wake_();
+}
+
+void Ring::closeWrite(void) noexcept
+{
+    isWriteClosed_.store(true, std::memory_order_release);
+    wake_();
+}
+
+void Ring::wait_(uint32_t seq) noexcept
+{
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+
+    // the peer bumps seq_ after each change, so a stale seq returns at once
+    syscall(SYS_futex, &seq_, FUTEX_WAIT_PRIVATE, seq, NULL, NULL, 0);
+
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void Ring::wake_(void) noexcept
+{
+    seq_.fetch_add(1, std::memory_order_seq_cst);
+
+    if (waiters_.load(std::memory_order_seq_cst))
+        syscall(SYS_futex, &seq_, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/// Below RingReader and RingWriter implementation
+
+RingReader::RingReader(Ring& ring) noexcept
+    : ring_(ring)
+{}
+
+RingReader::~RingReader(void) noexcept
+{
+    close();
+}
+
+ssize_t RingReader::read(void * buf, size_t size) noexcept
+{
+    return ring_.read(buf, size);
+}
+
+ssize_t RingReader::write(void const * buf, size_t size) noexcept
+{
+    (void)buf; (void)size;
+    errno = EBADF;
+    return -1;
+}
+
+void RingReader::close(void) noexcept
+{
+    if (!isClosed_)
+    {
+        ring_.closeRead();
+        isClosed_ = true;
+    }
+}
+
+RingWriter::RingWriter(Ring& ring) noexcept
+    : ring_(ring)
+{}
+
+RingWriter::~RingWriter(void) noexcept
+{
+    close();
+}
+
+ssize_t RingWriter::read(void * buf, size_t size) noexcept
+{
+    (void)buf; (void)size;
+    errno = EBADF;
+    return -1;
+}
+
+ssize_t RingWriter::write(void const * buf, size_t size) noexcept
+{
+    return ring_.write(buf, size);
+}
+
+void RingWriter::close(void) noexcept
+{
+    if (!isClosed_)
+    {
+        ring_.closeWrite();
+        isClosed_ = true;
+    }
+}